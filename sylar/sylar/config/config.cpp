@@ -1,63 +1,565 @@
 #include "../config/config.h"
+#include "../thread/thread.h"
+#include <algorithm>
+#include <cstdlib>
+#include <strings.h>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <dirent.h>
 
 namespace sylar
 {
+    std::atomic<uint64_t> ConfigVarBase::s_epoch(0);
 
-    static void ListAllMember(const std::string &prefix, const YAML::Node &node,
-                              std::list<std::pair<std::string, const YAML::Node>> &output)
+    // 只进入前缀树中存在的子树, 未注册的配置段整体跳过;
+    // 键中含'.'时(如顶层的 system.port: 9900)按段逐级查找, 与嵌套写法等价
+    static void LoadTrieNode(const ConfigTrieNode &trie, const YAML::Node &node,
+                             std::vector<std::pair<ConfigVarBase::ptr, YAML::Node>> &matched)
     {
-        if (prefix.find_first_not_of("abcdefghijklmnopqrstuvwxyz._012345678") !=
-            std::string ::npos)
+        if (!node.IsMap())
         {
-            LOG_ERROR(LOG_ROOT) << "Config invalid name: " << prefix << " : " << node;
             return;
         }
 
-        output.push_back(std::make_pair(prefix, node));
-        if (node.IsMap())
+        std::string lower;
+        for (auto it = node.begin(); it != node.end(); ++it)
         {
-            for (auto it = node.begin(); it != node.end(); ++it)
+            const std::string &key = it->first.Scalar();
+            const std::string *name = &key;
+            if (std::any_of(key.begin(), key.end(), ::isupper))
             {
-                ListAllMember(prefix.empty() ? it->first.Scalar()
-                                             : prefix + "." + it->first.Scalar(),
-                              it->second, output);
+                lower = key;
+                std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                name = &lower;
             }
+            if (name->empty() ||
+                name->find_first_not_of("abcdefghijklmnopqrstuvwxyz._0123456789") != std::string::npos)
+            {
+                LOG_ERROR(LOG_ROOT) << "Config invalid name: " << key << " : " << it->second;
+                continue;
+            }
+
+            const ConfigTrieNode *cur = &trie;
+            size_t begin = 0;
+            while (cur)
+            {
+                size_t end = name->find('.', begin);
+                if (end == std::string::npos)
+                {
+                    // 最后一段(不含'.'时即整个键), 不构造子串
+                    auto child = begin == 0 ? cur->children.find(*name)
+                                            : cur->children.find(name->substr(begin));
+                    cur = child == cur->children.end() ? nullptr : child->second.get();
+                    break;
+                }
+                auto child = cur->children.find(name->substr(begin, end - begin));
+                cur = child == cur->children.end() ? nullptr : child->second.get();
+                begin = end + 1;
+            }
+            if (!cur)
+            {
+                continue;
+            }
+
+            if (cur->var)
+            {
+                matched.push_back(std::make_pair(cur->var, it->second));
+            }
+            if (!cur->children.empty())
+            {
+                LoadTrieNode(*cur, it->second, matched);
+            }
+        }
+    }
+
+    static const size_t kConfigShardCount = 16;
+
+    // 查找只有一次哈希查找, 临界区很短, 使用读写自旋锁; 每个分片独占缓存行, 避免伪共享
+    struct alignas(64) ConfigShard
+    {
+        RWSpinlock mutex;
+        // 名称哈希 -> 配置项, 哈希冲突时比较名称
+        std::unordered_multimap<uint64_t, ConfigVarBase::ptr> datas;
+    };
+
+    static ConfigShard &GetConfigShard(uint64_t hash)
+    {
+        static ConfigShard s_shards[kConfigShardCount];
+        return s_shards[hash % kConfigShardCount];
+    }
+
+    // 配置项名称已统一为小写, 查找键可能含大写
+    static bool ConfigNameEquals(const std::string &name, const ConfigKey &key)
+    {
+        return name.size() == key.len && strncasecmp(name.c_str(), key.name, key.len) == 0;
+    }
+
+    static std::mutex &GetTrieMutex()
+    {
+        static std::mutex s_mutex;
+        return s_mutex;
+    }
+
+    // 串行化所有配置提交
+    static std::mutex &GetCommitMutex()
+    {
+        static std::mutex s_mutex;
+        return s_mutex;
+    }
+
+    /**
+     * @brief 配置回调线程
+     * @details 单线程按投递顺序执行回调, 保证同一配置项的回调按提交顺序触发;
+     *          首次提交时启动. 实例不随静态对象析构, 创建时注册atexit回调, 进程退出时先执行完
+     *          剩余任务再停止线程; atexit回调早于创建之前已构造的静态对象(日志器、配置项等)的析构执行,
+     *          回调中可以安全地使用它们. 停止后投递的任务在调用线程上直接执行
+     */
+    class ConfigListenerExecutor
+    {
+    public:
+        static ConfigListenerExecutor &GetInstance()
+        {
+            static ConfigListenerExecutor *s_executor = Create();
+            return *s_executor;
+        }
+
+        void post(const std::function<void()> &task)
+        {
+            {
+                std::lock_guard<std::mutex> lockGuard(m_mutex);
+                if (!m_stop)
+                {
+                    m_tasks.push_back(task);
+                    ++m_posted;
+                    m_cond.notify_all();
+                    return;
+                }
+            }
+            runTask(task);
+        }
+
+        // 等待当前已投递的任务执行完成
+        void wait()
+        {
+            if (Thread::GetThis() == m_thread.get())
+            {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            uint64_t target = m_posted;
+            m_condDone.wait(lock, [this, target]() { return m_finished >= target; });
+        }
+
+        // 执行完已投递的任务后停止回调线程
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lockGuard(m_mutex);
+                if (m_stop)
+                {
+                    return;
+                }
+                m_stop = true;
+                m_cond.notify_all();
+            }
+            // 在回调中调用exit()时不能等待自身
+            if (Thread::GetThis() != m_thread.get())
+            {
+                m_thread->join();
+            }
+        }
+
+        void record(const std::string &name, uint64_t key, uint64_t costUs)
+        {
+            std::lock_guard<std::mutex> lockGuard(m_statMutex);
+            Config::ListenerStat &stat = m_stats[std::make_pair(name, key)];
+            if (stat.count == 0)
+            {
+                stat.name = name;
+                stat.key = key;
+            }
+            ++stat.count;
+            stat.totalUs += costUs;
+            stat.maxUs = std::max(stat.maxUs, costUs);
+        }
+
+        std::vector<Config::ListenerStat> getStats()
+        {
+            std::lock_guard<std::mutex> lockGuard(m_statMutex);
+            std::vector<Config::ListenerStat> res;
+            res.reserve(m_stats.size());
+            for (auto &i : m_stats)
+            {
+                res.push_back(i.second);
+            }
+            return res;
+        }
+
+    private:
+        ConfigListenerExecutor()
+            : m_stop(false), m_posted(0), m_finished(0)
+        {
+            m_thread.reset(new Thread(std::bind(&ConfigListenerExecutor::run, this), "config_listener"));
+        }
+
+        static ConfigListenerExecutor *Create()
+        {
+            ConfigListenerExecutor *executor = new ConfigListenerExecutor;
+            atexit(&ConfigListenerExecutor::Shutdown);
+            return executor;
+        }
+
+        static void Shutdown()
+        {
+            GetInstance().stop();
+        }
+
+        static void runTask(const std::function<void()> &task)
+        {
+            try
+            {
+                task();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigListenerExecutor listener exception " << e.what() << '\n';
+            }
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true)
+            {
+                m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                {
+                    break;
+                }
+                std::function<void()> task;
+                task.swap(m_tasks.front());
+                m_tasks.pop_front();
+
+                lock.unlock();
+                runTask(task);
+                lock.lock();
+
+                ++m_finished;
+                m_condDone.notify_all();
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;     // 有新任务或需要退出
+        std::condition_variable m_condDone; // 有任务执行完成
+        std::deque<std::function<void()>> m_tasks;
+        bool m_stop;
+        uint64_t m_posted;   // 已投递的任务数
+        uint64_t m_finished; // 已完成的任务数
+        Thread::ptr m_thread;
+
+        std::mutex m_statMutex;
+        std::map<std::pair<std::string, uint64_t>, Config::ListenerStat> m_stats;
+    };
+
+    bool ConfigVarBase::Commit(const std::vector<Change::ptr> &changes)
+    {
+        std::vector<Change::ptr> committed;
+        {
+            std::lock_guard<std::mutex> lockGuard(GetCommitMutex());
+            // 版本号只在有值真正变化时递增, 空提交不会让各线程的 CachedConfig 失效
+            bool begun = false;
+            for (auto &c : changes)
+            {
+                if (c->commit(begun))
+                {
+                    committed.push_back(c);
+                }
+            }
+            if (begun)
+            {
+                s_epoch.fetch_add(1, std::memory_order_release);
+            }
+        }
+        if (committed.empty())
+        {
+            return false;
+        }
+
+        ConfigListenerExecutor::GetInstance().post([committed]() {
+            for (auto &c : committed)
+            {
+                c->notify();
+            }
+        });
+        return true;
+    }
+
+    void ConfigVarBase::BeginPublish(bool &begun)
+    {
+        if (!begun)
+        {
+            begun = true;
+            s_epoch.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void ConfigVarBase::RecordListener(const std::string &name, uint64_t key, uint64_t costUs)
+    {
+        ConfigListenerExecutor::GetInstance().record(name, key, costUs);
+    }
+
+    bool Config::Transaction::commit()
+    {
+        std::vector<ConfigVarBase::Change::ptr> changes;
+        changes.swap(m_changes);
+        bool failed = m_failed;
+        m_failed = false;
+        if (failed)
+        {
+            LOG_ERROR(LOG_ROOT) << "Config::Transaction commit aborted, "
+                                << changes.size() << " staged changes dropped\n";
+            return false;
         }
+        return ConfigVarBase::Commit(changes);
+    }
+
+    void Config::WaitListeners()
+    {
+        ConfigListenerExecutor::GetInstance().wait();
+    }
+
+    std::vector<Config::ListenerStat> Config::GetListenerStats()
+    {
+        return ConfigListenerExecutor::GetInstance().getStats();
     }
 
     void Config::LoadFromYaml(const YAML::Node &root)
     {
-        std::list<std::pair<std::string, const YAML::Node>> allNodes;
-        ListAllMember("", root, allNodes);
+        LoadFromYaml(std::vector<YAML::Node>(1, root));
+    }
 
-        for (auto &i : allNodes)
+    void Config::LoadFromYaml(const std::vector<YAML::Node> &roots)
+    {
+        // 前缀树加锁期间只收集, 回调中可能继续注册配置项, 因此释放锁后再赋值
+        std::vector<std::pair<ConfigVarBase::ptr, YAML::Node>> matched;
         {
-            std::string key = i.first;
-            if (key.empty())
+            std::lock_guard<std::mutex> lockGuard(GetTrieMutex());
+            for (auto &root : roots)
             {
-                continue;
+                LoadTrieNode(getTrie(), root, matched);
+            }
+        }
+
+        // 同一配置项出现多次时以最后一次为准, 保持第一次出现的顺序
+        std::unordered_map<ConfigVarBase *, size_t> index;
+        std::vector<std::pair<ConfigVarBase::ptr, YAML::Node>> merged;
+        for (auto &i : matched)
+        {
+            auto it = index.find(i.first.get());
+            if (it == index.end())
+            {
+                index[i.first.get()] = merged.size();
+                merged.push_back(i);
             }
-            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-            ConfigVarBase::ptr var = LookupBase(key);
-            if (var)
+            else
             {
-                if (i.second.IsScalar())
+                merged[it->second].second = i.second;
+            }
+        }
+
+        std::vector<ConfigVarBase::Change::ptr> changes;
+        for (auto &i : merged)
+        {
+            ConfigVarBase::Change::ptr c = i.first->prepareNode(i.second);
+            if (c)
+            {
+                changes.push_back(c);
+            }
+        }
+
+        ConfigVarBase::Commit(changes);
+    }
+
+    bool Config::LoadFromFiles(const std::vector<std::string> &files, size_t threads)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = std::min(threads, files.size());
+
+        // 各线程按下标领取文件, 结果按下标存放, 合并顺序与解析完成的先后无关
+        std::vector<YAML::Node> roots(files.size());
+        std::vector<std::string> errors(files.size());
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            size_t i;
+            while ((i = next.fetch_add(1, std::memory_order_relaxed)) < files.size())
+            {
+                try
                 {
-                    var->fromString(i.second.Scalar());
+                    roots[i] = YAML::LoadFile(files[i]);
                 }
-                else
+                catch (const std::exception &e)
+                {
+                    errors[i] = e.what();
+                }
+            }
+        };
+
+        std::vector<Thread::ptr> pool;
+        for (size_t i = 1; i < threads; ++i)
+        {
+            pool.push_back(std::make_shared<Thread>(worker, "config_load_" + std::to_string(i)));
+        }
+        worker();
+        for (auto &t : pool)
+        {
+            t->join();
+        }
+
+        bool ok = true;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            if (!errors[i].empty())
+            {
+                LOG_ERROR(LOG_ROOT) << "Config::LoadFromFiles load file = " << files[i]
+                                    << " error: " << errors[i] << '\n';
+                ok = false;
+            }
+        }
+        if (!ok)
+        {
+            return false;
+        }
+
+        LoadFromYaml(roots);
+        return true;
+    }
+
+    bool Config::LoadFromDir(const std::string &path, size_t threads)
+    {
+        DIR *dir = opendir(path.c_str());
+        if (!dir)
+        {
+            LOG_ERROR(LOG_ROOT) << "Config::LoadFromDir opendir error, dir = " << path << '\n';
+            return false;
+        }
+        std::vector<std::string> files;
+        while (struct dirent *ent = readdir(dir))
+        {
+            if (IsYamlFile(ent->d_name))
+            {
+                files.push_back(path + "/" + ent->d_name);
+            }
+        }
+        closedir(dir);
+
+        // 按文件名排序, 保证覆盖顺序确定
+        std::sort(files.begin(), files.end());
+        return LoadFromFiles(files, threads);
+    }
+
+    bool Config::IsYamlFile(const std::string &name)
+    {
+        auto endsWith = [&name](const std::string &suffix)
+        {
+            return name.size() > suffix.size() &&
+                   name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        return !name.empty() && name[0] != '.' && (endsWith(".yml") || endsWith(".yaml"));
+    }
+
+    ConfigVarBase::ptr Config::findData(const ConfigKey &key)
+    {
+        ConfigShard &shard = GetConfigShard(key.hash);
+        RWSpinlock::ReadLock lock(shard.mutex);
+        ConfigVarBase::ptr res;
+        auto range = shard.datas.equal_range(key.hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (ConfigNameEquals(it->second->getName(), key))
+            {
+                res = it->second;
+                break;
+            }
+        }
+        return res;
+    }
+
+    ConfigVarBase::ptr Config::addData(const ConfigKey &key, ConfigVarBase::ptr var)
+    {
+        ConfigShard &shard = GetConfigShard(key.hash);
+        {
+            RWSpinlock::WriteLock lock(shard.mutex);
+            auto range = shard.datas.equal_range(key.hash);
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (ConfigNameEquals(it->second->getName(), key))
                 {
-                    std::stringstream ss;
-                    ss << i.second;
-                    var->fromString(ss.str());
+                    return it->second;
                 }
             }
+            shard.datas.insert(std::make_pair(key.hash, var));
         }
+
+        addTrieNode(var->getName(), var);
+        return var;
+    }
+
+    void Config::addTrieNode(const std::string &name, ConfigVarBase::ptr var)
+    {
+        std::lock_guard<std::mutex> lockGuard(GetTrieMutex());
+        ConfigTrieNode *node = &getTrie();
+        size_t begin = 0;
+        while (true)
+        {
+            size_t end = name.find('.', begin);
+            std::string seg = name.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+            ConfigTrieNode::ptr &child = node->children[seg];
+            if (!child)
+            {
+                child.reset(new ConfigTrieNode);
+            }
+            node = child.get();
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            begin = end + 1;
+        }
+        node->var = var;
     }
 
     ConfigVarBase::ptr Config::LookupBase(const std::string &name)
     {
-        auto it = getDatas().find(name);
-        return it == getDatas().end() ? nullptr : it->second;
+        return findData(ConfigKey(name));
+    }
+
+    ConfigVarBase::ptr Config::LookupBase(const ConfigKey &key)
+    {
+        return findData(key);
+    }
+
+    void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb)
+    {
+        std::vector<ConfigVarBase::ptr> vars;
+        for (size_t i = 0; i < kConfigShardCount; ++i)
+        {
+            ConfigShard &shard = GetConfigShard(i);
+            RWSpinlock::ReadLock lock(shard.mutex);
+            for (auto &it : shard.datas)
+            {
+                vars.push_back(it.second);
+            }
+        }
+        for (auto &i : vars)
+        {
+            cb(i);
+        }
     }
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <string>
 #include "../util/util.h"
 #include "../log/log.h"
+#include "../thread/mutex.h"
 #include "yaml-cpp/yaml.h"
 #include <list>
 #include <map>
@@ -13,6 +14,14 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <vector>
+#include <chrono>
 
 namespace sylar
 {
@@ -32,13 +41,76 @@ namespace sylar
         const std::string &getName() const { return m_name; }
         const std::string &getDescription() const { return m_description; }
 
+        /**
+         * @brief 批量更新中单个配置项的暂存变更
+         * @details 先对所有配置项prepare, 再统一commit发布新值, 最后统一notify触发回调,
+         *          避免回调中观察到只更新了一部分的配置
+         */
+        class Change
+        {
+        public:
+            using ptr = std::shared_ptr<Change>;
+
+            virtual ~Change() {}
+
+            /**
+             * @brief 发布新值, 新值与当前值相同时返回false
+             * @param[in,out] begun 本批是否已开始发布; 第一个真正修改值的变更在写入前调用 BeginPublish
+             */
+            virtual bool commit(bool &begun) = 0;
+            // 触发变更回调(commit成功后调用)
+            virtual void notify() = 0;
+        };
+
         virtual std::string toString() = 0;
         virtual bool fromString(const std::string &str) = 0;
+        virtual bool fromNode(const YAML::Node &node) = 0;
         virtual std::string getTypeName() const = 0;
 
+        /**
+         * @brief 将node转换为暂存变更, 不修改当前值
+         * @return 转换失败返回nullptr
+         */
+        virtual Change::ptr prepareNode(const YAML::Node &node) = 0;
+
+        /**
+         * @brief 将字符串转换为暂存变更, 不修改当前值
+         * @return 转换失败返回nullptr
+         */
+        virtual Change::ptr prepareString(const std::string &str) = 0;
+
+        // 将当前值以二进制编码追加到out, 用于预编译配置快照
+        virtual void toBinary(std::string &out) = 0;
+
+        /**
+         * @brief 将二进制编码转换为暂存变更, 不修改当前值
+         * @return 数据不完整或转换失败返回nullptr
+         */
+        virtual Change::ptr prepareBinary(const char *data, size_t len) = 0;
+
     protected:
+        friend class Config;
+
+        /**
+         * @brief 提交一批暂存变更, 并把回调投递到配置回调线程执行
+         * @details 所有提交由同一把锁串行化; 从第一个值真正变化的配置项写入前到提交完成,
+         *          全局版本号为奇数, 完成后递增为偶数; 没有任何值变化的提交不改变版本号.
+         *          回调按提交顺序在同一个线程中依次执行, 不阻塞提交方
+         * @return 至少有一个配置项的值发生变化时返回true
+         */
+        static bool Commit(const std::vector<Change::ptr> &changes);
+
+        // 记录一次回调的耗时(微秒)
+        static void RecordListener(const std::string &name, uint64_t key, uint64_t costUs);
+
         std::string m_name;
         std::string m_description;
+
+        // 在持有提交锁时调用: 本批第一次修改值之前把版本号递增为奇数
+        static void BeginPublish(bool &begun);
+
+        // 全局配置版本号, 提交开始和完成时各递增一次, 奇数表示正在提交
+        static std::atomic<uint64_t> s_epoch;
     };
 
     template <typename FromType, typename ToType>
@@ -51,26 +123,66 @@ namespace sylar
         }
     };
 
-    // string to vector
+    /**
+     * @brief YAML::Node 直接转换为 T
+     * @details 标量直接取Scalar()做字符串转换; 容器有对应偏特化, 逐个元素递归转换, 不经过字符串;
+     *          只提供了字符串LexicalCast的自定义类型才退回到序列化后再解析
+     */
     template <typename T>
-    class LexicalCast<std::string, std::vector<T>>
+    class NodeCast
     {
     public:
-        std::vector<T> operator()(const std::string &val)
+        T operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
+            if (node.IsScalar())
+            {
+                return LexicalCast<std::string, T>()(node.Scalar());
+            }
             std::stringstream ss;
+            ss << node;
+            return LexicalCast<std::string, T>()(ss.str());
+        }
+    };
+
+    template <typename T>
+    class ConfigEmit;
+
+    // 通过 ConfigEmit 流式序列化为YAML字符串
+    template <typename T>
+    std::string ConfigEmitToString(const T &val)
+    {
+        YAML::Emitter out;
+        ConfigEmit<T>()(out, val);
+        return std::string(out.c_str(), out.size());
+    }
+
+    // node to vector
+    template <typename T>
+    class NodeCast<std::vector<T>>
+    {
+    public:
+        std::vector<T> operator()(const YAML::Node &node)
+        {
             std::vector<T> res;
             for (size_t i = 0; i < node.size(); ++i)
             {
-                ss.str("");
-                ss << node[i];
-                res.push_back(LexicalCast<std::string, T>()(ss.str()));
+                res.push_back(NodeCast<T>()(node[i]));
             }
             return res;
         }
     };
 
+    // string to vector
+    template <typename T>
+    class LexicalCast<std::string, std::vector<T>>
+    {
+    public:
+        std::vector<T> operator()(const std::string &val)
+        {
+            return NodeCast<std::vector<T>>()(YAML::Load(val));
+        }
+    };
+
     // vector to string
     template <typename T>
     class LexicalCast<std::vector<T>, std::string>
@@ -78,37 +190,37 @@ namespace sylar
     public:
         std::string operator()(const std::vector<T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // string to list
+    // node to list
     template <typename T>
-    class LexicalCast<std::string, std::list<T>>
+    class NodeCast<std::list<T>>
     {
     public:
-        std::list<T> operator()(const std::string &val)
+        std::list<T> operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
-            std::stringstream ss;
             std::list<T> res;
             for (size_t i = 0; i < node.size(); ++i)
             {
-                ss.str("");
-                ss << node[i];
-                res.push_back(LexicalCast<std::string, T>()(ss.str()));
+                res.push_back(NodeCast<T>()(node[i]));
             }
             return res;
         }
     };
 
+    // string to list
+    template <typename T>
+    class LexicalCast<std::string, std::list<T>>
+    {
+    public:
+        std::list<T> operator()(const std::string &val)
+        {
+            return NodeCast<std::list<T>>()(YAML::Load(val));
+        }
+    };
+
     // list to string
     template <typename T>
     class LexicalCast<std::list<T>, std::string>
@@ -116,37 +228,37 @@ namespace sylar
     public:
         std::string operator()(const std::list<T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // string to set
+    // node to set
     template <typename T>
-    class LexicalCast<std::string, std::set<T>>
+    class NodeCast<std::set<T>>
     {
     public:
-        std::set<T> operator()(const std::string &val)
+        std::set<T> operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
-            std::stringstream ss;
             std::set<T> res;
             for (size_t i = 0; i < node.size(); ++i)
             {
-                ss.str("");
-                ss << node[i];
-                res.insert(LexicalCast<std::string, T>()(ss.str()));
+                res.insert(NodeCast<T>()(node[i]));
             }
             return res;
         }
     };
 
+    // string to set
+    template <typename T>
+    class LexicalCast<std::string, std::set<T>>
+    {
+    public:
+        std::set<T> operator()(const std::string &val)
+        {
+            return NodeCast<std::set<T>>()(YAML::Load(val));
+        }
+    };
+
     // set to string
     template <typename T>
     class LexicalCast<std::set<T>, std::string>
@@ -154,37 +266,37 @@ namespace sylar
     public:
         std::string operator()(const std::set<T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // string to unordered_set
+    // node to unordered_set
     template <typename T>
-    class LexicalCast<std::string, std::unordered_set<T>>
+    class NodeCast<std::unordered_set<T>>
     {
     public:
-        std::unordered_set<T> operator()(const std::string &val)
+        std::unordered_set<T> operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
-            std::stringstream ss;
             std::unordered_set<T> res;
             for (size_t i = 0; i < node.size(); ++i)
             {
-                ss.str("");
-                ss << node[i];
-                res.insert(LexicalCast<std::string, T>()(ss.str()));
+                res.insert(NodeCast<T>()(node[i]));
             }
             return res;
         }
     };
 
+    // string to unordered_set
+    template <typename T>
+    class LexicalCast<std::string, std::unordered_set<T>>
+    {
+    public:
+        std::unordered_set<T> operator()(const std::string &val)
+        {
+            return NodeCast<std::unordered_set<T>>()(YAML::Load(val));
+        }
+    };
+
     // unordered_set to string
     template <typename T>
     class LexicalCast<std::unordered_set<T>, std::string>
@@ -192,38 +304,37 @@ namespace sylar
     public:
         std::string operator()(const std::unordered_set<T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node.push_back(YAML::Load(LexicalCast<T, std::string>()(i)));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // string to map
+    // node to map
     template <typename T>
-    class LexicalCast<std::string, std::map<std::string, T>>
+    class NodeCast<std::map<std::string, T>>
     {
     public:
-        std::map<std::string, T> operator()(const std::string &val)
+        std::map<std::string, T> operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
-            std::stringstream ss;
             std::map<std::string, T> res;
             for (auto it = node.begin(); it != node.end(); ++it)
             {
-                ss.str("");
-                ss << it->second;
-                res.insert(std::make_pair(it->first.Scalar(),
-                                          LexicalCast<std::string, T>()(ss.str())));
+                res.insert(std::make_pair(it->first.Scalar(), NodeCast<T>()(it->second)));
             }
             return res;
         }
     };
 
+    // string to map
+    template <typename T>
+    class LexicalCast<std::string, std::map<std::string, T>>
+    {
+    public:
+        std::map<std::string, T> operator()(const std::string &val)
+        {
+            return NodeCast<std::map<std::string, T>>()(YAML::Load(val));
+        }
+    };
+
     // map to string
     template <typename T>
     class LexicalCast<std::map<std::string, T>, std::string>
@@ -231,38 +342,37 @@ namespace sylar
     public:
         std::string operator()(const std::map<std::string, T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node[i.first] = YAML::Load(LexicalCast<T, std::string>()(i.second));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // string to unordered_map
+    // node to unordered_map
     template <typename T>
-    class LexicalCast<std::string, std::unordered_map<std::string, T>>
+    class NodeCast<std::unordered_map<std::string, T>>
     {
     public:
-        std::unordered_map<std::string, T> operator()(const std::string &val)
+        std::unordered_map<std::string, T> operator()(const YAML::Node &node)
         {
-            YAML::Node node = YAML::Load(val);
-            std::stringstream ss;
             std::unordered_map<std::string, T> res;
             for (auto it = node.begin(); it != node.end(); ++it)
             {
-                ss.str("");
-                ss << it->second;
-                res.insert(std::make_pair(it->first.Scalar(),
-                                          LexicalCast<std::string, T>()(ss.str())));
+                res.insert(std::make_pair(it->first.Scalar(), NodeCast<T>()(it->second)));
             }
             return res;
         }
     };
 
+    // string to unordered_map
+    template <typename T>
+    class LexicalCast<std::string, std::unordered_map<std::string, T>>
+    {
+    public:
+        std::unordered_map<std::string, T> operator()(const std::string &val)
+        {
+            return NodeCast<std::unordered_map<std::string, T>>()(YAML::Load(val));
+        }
+    };
+
     // unordered_map to string
     template <typename T>
     class LexicalCast<std::unordered_map<std::string, T>, std::string>
@@ -270,182 +380,1415 @@ namespace sylar
     public:
         std::string operator()(const std::unordered_map<std::string, T> &val)
         {
-            YAML::Node node;
-            for (auto &i : val)
-            {
-                node[i.first] = YAML::Load(LexicalCast<T, std::string>()(i.second));
-            }
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
+            return ConfigEmitToString(val);
         }
     };
 
-    // FromStr: T operator()(cosnt std::string&)
-    // ToStr: std::string operator()(const T&)
-    template <typename T, typename FormStr = LexicalCast<std::string, T>,
-              typename ToStr = LexicalCast<T, std::string>>
-    class ConfigVar : public ConfigVarBase
+    /**
+     * @brief 二进制配置快照中值的读取游标
+     * @details 越界读取抛出 std::out_of_range
+     */
+    class ConfigBinaryReader
     {
     public:
-        using ptr = std::shared_ptr<ConfigVar>;
-        using on_change_callback = std::function<void(const T &oldValue, const T &newValue)>;
-
-        ConfigVar(const std::string &name, const T &defaultValue, const std::string &descripton = "")
-            : ConfigVarBase(name, descripton), m_val(defaultValue) {}
+        ConfigBinaryReader(const char *data, size_t len)
+            : m_cur(data), m_end(data + len) {}
 
-        std::string toString() override
+        template <typename T>
+        T readPod()
         {
-            try
-            {
-                //return Util::lexical_cast<std::string>(m_val);
-                return ToStr()(m_val);
-            }
-            catch (const std::exception &e)
-            {
-                LOG_ERROR(LOG_ROOT) << "ConfigVar::toString exception " << e.what()
-                                    << " convert: " << typeid(m_val).name() << "to string"
-                                    << '\n';
-            }
-
-            return "";
+            T val;
+            memcpy(&val, skip(sizeof(T)), sizeof(T));
+            return val;
         }
 
-        bool fromString(const std::string &str) override
+        std::string readBytes()
         {
-            try
-            {
-                //return (m_val = Util::lexical_cast<T>(str));
-                setValue(FormStr()(str));
-            }
-            catch (const std::exception &e)
-            {
-                LOG_ERROR(LOG_ROOT) << "ConfigVar::fromString exception " << e.what()
-                                    << " convert: string to " << typeid(m_val).name()
-                                    << '\n';
-            }
-            return false;
+            uint32_t len = readPod<uint32_t>();
+            const char *p = skip(len);
+            return std::string(p, len);
         }
-        const T getValue() const { return m_val; }
 
-        void setValue(const T &val)
-        {
-            if (val == m_val)
-            {
-                return;
-            }
+        bool eof() const { return m_cur == m_end; }
 
-            for (auto &i : m_callbacks)
+    private:
+        const char *skip(size_t len)
+        {
+            if (static_cast<size_t>(m_end - m_cur) < len)
             {
-                i.second(m_val, val);
+                throw std::out_of_range("config binary truncated");
             }
-            m_val = val;
+            const char *p = m_cur;
+            m_cur += len;
+            return p;
         }
 
-        std::string getTypeName() const override { return typeid(T).name(); }
+    private:
+        const char *m_cur;
+        const char *m_end;
+    };
 
-        void addListener(uint64_t key, on_change_callback callback)
-        {
-            m_callbacks[key] = callback;
-        }
+    template <typename T>
+    inline void ConfigBinaryWritePod(std::string &out, const T &val)
+    {
+        out.append(reinterpret_cast<const char *>(&val), sizeof(T));
+    }
 
-        void delListener(uint64_t key)
+    inline void ConfigBinaryWriteBytes(std::string &out, const std::string &val)
+    {
+        ConfigBinaryWritePod(out, static_cast<uint32_t>(val.size()));
+        out.append(val);
+    }
+
+    /**
+     * @brief 配置值的二进制编码, 用于预编译配置快照
+     * @details 算术类型按内存布局存放, 字符串和容器存放长度前缀, 加载时无需解析文本;
+     *          其他类型退回到 LexicalCast 的字符串形式
+     */
+    template <typename T, typename Enable = void>
+    struct ConfigBinary
+    {
+        static void Encode(const T &val, std::string &out)
         {
-            m_callbacks.erase(key);
+            ConfigBinaryWriteBytes(out, LexicalCast<T, std::string>()(val));
         }
 
-        on_change_callback getListener(uint64_t key)
+        static T Decode(ConfigBinaryReader &in)
         {
-            auto it = m_callbacks.find(key);
-            return it == m_callbacks.end() ? nullptr : it->second;
+            return LexicalCast<std::string, T>()(in.readBytes());
         }
+    };
 
-        void clearListener() { m_callbacks.clear(); }
-
-    private:
-        T m_val;
+    template <typename T>
+    struct ConfigBinary<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    {
+        static void Encode(const T &val, std::string &out) { ConfigBinaryWritePod(out, val); }
+        static T Decode(ConfigBinaryReader &in) { return in.readPod<T>(); }
+    };
 
-        //变更回调函数组，回调函数可以用一个唯一的hash值对其进行关联(目前使用的是一个uint64_t值)
-        std::map<uint64_t, on_change_callback> m_callbacks;
+    template <>
+    struct ConfigBinary<std::string>
+    {
+        static void Encode(const std::string &val, std::string &out) { ConfigBinaryWriteBytes(out, val); }
+        static std::string Decode(ConfigBinaryReader &in) { return in.readBytes(); }
     };
 
-    class Config
+    // 顺序容器/集合: 元素个数 + 逐个元素
+    template <typename Container>
+    struct ConfigBinarySequence
     {
-    public:
-        using ConfigVarMap = std::unordered_map<std::string, ConfigVarBase::ptr>;
+        using value_type = typename Container::value_type;
 
-        /**
-         * @brief 获取/创建对应参数名的配置参数
-         * @param[in] name 配置参数名称
-         * @param[in] defaultValue 参数默认值
-         * @param[in] description 参数描述
-         * @details 获取参数名为name的配置参数,如果存在直接返回
-         *          如果不存在,创建参数配置并用default_value赋值
-         * @return 返回对应的配置参数,如果参数名存在但是类型不匹配则返回nullptr
-         * @exception 如果参数名包含非法字符[^0-9a-z_.] 抛出异常 std::invalid_argument
-         */
-        template <typename T>
-        static typename ConfigVar<T>::ptr Lookup(const std::string &name,
-                                                 const T &defaultValue,
-                                                 const std::string &description = "")
+        static void Encode(const Container &val, std::string &out)
         {
-            auto it = getDatas().find(name);
-            if (it != getDatas().end())
+            ConfigBinaryWritePod(out, static_cast<uint32_t>(val.size()));
+            for (auto &i : val)
             {
-                auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-                if (tmp)
-                {
-                    LOG_INFO(LOG_ROOT) << "Config::Lookup name = " << name << " exists\n";
-                    return tmp;
-                }
-                else
-                {
-                    LOG_ERROR(LOG_ROOT) << "Config::Lookup name = " << name << " exists but type not "
-                                        << typeid(T).name() << ", real type = "
-                                        << it->second->getTypeName() << " value: " << it->second->toString();
-                    return nullptr;
-                }
+                ConfigBinary<value_type>::Encode(i, out);
             }
+        }
 
-            if (name.find_first_not_of("abcdefghijklmnopqrstuvwxyz._012345678") != std::string::npos)
+        static Container Decode(ConfigBinaryReader &in)
+        {
+            Container res;
+            uint32_t size = in.readPod<uint32_t>();
+            for (uint32_t i = 0; i < size; ++i)
             {
-                LOG_ERROR(LOG_ROOT) << "Config::Lookup name invaild " << name << " \n";
-                throw std::invalid_argument(name);
+                res.insert(res.end(), ConfigBinary<value_type>::Decode(in));
             }
+            return res;
+        }
+    };
 
-            typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, defaultValue, description));
-            getDatas()[name] = v;
+    // 字典: 元素个数 + 逐个键值
+    template <typename Container>
+    struct ConfigBinaryMap
+    {
+        using mapped_type = typename Container::mapped_type;
 
-            return v;
+        static void Encode(const Container &val, std::string &out)
+        {
+            ConfigBinaryWritePod(out, static_cast<uint32_t>(val.size()));
+            for (auto &i : val)
+            {
+                ConfigBinaryWriteBytes(out, i.first);
+                ConfigBinary<mapped_type>::Encode(i.second, out);
+            }
         }
 
-        template <typename T>
-        static typename ConfigVar<T>::ptr Lookup(const std::string &name)
+        static Container Decode(ConfigBinaryReader &in)
         {
-            auto it = getDatas().find(name);
-            if (it == getDatas().end())
+            Container res;
+            uint32_t size = in.readPod<uint32_t>();
+            for (uint32_t i = 0; i < size; ++i)
             {
-                return nullptr;
+                std::string key = in.readBytes();
+                res.insert(std::make_pair(key, ConfigBinary<mapped_type>::Decode(in)));
             }
-
-            return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
+            return res;
         }
+    };
 
+    template <typename T>
+    struct ConfigBinary<std::vector<T>> : ConfigBinarySequence<std::vector<T>>
+    {
+    };
+
+    template <typename T>
+    struct ConfigBinary<std::list<T>> : ConfigBinarySequence<std::list<T>>
+    {
+    };
+
+    template <typename T>
+    struct ConfigBinary<std::set<T>> : ConfigBinarySequence<std::set<T>>
+    {
+    };
+
+    template <typename T>
+    struct ConfigBinary<std::unordered_set<T>> : ConfigBinarySequence<std::unordered_set<T>>
+    {
+    };
+
+    template <typename T>
+    struct ConfigBinary<std::map<std::string, T>> : ConfigBinaryMap<std::map<std::string, T>>
+    {
+    };
+
+    template <typename T>
+    struct ConfigBinary<std::unordered_map<std::string, T>> : ConfigBinaryMap<std::unordered_map<std::string, T>>
+    {
+    };
+
+    /**
+     * @brief 配置值的结构化差异, 由 ConfigVar::addDiffListener 的回调接收
+     * @details 默认把整个值视为一次修改; set/map/vector等容器有对应偏特化,
+     *          只给出新增、删除、修改的元素
+     */
+    template <typename T>
+    struct ConfigDiff
+    {
+        ConfigDiff(const T &oldValue, const T &newValue)
+            : oldValue(oldValue), newValue(newValue) {}
+
+        bool empty() const { return oldValue == newValue; }
+
+        const T &oldValue;
+        const T &newValue;
+    };
+
+    /**
+     * @brief vector 按下标比较
+     * @details 公共长度内下标相同而值不同的为修改, 超出旧长度的为新增, 超出新长度的为删除
+     */
+    template <typename T>
+    struct ConfigDiff<std::vector<T>>
+    {
+        struct Changed
+        {
+            size_t index;
+            T oldValue;
+            T newValue;
+        };
+
+        ConfigDiff(const std::vector<T> &oldValue, const std::vector<T> &newValue)
+        {
+            size_t common = std::min(oldValue.size(), newValue.size());
+            for (size_t i = 0; i < common; ++i)
+            {
+                if (!(oldValue[i] == newValue[i]))
+                {
+                    changed.push_back(Changed{i, oldValue[i], newValue[i]});
+                }
+            }
+            for (size_t i = common; i < newValue.size(); ++i)
+            {
+                added.push_back(std::make_pair(i, newValue[i]));
+            }
+            for (size_t i = common; i < oldValue.size(); ++i)
+            {
+                removed.push_back(std::make_pair(i, oldValue[i]));
+            }
+        }
+
+        bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+        std::vector<std::pair<size_t, T>> added;   // 新增的元素(下标, 值)
+        std::vector<std::pair<size_t, T>> removed; // 删除的元素(下标, 值)
+        std::vector<Changed> changed;              // 修改的元素
+    };
+
+    /**
+     * @brief set 按比较器归并, 一次遍历完成
+     * @details 比较器认为等价但 operator== 不相等的元素(如只按name排序的LogDefine)视为修改
+     */
+    template <typename T>
+    struct ConfigDiff<std::set<T>>
+    {
+        struct Changed
+        {
+            T oldValue;
+            T newValue;
+        };
+
+        ConfigDiff(const std::set<T> &oldValue, const std::set<T> &newValue)
+        {
+            auto comp = oldValue.key_comp();
+            auto o = oldValue.begin();
+            auto n = newValue.begin();
+            while (o != oldValue.end() && n != newValue.end())
+            {
+                if (comp(*o, *n))
+                {
+                    removed.push_back(*o++);
+                }
+                else if (comp(*n, *o))
+                {
+                    added.push_back(*n++);
+                }
+                else
+                {
+                    if (!(*o == *n))
+                    {
+                        changed.push_back(Changed{*o, *n});
+                    }
+                    ++o;
+                    ++n;
+                }
+            }
+            removed.insert(removed.end(), o, oldValue.end());
+            added.insert(added.end(), n, newValue.end());
+        }
+
+        bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+        std::vector<T> added;         // 新增的元素
+        std::vector<T> removed;       // 删除的元素
+        std::vector<Changed> changed; // 修改的元素
+    };
+
+    // unordered_set 没有修改, 只有新增和删除
+    template <typename T>
+    struct ConfigDiff<std::unordered_set<T>>
+    {
+        ConfigDiff(const std::unordered_set<T> &oldValue, const std::unordered_set<T> &newValue)
+        {
+            for (auto &i : newValue)
+            {
+                if (!oldValue.count(i))
+                {
+                    added.push_back(i);
+                }
+            }
+            for (auto &i : oldValue)
+            {
+                if (!newValue.count(i))
+                {
+                    removed.push_back(i);
+                }
+            }
+        }
+
+        bool empty() const { return added.empty() && removed.empty(); }
+
+        std::vector<T> added;   // 新增的元素
+        std::vector<T> removed; // 删除的元素
+    };
+
+    // map 按key归并, 一次遍历完成
+    template <typename T>
+    struct ConfigDiff<std::map<std::string, T>>
+    {
+        struct Changed
+        {
+            std::string key;
+            T oldValue;
+            T newValue;
+        };
+
+        ConfigDiff(const std::map<std::string, T> &oldValue, const std::map<std::string, T> &newValue)
+        {
+            auto o = oldValue.begin();
+            auto n = newValue.begin();
+            while (o != oldValue.end() && n != newValue.end())
+            {
+                if (o->first < n->first)
+                {
+                    removed.push_back(*o++);
+                }
+                else if (n->first < o->first)
+                {
+                    added.push_back(*n++);
+                }
+                else
+                {
+                    if (!(o->second == n->second))
+                    {
+                        changed.push_back(Changed{o->first, o->second, n->second});
+                    }
+                    ++o;
+                    ++n;
+                }
+            }
+            removed.insert(removed.end(), o, oldValue.end());
+            added.insert(added.end(), n, newValue.end());
+        }
+
+        bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+        std::vector<std::pair<std::string, T>> added;   // 新增的键值
+        std::vector<std::pair<std::string, T>> removed; // 删除的键值
+        std::vector<Changed> changed;                   // 值被修改的键
+    };
+
+    template <typename T>
+    struct ConfigDiff<std::unordered_map<std::string, T>>
+    {
+        using Changed = typename ConfigDiff<std::map<std::string, T>>::Changed;
+
+        ConfigDiff(const std::unordered_map<std::string, T> &oldValue,
+                   const std::unordered_map<std::string, T> &newValue)
+        {
+            for (auto &i : newValue)
+            {
+                auto it = oldValue.find(i.first);
+                if (it == oldValue.end())
+                {
+                    added.push_back(i);
+                }
+                else if (!(it->second == i.second))
+                {
+                    changed.push_back(Changed{i.first, it->second, i.second});
+                }
+            }
+            for (auto &i : oldValue)
+            {
+                if (!newValue.count(i.first))
+                {
+                    removed.push_back(i);
+                }
+            }
+        }
+
+        bool empty() const { return added.empty() && removed.empty() && changed.empty(); }
+
+        std::vector<std::pair<std::string, T>> added;   // 新增的键值
+        std::vector<std::pair<std::string, T>> removed; // 删除的键值
+        std::vector<Changed> changed;                   // 值被修改的键
+    };
+
+    /**
+     * @brief 将配置值直接写入 YAML::Emitter
+     * @details 算术类型和字符串以标量写入, 容器逐个元素递归写入;
+     *          其他类型退回到 LexicalCast 的字符串形式再解析为节点
+     */
+    template <typename T>
+    class ConfigEmit
+    {
+    public:
+        void operator()(YAML::Emitter &out, const T &val)
+        {
+            emit(out, val, std::integral_constant<bool, std::is_arithmetic<T>::value ||
+                                                            std::is_same<T, std::string>::value>());
+        }
+
+    private:
+        void emit(YAML::Emitter &out, const T &val, std::true_type)
+        {
+            out << LexicalCast<T, std::string>()(val);
+        }
+
+        void emit(YAML::Emitter &out, const T &val, std::false_type)
+        {
+            out << YAML::Load(LexicalCast<T, std::string>()(val));
+        }
+    };
+
+    // 顺序容器/集合: 逐个元素写入序列
+    template <typename Container>
+    class ConfigEmitSequence
+    {
+    public:
+        void operator()(YAML::Emitter &out, const Container &val)
+        {
+            out << YAML::BeginSeq;
+            for (auto &i : val)
+            {
+                ConfigEmit<typename Container::value_type>()(out, i);
+            }
+            out << YAML::EndSeq;
+        }
+    };
+
+    // 字典: 逐个键值写入映射
+    template <typename Container>
+    class ConfigEmitMap
+    {
+    public:
+        void operator()(YAML::Emitter &out, const Container &val)
+        {
+            out << YAML::BeginMap;
+            for (auto &i : val)
+            {
+                out << YAML::Key << i.first << YAML::Value;
+                ConfigEmit<typename Container::mapped_type>()(out, i.second);
+            }
+            out << YAML::EndMap;
+        }
+    };
+
+    template <typename T>
+    class ConfigEmit<std::vector<T>> : public ConfigEmitSequence<std::vector<T>>
+    {
+    };
+
+    template <typename T>
+    class ConfigEmit<std::list<T>> : public ConfigEmitSequence<std::list<T>>
+    {
+    };
+
+    template <typename T>
+    class ConfigEmit<std::set<T>> : public ConfigEmitSequence<std::set<T>>
+    {
+    };
+
+    template <typename T>
+    class ConfigEmit<std::unordered_set<T>> : public ConfigEmitSequence<std::unordered_set<T>>
+    {
+    };
+
+    template <typename T>
+    class ConfigEmit<std::map<std::string, T>> : public ConfigEmitMap<std::map<std::string, T>>
+    {
+    };
+
+    template <typename T>
+    class ConfigEmit<std::unordered_map<std::string, T>> : public ConfigEmitMap<std::unordered_map<std::string, T>>
+    {
+    };
+
+    /**
+     * @brief 自定义配置结构体的字段表, 由 SYLAR_CONFIG_STRUCT 生成
+     * @details Visit(obj, f) 对每个字段调用 f(字段名, obj.字段)
+     */
+    template <typename T>
+    struct ConfigFields;
+
+    // 按字段从节点读取, 节点中没有的字段保持默认值
+    class ConfigStructReader
+    {
+    public:
+        explicit ConfigStructReader(const YAML::Node &node) : m_node(node) {}
+
+        template <typename V>
+        void operator()(const char *key, V &val) const
+        {
+            const YAML::Node child = m_node[key];
+            if (child)
+            {
+                val = NodeCast<V>()(child);
+            }
+        }
+
+    private:
+        const YAML::Node &m_node;
+    };
+
+    // 按字段写入 YAML::Emitter
+    class ConfigStructWriter
+    {
+    public:
+        explicit ConfigStructWriter(YAML::Emitter &out) : m_out(out) {}
+
+        template <typename V>
+        void operator()(const char *key, const V &val) const
+        {
+            m_out << YAML::Key << key << YAML::Value;
+            ConfigEmit<V>()(m_out, val);
+        }
+
+    private:
+        YAML::Emitter &m_out;
+    };
+
+    // 按字段二进制编码
+    class ConfigStructEncoder
+    {
+    public:
+        explicit ConfigStructEncoder(std::string &out) : m_out(out) {}
+
+        template <typename V>
+        void operator()(const char *, const V &val) const
+        {
+            ConfigBinary<V>::Encode(val, m_out);
+        }
+
+    private:
+        std::string &m_out;
+    };
+
+    class ConfigStructDecoder
+    {
+    public:
+        explicit ConfigStructDecoder(ConfigBinaryReader &in) : m_in(in) {}
+
+        template <typename V>
+        void operator()(const char *, V &val) const
+        {
+            val = ConfigBinary<V>::Decode(m_in);
+        }
+
+    private:
+        ConfigBinaryReader &m_in;
+    };
+
+    template <typename T>
+    class ConfigStructNodeCast
+    {
+    public:
+        T operator()(const YAML::Node &node)
+        {
+            if (!node.IsMap())
+            {
+                throw std::invalid_argument("config struct expects a map node");
+            }
+            T res;
+            ConfigStructReader reader(node);
+            ConfigFields<T>::Visit(res, reader);
+            return res;
+        }
+    };
+
+    template <typename T>
+    class ConfigStructEmit
+    {
+    public:
+        void operator()(YAML::Emitter &out, const T &val)
+        {
+            out << YAML::BeginMap;
+            ConfigStructWriter writer(out);
+            ConfigFields<T>::Visit(val, writer);
+            out << YAML::EndMap;
+        }
+    };
+
+    template <typename T>
+    class ConfigStructToString
+    {
+    public:
+        std::string operator()(const T &val)
+        {
+            YAML::Emitter out;
+            ConfigStructEmit<T>()(out, val);
+            return std::string(out.c_str(), out.size());
+        }
+    };
+
+    template <typename T>
+    class ConfigStructFromString
+    {
+    public:
+        T operator()(const std::string &val)
+        {
+            return ConfigStructNodeCast<T>()(YAML::Load(val));
+        }
+    };
+
+    template <typename T>
+    struct ConfigStructBinary
+    {
+        static void Encode(const T &val, std::string &out)
+        {
+            ConfigStructEncoder encoder(out);
+            ConfigFields<T>::Visit(val, encoder);
+        }
+
+        static T Decode(ConfigBinaryReader &in)
+        {
+            T res;
+            ConfigStructDecoder decoder(in);
+            ConfigFields<T>::Visit(res, decoder);
+            return res;
+        }
+    };
+
+#define SYLAR_PP_CAT(a, b) SYLAR_PP_CAT_I(a, b)
+#define SYLAR_PP_CAT_I(a, b) a##b
+#define SYLAR_PP_NARG(...) SYLAR_PP_NARG_I(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define SYLAR_PP_NARG_I(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+#define SYLAR_PP_FOR_EACH(m, ...) SYLAR_PP_CAT(SYLAR_PP_FOR_EACH_, SYLAR_PP_NARG(__VA_ARGS__))(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_1(m, x) m(x)
+#define SYLAR_PP_FOR_EACH_2(m, x, ...) m(x) SYLAR_PP_FOR_EACH_1(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_3(m, x, ...) m(x) SYLAR_PP_FOR_EACH_2(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_4(m, x, ...) m(x) SYLAR_PP_FOR_EACH_3(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_5(m, x, ...) m(x) SYLAR_PP_FOR_EACH_4(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_6(m, x, ...) m(x) SYLAR_PP_FOR_EACH_5(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_7(m, x, ...) m(x) SYLAR_PP_FOR_EACH_6(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_8(m, x, ...) m(x) SYLAR_PP_FOR_EACH_7(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_9(m, x, ...) m(x) SYLAR_PP_FOR_EACH_8(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_10(m, x, ...) m(x) SYLAR_PP_FOR_EACH_9(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_11(m, x, ...) m(x) SYLAR_PP_FOR_EACH_10(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_12(m, x, ...) m(x) SYLAR_PP_FOR_EACH_11(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_13(m, x, ...) m(x) SYLAR_PP_FOR_EACH_12(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_14(m, x, ...) m(x) SYLAR_PP_FOR_EACH_13(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_15(m, x, ...) m(x) SYLAR_PP_FOR_EACH_14(m, __VA_ARGS__)
+#define SYLAR_PP_FOR_EACH_16(m, x, ...) m(x) SYLAR_PP_FOR_EACH_15(m, __VA_ARGS__)
+
+// 参数是否是括号括起来的列表, 是为1, 否则为0
+#define SYLAR_PP_IS_PAREN(x) SYLAR_PP_IS_PAREN_CHECK(SYLAR_PP_IS_PAREN_PROBE x)
+#define SYLAR_PP_IS_PAREN_PROBE(...) ~, 1
+#define SYLAR_PP_IS_PAREN_CHECK(...) SYLAR_PP_IS_PAREN_CHECK_N(__VA_ARGS__, 0, ~)
+#define SYLAR_PP_IS_PAREN_CHECK_N(x, n, ...) n
+
+/**
+ * @brief 指定字段在YAML中的键名, 用于 SYLAR_CONFIG_STRUCT 的字段列表
+ * @details SYLAR_CONFIG_STRUCT(Person, SYLAR_CONFIG_FIELD(m_name, "name"), SYLAR_CONFIG_FIELD(m_age, "age"))
+ */
+#define SYLAR_CONFIG_FIELD(member, key) (member, key)
+
+#define SYLAR_CONFIG_STRUCT_FIELD(field) SYLAR_PP_CAT(SYLAR_CONFIG_STRUCT_FIELD_, SYLAR_PP_IS_PAREN(field))(field)
+#define SYLAR_CONFIG_STRUCT_FIELD_0(field) f(#field, obj.field);
+#define SYLAR_CONFIG_STRUCT_FIELD_1(field) SYLAR_CONFIG_STRUCT_FIELD_KEYED field
+#define SYLAR_CONFIG_STRUCT_FIELD_KEYED(member, key) f(key, obj.member);
+
+/**
+ * @brief 为自定义配置结构体生成字段表以及 NodeCast/LexicalCast/ConfigEmit/ConfigBinary 特化
+ * @details 在全局命名空间中使用, 默认字段名即YAML中的键名, 用 SYLAR_CONFIG_FIELD(成员, "键名") 指定其他键名,
+ *          两种写法可以混用, 最多16个字段; 字段类型本身可以是容器或另一个用该宏声明的结构体.
+ *          结构体需要可默认构造并提供 operator==
+ *          SYLAR_CONFIG_STRUCT(Person, SYLAR_CONFIG_FIELD(m_name, "name"), SYLAR_CONFIG_FIELD(m_age, "age"), sex)
+ */
+#define SYLAR_CONFIG_STRUCT(Type, ...)                                                 \
+    namespace sylar                                                                    \
+    {                                                                                  \
+        template <>                                                                    \
+        struct ConfigFields<Type>                                                      \
+        {                                                                              \
+            template <typename Obj, typename F>                                        \
+            static void Visit(Obj &obj, const F &f)                                    \
+            {                                                                          \
+                SYLAR_PP_FOR_EACH(SYLAR_CONFIG_STRUCT_FIELD, __VA_ARGS__)              \
+            }                                                                          \
+        };                                                                             \
+        template <>                                                                    \
+        class NodeCast<Type> : public ConfigStructNodeCast<Type>                       \
+        {                                                                              \
+        };                                                                             \
+        template <>                                                                    \
+        class LexicalCast<std::string, Type> : public ConfigStructFromString<Type>     \
+        {                                                                              \
+        };                                                                             \
+        template <>                                                                    \
+        class LexicalCast<Type, std::string> : public ConfigStructToString<Type>       \
+        {                                                                              \
+        };                                                                             \
+        template <>                                                                    \
+        class ConfigEmit<Type> : public ConfigStructEmit<Type>                         \
+        {                                                                              \
+        };                                                                             \
+        template <>                                                                    \
+        struct ConfigBinary<Type> : public ConfigStructBinary<Type>                    \
+        {                                                                              \
+        };                                                                             \
+    }
+
+    // 配置值的存储方式
+    enum class ConfigStorageKind
+    {
+        SNAPSHOT, // 不可变快照
+        ATOMIC,   // 原子变量
+        SEQLOCK   // 顺序锁
+    };
+
+    /**
+     * @brief 按类型选择存储方式
+     * @details 不超过一个机器字的可平凡拷贝类型用原子变量; 不超过一个缓存行的可平凡拷贝类型
+     *          (如多个数值组成的小结构体)用顺序锁, 读取只拷贝值、不触碰引用计数; 其余用快照
+     */
+    template <typename T>
+    struct ConfigStorageKindOf
+    {
+        static const ConfigStorageKind value =
+            !std::is_trivially_copyable<T>::value ? ConfigStorageKind::SNAPSHOT
+            : (sizeof(T) <= sizeof(uint64_t))     ? ConfigStorageKind::ATOMIC
+            : (sizeof(T) <= 64)                   ? ConfigStorageKind::SEQLOCK
+                                                  : ConfigStorageKind::SNAPSHOT;
+    };
+
+    // 按值持有的读取句柄, 通过 * 和 -> 访问值
+    template <typename T>
+    class ConfigValueHandle
+    {
+    public:
+        ConfigValueHandle() : m_val() {}
+        explicit ConfigValueHandle(const T &val) : m_val(val) {}
+
+        const T &operator*() const { return m_val; }
+        const T *operator->() const { return &m_val; }
+
+    private:
+        T m_val;
+    };
+
+    /**
+     * @brief 配置值的存储
+     * @details 默认以不可变快照 shared_ptr<const T> 发布(RCU方式): 写入时整体替换快照,
+     *          读取只拿到快照引用, 不拷贝容器; 读者持有的旧快照在其释放后才销毁.
+     *          注意 shared_ptr 的 atomic_load/atomic_store 不是无锁的(libstdc++ 以地址哈希到全局互斥锁池),
+     *          且每次读取都有一次引用计数的原子增减; 热路径上应使用 CachedConfig
+     */
+    template <typename T, ConfigStorageKind Kind = ConfigStorageKindOf<T>::value>
+    class ConfigValueStorage
+    {
+    public:
+        // 读取句柄, 通过 * 和 -> 访问值
+        using handle = std::shared_ptr<const T>;
+
+        explicit ConfigValueStorage(const T &val)
+            : m_ptr(std::make_shared<const T>(val)) {}
+
+        handle get() const { return std::atomic_load_explicit(&m_ptr, std::memory_order_acquire); }
+
+        void set(const T &val)
+        {
+            std::atomic_store_explicit(&m_ptr, handle(std::make_shared<const T>(val)),
+                                       std::memory_order_release);
+        }
+
+    private:
+        handle m_ptr;
+    };
+
+    // 小的可平凡拷贝类型(算术类型、枚举等)直接存放在原子变量中
+    template <typename T>
+    class ConfigValueStorage<T, ConfigStorageKind::ATOMIC>
+    {
+    public:
+        using handle = ConfigValueHandle<T>;
+
+        explicit ConfigValueStorage(const T &val)
+            : m_val(val) {}
+
+        handle get() const { return handle(m_val.load(std::memory_order_acquire)); }
+
+        void set(const T &val) { m_val.store(val, std::memory_order_release); }
+
+    private:
+        std::atomic<T> m_val;
+    };
+
+    // 中等大小的可平凡拷贝类型由顺序锁保护, 读者不加锁, 写入时读者重试
+    template <typename T>
+    class ConfigValueStorage<T, ConfigStorageKind::SEQLOCK>
+    {
+    public:
+        using handle = ConfigValueHandle<T>;
+
+        explicit ConfigValueStorage(const T &val)
+            : m_val(val) {}
+
+        handle get() const { return handle(m_val.load()); }
+
+        void set(const T &val) { m_val.store(val); }
+
+    private:
+        SeqLockValue<T> m_val;
+    };
+
+    // FromStr: T operator()(cosnt std::string&)
+    // ToStr: std::string operator()(const T&)
+    // FromNode: T operator()(const YAML::Node&)
+    template <typename T, typename FormStr = LexicalCast<std::string, T>,
+              typename ToStr = LexicalCast<T, std::string>,
+              typename FromNode = NodeCast<T>>
+    class ConfigVar : public ConfigVarBase
+    {
+    public:
+        using ptr = std::shared_ptr<ConfigVar>;
+        using on_change_callback = std::function<void(const T &oldValue, const T &newValue)>;
+        using on_diff_callback = std::function<void(const ConfigDiff<T> &diff)>;
+        using handle = typename ConfigValueStorage<T>::handle;
+        using value_type = T;
+
+        ConfigVar(const std::string &name, const T &defaultValue, const std::string &descripton = "")
+            : ConfigVarBase(name, descripton), m_val(defaultValue) {}
+
+        std::string toString() override
+        {
+            try
+            {
+                //return Util::lexical_cast<std::string>(m_val);
+                return ToStr()(*m_val.get());
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::toString exception " << e.what()
+                                    << " convert: " << typeid(T).name() << "to string"
+                                    << '\n';
+            }
+
+            return "";
+        }
+
+        bool fromString(const std::string &str) override
+        {
+            try
+            {
+                //return (m_val = Util::lexical_cast<T>(str));
+                setValue(FormStr()(str));
+                return true;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::fromString exception " << e.what()
+                                    << " convert: string to " << typeid(T).name()
+                                    << '\n';
+            }
+            return false;
+        }
+
+        bool fromNode(const YAML::Node &node) override
+        {
+            try
+            {
+                setValue(FromNode()(node));
+                return true;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::fromNode exception " << e.what()
+                                    << " convert: node to " << typeid(T).name()
+                                    << '\n';
+            }
+            return false;
+        }
+
+        Change::ptr prepareNode(const YAML::Node &node) override
+        {
+            try
+            {
+                return Change::ptr(new VarChange(this, FromNode()(node)));
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::prepareNode exception " << e.what()
+                                    << " convert: node to " << typeid(T).name()
+                                    << '\n';
+            }
+            return nullptr;
+        }
+
+        Change::ptr prepareString(const std::string &str) override
+        {
+            try
+            {
+                return prepareValue(FormStr()(str));
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::prepareString exception " << e.what()
+                                    << " convert: string to " << typeid(T).name()
+                                    << '\n';
+            }
+            return nullptr;
+        }
+
+        void toBinary(std::string &out) override
+        {
+            ConfigBinary<T>::Encode(*m_val.get(), out);
+        }
+
+        Change::ptr prepareBinary(const char *data, size_t len) override
+        {
+            try
+            {
+                ConfigBinaryReader in(data, len);
+                T val = ConfigBinary<T>::Decode(in);
+                if (!in.eof())
+                {
+                    throw std::invalid_argument("config binary has trailing data");
+                }
+                return prepareValue(val);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigVar::prepareBinary exception " << e.what()
+                                    << " convert: binary to " << typeid(T).name()
+                                    << '\n';
+            }
+            return nullptr;
+        }
+
+        // 将新值暂存为变更, 不修改当前值
+        Change::ptr prepareValue(const T &val)
+        {
+            return Change::ptr(new VarChange(this, val));
+        }
+
+        /**
+         * @brief 获取当前值的快照句柄(不拷贝), 通过 *handle 或 handle-> 访问
+         * @details 句柄在其生命周期内保持值不变, 不受之后setValue的影响.
+         *          小的可平凡拷贝类型直接读原子变量或顺序锁, 无锁; 其余类型(容器、字符串等)的快照
+         *          经 shared_ptr 的 atomic_load 读取, 内部会短暂获取互斥锁. 只有 CachedConfig 的读取
+         *          对所有类型都是无锁的(版本号未变时只有一次relaxed load)
+         */
+        handle get() const { return m_val.get(); }
+
+        // 返回值的拷贝, 容器类型建议使用get()
+        const T getValue() const { return *m_val.get(); }
+
+        /**
+         * @brief 设置新值
+         * @details 先发布新值, 变更回调随后在配置回调线程中异步执行,
+         *          需要等待回调完成时调用 Config::WaitListeners()
+         */
+        void setValue(const T &val)
+        {
+            Commit(std::vector<Change::ptr>(1, prepareValue(val)));
+        }
+
+        std::string getTypeName() const override { return typeid(T).name(); }
+
+        void addListener(uint64_t key, on_change_callback callback)
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            m_callbacks[key] = callback;
+        }
+
+        /**
+         * @brief 添加差异回调, 只接收新增、删除、修改的元素
+         * @details 差异在每次变更时只计算一次, 由所有差异回调共享;
+         *          key与addListener共用, delListener/clearListener同样作用于差异回调
+         */
+        void addDiffListener(uint64_t key, on_diff_callback callback)
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            m_diffCallbacks[key] = callback;
+        }
+
+        void delListener(uint64_t key)
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            m_callbacks.erase(key);
+            m_diffCallbacks.erase(key);
+        }
+
+        on_change_callback getListener(uint64_t key)
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            auto it = m_callbacks.find(key);
+            return it == m_callbacks.end() ? nullptr : it->second;
+        }
+
+        void clearListener()
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            m_callbacks.clear();
+            m_diffCallbacks.clear();
+        }
+
+    private:
+        class VarChange : public Change
+        {
+        public:
+            VarChange(ConfigVar *var, const T &val)
+                : m_var(var), m_new(val) {}
+
+            bool commit(bool &begun) override
+            {
+                std::lock_guard<std::mutex> lockGuard(m_var->m_mutex);
+                m_old = m_var->m_val.get();
+                if (m_new == *m_old)
+                {
+                    return false;
+                }
+                BeginPublish(begun);
+                m_callbacks.assign(m_var->m_callbacks.begin(), m_var->m_callbacks.end());
+                m_diffCallbacks.assign(m_var->m_diffCallbacks.begin(), m_var->m_diffCallbacks.end());
+                m_var->m_val.set(m_new);
+                return true;
+            }
+
+            void notify() override
+            {
+                for (auto &i : m_callbacks)
+                {
+                    auto begin = std::chrono::steady_clock::now();
+                    i.second(*m_old, m_new);
+                    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin);
+                    RecordListener(m_var->getName(), i.first, cost.count());
+                }
+
+                if (m_diffCallbacks.empty())
+                {
+                    return;
+                }
+                ConfigDiff<T> diff(*m_old, m_new);
+                if (diff.empty())
+                {
+                    return;
+                }
+                for (auto &i : m_diffCallbacks)
+                {
+                    auto begin = std::chrono::steady_clock::now();
+                    i.second(diff);
+                    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - begin);
+                    RecordListener(m_var->getName(), i.first, cost.count());
+                }
+            }
+
+        private:
+            ConfigVar *m_var;                             // 配置项(注册后不会销毁)
+            T m_new;                                      // 新值
+            handle m_old;                                 // 提交前的值
+            std::vector<std::pair<uint64_t, on_change_callback>> m_callbacks;   // 提交时的回调快照
+            std::vector<std::pair<uint64_t, on_diff_callback>> m_diffCallbacks; // 提交时的差异回调快照
+        };
+
+    private:
+        ConfigValueStorage<T> m_val;
+
+        //变更回调函数组，回调函数可以用一个唯一的hash值对其进行关联(目前使用的是一个uint64_t值)
+        std::map<uint64_t, on_change_callback> m_callbacks;
+        std::map<uint64_t, on_diff_callback> m_diffCallbacks; // 差异回调
+        std::mutex m_mutex; // 保护写入和回调的增删, 读取不加锁
+    };
+
+    // 配置项名称前缀树: 按"."分段, LoadFromYaml只遍历包含已注册配置项的子树
+    struct ConfigTrieNode
+    {
+        using ptr = std::shared_ptr<ConfigTrieNode>;
+
+        ConfigVarBase::ptr var;                                        // 以该节点结尾的配置项
+        std::unordered_map<std::string, ConfigTrieNode::ptr> children; // 下一段名称 -> 子节点
+    };
+
+    /**
+     * @brief 配置项名称哈希(FNV-1a, 忽略大小写)
+     * @details constexpr实现, 字面量名称可在编译期求值
+     */
+    constexpr uint64_t ConfigHash(const char *str, uint64_t hash = 0xcbf29ce484222325ULL)
+    {
+        return *str ? ConfigHash(str + 1,
+                                 (hash ^ static_cast<unsigned char>((*str >= 'A' && *str <= 'Z')
+                                                                        ? *str - 'A' + 'a'
+                                                                        : *str)) *
+                                     0x100000001b3ULL)
+                    : hash;
+    }
+
+    // 配置项查找键: 名称 + 预先计算好的哈希
+    struct ConfigKey
+    {
+        constexpr ConfigKey(const char *n, size_t l, uint64_t h)
+            : name(n), len(l), hash(h) {}
+
+        explicit ConfigKey(const std::string &n)
+            : name(n.c_str()), len(n.size()), hash(ConfigHash(n.c_str())) {}
+
+        const char *name;
+        size_t len;
+        uint64_t hash;
+    };
+
+/**
+ * @brief 以字面量名称构造ConfigKey, 哈希在编译期计算
+ * @details sylar::Config::Lookup<int>(SYLAR_CONFIG("system.port"))
+ */
+#define SYLAR_CONFIG(name) \
+    sylar::ConfigKey(name, sizeof(name) - 1, std::integral_constant<uint64_t, sylar::ConfigHash(name)>::value)
+
+    class Config
+    {
+    public:
+        /**
+         * @brief 配置事务: 暂存多个配置项的新值, 一次性提交
+         * @details 提交时所有配置项在同一把提交锁下发布, 全局版本号只前进一个版本,
+         *          回调在所有新值发布之后才执行, 观察不到只更新了一部分的配置.
+         *          批量一致性只对回调和 CachedConfig 的读者成立; 直接调用 ConfigVar::get() 的读者
+         *          逐项读取, 提交过程中可能读到一部分新值和一部分旧值.
+         *          任意一项转换失败(或配置项为空)则整个事务放弃提交.
+         *          sylar::Config::Transaction().set(g_port, 8080).set(g_host, host).commit();
+         */
+        class Transaction
+        {
+        public:
+            Transaction() : m_failed(false) {}
+
+            template <typename Var>
+            Transaction &set(const std::shared_ptr<Var> &var, const typename Var::value_type &val)
+            {
+                return add(var ? var->prepareValue(val) : nullptr);
+            }
+
+            // 按YAML节点暂存
+            Transaction &set(ConfigVarBase::ptr var, const YAML::Node &node)
+            {
+                return add(var ? var->prepareNode(node) : nullptr);
+            }
+
+            // 按字符串暂存
+            Transaction &setString(ConfigVarBase::ptr var, const std::string &str)
+            {
+                return add(var ? var->prepareString(str) : nullptr);
+            }
+
+            // 按二进制编码暂存(见 ConfigBinary)
+            Transaction &setBinary(ConfigVarBase::ptr var, const char *data, size_t len)
+            {
+                return add(var ? var->prepareBinary(data, len) : nullptr);
+            }
+
+            /**
+             * @brief 提交所有暂存的变更, 提交后事务被清空
+             * @return 存在转换失败的项或者没有值发生变化时返回false
+             */
+            bool commit();
+
+            // 是否有暂存失败的项(失败的事务提交时会被整体放弃)
+            bool failed() const { return m_failed; }
+
+        private:
+            Transaction &add(ConfigVarBase::Change::ptr change)
+            {
+                if (change)
+                {
+                    m_changes.push_back(change);
+                }
+                else
+                {
+                    m_failed = true;
+                }
+                return *this;
+            }
+
+        private:
+            std::vector<ConfigVarBase::Change::ptr> m_changes;
+            bool m_failed; // 是否有暂存失败的项
+        };
+
+        // 单个回调的耗时统计
+        struct ListenerStat
+        {
+            std::string name;   // 配置项名称
+            uint64_t key;       // 回调的key
+            uint64_t count;     // 执行次数
+            uint64_t totalUs;   // 累计耗时(微秒)
+            uint64_t maxUs;     // 最大耗时(微秒)
+        };
+
+        /**
+         * @brief 获取/创建对应参数名的配置参数
+         * @param[in] name 配置参数名称
+         * @param[in] defaultValue 参数默认值
+         * @param[in] description 参数描述
+         * @details 获取参数名为name的配置参数,如果存在直接返回
+         *          如果不存在,创建参数配置并用default_value赋值
+         * @return 返回对应的配置参数,如果参数名存在但是类型不匹配则返回nullptr
+         * @exception 如果参数名包含非法字符[^0-9a-z_.] 抛出异常 std::invalid_argument
+         */
+        template <typename T>
+        static typename ConfigVar<T>::ptr Lookup(const std::string &name,
+                                                 const T &defaultValue,
+                                                 const std::string &description = "")
+        {
+            ConfigKey key(name);
+            ConfigVarBase::ptr base = findData(key);
+            if (!base)
+            {
+                if (name.find_first_not_of("abcdefghijklmnopqrstuvwxyz._0123456789") != std::string::npos)
+                {
+                    LOG_ERROR(LOG_ROOT) << "Config::Lookup name invaild " << name << " \n";
+                    throw std::invalid_argument(name);
+                }
+
+                typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, defaultValue, description));
+                base = addData(key, v);
+                if (base == v)
+                {
+                    return v;
+                }
+            }
+
+            auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(base);
+            if (tmp)
+            {
+                LOG_INFO(LOG_ROOT) << "Config::Lookup name = " << name << " exists\n";
+                return tmp;
+            }
+            else
+            {
+                LOG_ERROR(LOG_ROOT) << "Config::Lookup name = " << name << " exists but type not "
+                                    << typeid(T).name() << ", real type = "
+                                    << base->getTypeName() << " value: " << base->toString();
+                return nullptr;
+            }
+        }
+
+        template <typename T>
+        static typename ConfigVar<T>::ptr Lookup(const std::string &name)
+        {
+            return Lookup<T>(ConfigKey(name));
+        }
+
+        /**
+         * @brief 按预先计算好哈希的键查找, 不分配内存
+         * @details sylar::Config::Lookup<int>(SYLAR_CONFIG("system.port"))
+         */
+        template <typename T>
+        static typename ConfigVar<T>::ptr Lookup(const ConfigKey &key)
+        {
+            return std::dynamic_pointer_cast<ConfigVar<T>>(findData(key));
+        }
+
+        /**
+         * @brief 从YAML加载配置
+         * @details 先转换所有匹配的配置项, 再作为一个事务统一发布新值,
+         *          回调在配置回调线程中异步执行
+         */
         static void LoadFromYaml(const YAML::Node &root);
 
+        /**
+         * @brief 从多个YAML批量加载配置, 同一配置项以后面的为准
+         */
+        static void LoadFromYaml(const std::vector<YAML::Node> &roots);
+
+        /**
+         * @brief 并行解析多个YAML文件, 按给定顺序合并后作为一个批次加载
+         * @param[in] files YAML文件, 同一配置项以后面的为准
+         * @param[in] threads 解析线程数, 0表示取CPU核数
+         * @return 任意一个文件解析失败时不加载任何配置, 返回false
+         */
+        static bool LoadFromFiles(const std::vector<std::string> &files, size_t threads = 0);
+
+        /**
+         * @brief 加载目录下所有 .yml 和 .yaml 文件
+         * @details 按文件名排序决定覆盖顺序, 与解析完成的先后无关
+         * @return 目录无法读取或任意一个文件解析失败时返回false
+         */
+        static bool LoadFromDir(const std::string &path, size_t threads = 0);
+
+        // 是否是YAML配置文件(.yml/.yaml, 忽略隐藏文件)
+        static bool IsYamlFile(const std::string &name);
+
         static ConfigVarBase::ptr LookupBase(const std::string &name);
+        static ConfigVarBase::ptr LookupBase(const ConfigKey &key);
+
+        /**
+         * @brief 遍历所有已注册的配置项
+         * @details 先复制出配置项列表再回调, 回调中可以继续注册配置项
+         */
+        static void Visit(std::function<void(ConfigVarBase::ptr)> cb);
+
+        /**
+         * @brief 等待已提交变更的回调全部执行完成
+         * @details 在回调线程中调用时直接返回. 进程退出时(atexit)剩余的回调会先执行完, 不需要在退出前调用
+         */
+        static void WaitListeners();
+
+        // 获取各回调的耗时统计
+        static std::vector<ListenerStat> GetListenerStats();
+
+        /**
+         * @brief 全局配置版本号, 每次提交前后各递增一次, 奇数表示正在提交
+         * @details relaxed读取, 观察到变化后需要 acquire fence 再读取配置值
+         */
+        static uint64_t GetEpoch()
+        {
+            return ConfigVarBase::s_epoch.load(std::memory_order_relaxed);
+        }
 
     private:
-        /*  static ConfigVarMap m_datas; 
-            最初实现是成员函数直接操纵的m_datas中的数据(non-local static)--->存在初始化次序的问题；
-            所以更改为local static(使用静态成员函数返回静态成员的引用) */
-        static ConfigVarMap &getDatas()
+        /*  注册表按名称哈希分片, 每个分片由读写锁保护, 运行期可在任意线程查找;
+            数据均为local static, 避免non-local static的初始化次序问题 */
+        static ConfigVarBase::ptr findData(const ConfigKey &key);
+
+        // 插入配置项, 同名配置项已存在时返回已存在的配置项
+        static ConfigVarBase::ptr addData(const ConfigKey &key, ConfigVarBase::ptr var);
+
+        static ConfigTrieNode &getTrie()
         {
-            static ConfigVarMap m_datas;
-            return m_datas;
+            static ConfigTrieNode m_trie;
+            return m_trie;
         }
+
+        static void addTrieNode(const std::string &name, ConfigVarBase::ptr var);
     };
 
+    /**
+     * @brief 线程本地缓存的配置值
+     * @details 缓存配置值的快照句柄, 只有全局版本号变化时才重新读取;
+     *          稳定状态下一次读取只有一次relaxed load和一次比较.
+     *          重新读取按顺序锁的方式进行: 读取前后版本号相同且为偶数(没有提交在进行)才采用,
+     *          缓存的值一定是 getEpoch() 版本对应的值; 版本号相同的多个 CachedConfig 来自同一批已完成的提交,
+     *          事务的批量一致性只对这样的读者成立.
+     *          对象本身不是线程安全的, 应按线程声明:
+     *          static thread_local sylar::CachedConfig<int> s_port(g_port);
+     */
+    template <typename T>
+    class CachedConfig
+    {
+    public:
+        using handle = typename ConfigVar<T>::handle;
+
+        explicit CachedConfig(typename ConfigVar<T>::ptr var)
+            : m_var(var), m_epoch(0)
+        {
+            load(Config::GetEpoch());
+        }
+
+        const T &get()
+        {
+            uint64_t epoch = Config::GetEpoch();
+            if (epoch != m_epoch)
+            {
+                load(epoch);
+            }
+            return *m_val;
+        }
+
+        const T &operator*() { return get(); }
+        const T *operator->() { return &get(); }
+
+        // 缓存值对应的全局版本号
+        uint64_t getEpoch() const { return m_epoch; }
+
+    private:
+        // 读取版本号epoch对应的值, 期间有提交开始或完成则重试
+        void load(uint64_t epoch)
+        {
+            SpinBackoff backoff;
+            while (true)
+            {
+                if (!(epoch & 1))
+                {
+                    // 与提交完成时的release递增配对, 保证读到该版本号对应的值
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    handle val = m_var->get();
+                    // 值的读取不能被重排到下面的版本号读取之后
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    uint64_t after = Config::GetEpoch();
+                    if (after == epoch)
+                    {
+                        m_val = val;
+                        m_epoch = epoch;
+                        return;
+                    }
+                    epoch = after;
+                    continue;
+                }
+                // 提交正在进行, 等待其完成
+                backoff.pause();
+                epoch = Config::GetEpoch();
+            }
+        }
+
+    private:
+        typename ConfigVar<T>::ptr m_var; // 对应的配置项
+        uint64_t m_epoch;                 // 缓存时的全局版本号
+        handle m_val;                     // 缓存的值
+    };
 }
 
 #endif // __CONFIG_H__
\ No newline at end of file
@@ -0,0 +1,344 @@
+#include "config_snapshot.h"
+#include "config.h"
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+namespace sylar
+{
+    static const char kSnapshotMagic[8] = {'S', 'Y', 'L', 'A', 'R', 'C', 'F', 'G'};
+
+    /*  文件布局(本机字节序):
+        SnapshotHeader | SnapshotEntry[count](按hash升序) | 源文件列表 | 名称、类型、值
+        所有offset均相对文件开头 */
+    struct SnapshotHeader
+    {
+        char magic[8];         // 魔数
+        uint32_t version;      // 格式版本
+        uint32_t count;        // 条目数
+        uint64_t fileSize;     // 文件大小
+        uint32_t sourceOffset; // 源文件列表偏移
+        uint32_t sourceCount;  // 源文件个数
+    };
+
+    struct SnapshotEntry
+    {
+        uint64_t hash;        // 名称哈希(ConfigHash)
+        uint32_t nameOffset;  // 名称
+        uint32_t nameLen;
+        uint32_t typeOffset;  // 类型名(getTypeName)
+        uint32_t typeLen;
+        uint32_t valueOffset; // 值(ConfigBinary编码)
+        uint32_t valueLen;
+    };
+
+    static const SnapshotEntry *GetEntries(const char *data)
+    {
+        return reinterpret_cast<const SnapshotEntry *>(data + sizeof(SnapshotHeader));
+    }
+
+    bool ConfigSnapshot::StatSource(const std::string &path, Source &source)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        source.path = path;
+        source.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        source.size = st.st_size;
+        return true;
+    }
+
+    bool ConfigSnapshot::Compile(const std::string &path, const std::vector<std::string> &sources)
+    {
+        struct Item
+        {
+            uint64_t hash;
+            std::string name;
+            std::string type;
+            std::string value;
+        };
+        std::vector<Item> items;
+        Config::Visit([&items](ConfigVarBase::ptr var)
+                      {
+                          Item item;
+                          item.name = var->getName();
+                          item.hash = ConfigHash(item.name.c_str());
+                          item.type = var->getTypeName();
+                          var->toBinary(item.value);
+                          items.push_back(std::move(item));
+                      });
+        std::sort(items.begin(), items.end(), [](const Item &a, const Item &b)
+                  { return a.hash < b.hash || (a.hash == b.hash && a.name < b.name); });
+
+        std::string sourceData;
+        for (auto &i : sources)
+        {
+            Source source;
+            if (!StatSource(i, source))
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Compile stat source " << i
+                                    << " failed: " << strerror(errno) << '\n';
+                return false;
+            }
+            ConfigBinaryWriteBytes(sourceData, source.path);
+            ConfigBinaryWritePod(sourceData, source.mtime);
+            ConfigBinaryWritePod(sourceData, source.size);
+        }
+
+        SnapshotHeader header;
+        memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+        header.version = kVersion;
+        header.count = items.size();
+        header.sourceOffset = sizeof(SnapshotHeader) + sizeof(SnapshotEntry) * items.size();
+        header.sourceCount = sources.size();
+
+        std::string body;
+        std::vector<SnapshotEntry> entries(items.size());
+        uint32_t base = header.sourceOffset + sourceData.size();
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            SnapshotEntry &e = entries[i];
+            e.hash = items[i].hash;
+            e.nameOffset = base + body.size();
+            e.nameLen = items[i].name.size();
+            body.append(items[i].name);
+            e.typeOffset = base + body.size();
+            e.typeLen = items[i].type.size();
+            body.append(items[i].type);
+            e.valueOffset = base + body.size();
+            e.valueLen = items[i].value.size();
+            body.append(items[i].value);
+        }
+        header.fileSize = base + body.size();
+
+        std::string data;
+        data.reserve(header.fileSize);
+        data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        data.append(reinterpret_cast<const char *>(entries.data()), sizeof(SnapshotEntry) * entries.size());
+        data.append(sourceData);
+        data.append(body);
+
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Compile open " << tmp
+                                << " failed: " << strerror(errno) << '\n';
+            return false;
+        }
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t n = write(fd, data.data() + written, data.size() - written);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Compile write " << tmp
+                                    << " failed: " << strerror(errno) << '\n';
+                close(fd);
+                unlink(tmp.c_str());
+                return false;
+            }
+            written += n;
+        }
+        close(fd);
+
+        if (rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Compile rename " << tmp << " to " << path
+                                << " failed: " << strerror(errno) << '\n';
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    ConfigSnapshot::ptr ConfigSnapshot::Open(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader))
+        {
+            close(fd);
+            return nullptr;
+        }
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Open mmap " << path
+                                << " failed: " << strerror(errno) << '\n';
+            return nullptr;
+        }
+
+        ptr snapshot(new ConfigSnapshot);
+        snapshot->m_data = static_cast<const char *>(addr);
+        snapshot->m_size = st.st_size;
+        if (!snapshot->parse())
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Open " << path << " invalid snapshot\n";
+            return nullptr;
+        }
+        return snapshot;
+    }
+
+    ConfigSnapshot::~ConfigSnapshot()
+    {
+        if (m_data)
+        {
+            munmap(const_cast<char *>(m_data), m_size);
+        }
+    }
+
+    // 一次性校验所有偏移, 之后的查找和解码不再检查越界
+    bool ConfigSnapshot::parse()
+    {
+        const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(m_data);
+        if (memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 ||
+            header->version != kVersion || header->fileSize != m_size)
+        {
+            return false;
+        }
+
+        uint64_t entriesEnd = sizeof(SnapshotHeader) + sizeof(SnapshotEntry) * static_cast<uint64_t>(header->count);
+        if (entriesEnd > m_size || header->sourceOffset < entriesEnd || header->sourceOffset > m_size)
+        {
+            return false;
+        }
+
+        auto inRange = [this](uint32_t offset, uint32_t len)
+        { return static_cast<uint64_t>(offset) + len <= m_size; };
+        const SnapshotEntry *entries = GetEntries(m_data);
+        for (uint32_t i = 0; i < header->count; ++i)
+        {
+            const SnapshotEntry &e = entries[i];
+            if (!inRange(e.nameOffset, e.nameLen) || !inRange(e.typeOffset, e.typeLen) ||
+                !inRange(e.valueOffset, e.valueLen) || (i > 0 && entries[i - 1].hash > e.hash))
+            {
+                return false;
+            }
+        }
+
+        try
+        {
+            ConfigBinaryReader in(m_data + header->sourceOffset, m_size - header->sourceOffset);
+            for (uint32_t i = 0; i < header->sourceCount; ++i)
+            {
+                Source source;
+                source.path = in.readBytes();
+                source.mtime = in.readPod<int64_t>();
+                source.size = in.readPod<int64_t>();
+                m_sources.push_back(source.path);
+                m_stats.push_back(source);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    size_t ConfigSnapshot::size() const
+    {
+        return reinterpret_cast<const SnapshotHeader *>(m_data)->count;
+    }
+
+    int64_t ConfigSnapshot::find(const std::string &name) const
+    {
+        const SnapshotEntry *begin = GetEntries(m_data);
+        const SnapshotEntry *end = begin + size();
+        uint64_t hash = ConfigHash(name.c_str());
+        auto it = std::lower_bound(begin, end, hash, [](const SnapshotEntry &e, uint64_t h)
+                                   { return e.hash < h; });
+        for (; it != end && it->hash == hash; ++it)
+        {
+            if (it->nameLen == name.size() && memcmp(m_data + it->nameOffset, name.c_str(), name.size()) == 0)
+            {
+                return it - begin;
+            }
+        }
+        return -1;
+    }
+
+    bool ConfigSnapshot::isStale() const
+    {
+        for (auto &i : m_stats)
+        {
+            Source source;
+            if (!StatSource(i.path, source) || source.mtime != i.mtime || source.size != i.size)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ConfigSnapshot::apply() const
+    {
+        const SnapshotEntry *entries = GetEntries(m_data);
+        Config::Transaction trans;
+        Config::Visit([this, entries, &trans](ConfigVarBase::ptr var)
+                      {
+                          int64_t idx = find(var->getName());
+                          if (idx < 0)
+                          {
+                              return;
+                          }
+                          const SnapshotEntry &e = entries[idx];
+                          std::string type = var->getTypeName();
+                          if (type.size() != e.typeLen || memcmp(m_data + e.typeOffset, type.c_str(), e.typeLen) != 0)
+                          {
+                              LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::apply " << var->getName()
+                                                  << " type changed, skipped\n";
+                              return;
+                          }
+                          trans.setBinary(var, m_data + e.valueOffset, e.valueLen);
+                      });
+        if (trans.failed())
+        {
+            return false;
+        }
+        trans.commit();
+        return true;
+    }
+
+    bool ConfigSnapshot::Load(const std::string &path, const std::vector<std::string> &sources)
+    {
+        ptr snapshot = Open(path);
+        if (snapshot && snapshot->getSources() == sources && !snapshot->isStale() && snapshot->apply())
+        {
+            return true;
+        }
+
+        std::vector<YAML::Node> roots;
+        for (auto &i : sources)
+        {
+            try
+            {
+                roots.push_back(YAML::LoadFile(i));
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(LOG_ROOT) << "ConfigSnapshot::Load load " << i << " failed: " << e.what() << '\n';
+                return false;
+            }
+        }
+        Config::LoadFromYaml(roots);
+        Compile(path, sources);
+        return true;
+    }
+}
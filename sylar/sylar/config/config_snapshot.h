@@ -0,0 +1,90 @@
+#ifndef __CONFIG_SNAPSHOT_H__
+#define __CONFIG_SNAPSHOT_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace sylar
+{
+    /**
+     * @brief 预编译的二进制配置快照
+     * @details 把所有已注册配置项的当前值编码为按名称哈希排序的二进制文件, 加载时只读mmap,
+     *          按配置项名称二分查找后直接解码, 不经过yaml-cpp和字符串转换.
+     *          快照记录了生成它的YAML文件的大小和修改时间, 源文件变化后视为过期.
+     *          映射为只读共享页, fork出的子进程以及同时加载同一快照的多个进程共享同一份物理页
+     */
+    class ConfigSnapshot
+    {
+    public:
+        using ptr = std::shared_ptr<ConfigSnapshot>;
+
+        // 快照格式版本, 格式变化时递增, 旧版本的快照视为无效
+        static const uint32_t kVersion = 1;
+
+        /**
+         * @brief 将所有已注册配置项的当前值编译为快照文件
+         * @param[in] path 快照文件路径
+         * @param[in] sources 生成当前配置值的YAML文件
+         * @details 先写临时文件再rename, 正在使用旧快照的进程不受影响
+         */
+        static bool Compile(const std::string &path, const std::vector<std::string> &sources);
+
+        /**
+         * @brief 打开快照文件
+         * @return 文件不存在、版本不匹配或内容损坏时返回nullptr
+         */
+        static ptr Open(const std::string &path);
+
+        /**
+         * @brief 加载配置: 快照有效时直接应用快照, 否则解析YAML并重新生成快照
+         * @param[in] path 快照文件路径
+         * @param[in] sources YAML文件, 同一配置项以后面的为准
+         * @return 配置是否加载成功
+         */
+        static bool Load(const std::string &path, const std::vector<std::string> &sources);
+
+        ~ConfigSnapshot();
+
+        /**
+         * @brief 源文件是否已变化(大小或修改时间不同, 或者文件不存在)
+         */
+        bool isStale() const;
+
+        /**
+         * @brief 将快照中的值作为一个事务应用到已注册的配置项
+         * @details 快照中不存在或类型不同的配置项保持不变; 任意一项解码失败则整体不应用
+         * @return 是否应用成功
+         */
+        bool apply() const;
+
+        size_t size() const;
+        const std::vector<std::string> &getSources() const { return m_sources; }
+
+    private:
+        struct Source
+        {
+            std::string path;
+            int64_t mtime; // 修改时间(纳秒)
+            int64_t size;  // 文件大小
+        };
+
+        ConfigSnapshot() {}
+
+        bool parse();
+
+        // 按名称查找条目, 返回条目下标, 不存在返回-1
+        int64_t find(const std::string &name) const;
+
+        static bool StatSource(const std::string &path, Source &source);
+
+    private:
+        const char *m_data = nullptr;       // 映射的文件内容
+        size_t m_size = 0;                  // 文件大小
+        std::vector<std::string> m_sources; // 源文件路径
+        std::vector<Source> m_stats;        // 生成快照时源文件的状态
+    };
+}
+
+#endif // __CONFIG_SNAPSHOT_H__
@@ -0,0 +1,189 @@
+#include "config_watcher.h"
+#include "config.h"
+#include <algorithm>
+#include <vector>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+namespace sylar
+{
+    ConfigWatcher::ConfigWatcher(const std::string &path, uint32_t debounceMs)
+        : m_path(path), m_debounce_ms(debounceMs), m_running(false), m_timer_manager(TimerMgr::GetInstance())
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            m_dir = path;
+        }
+        else
+        {
+            size_t pos = path.rfind('/');
+            m_dir = pos == std::string::npos ? "." : path.substr(0, pos ? pos : 1);
+            m_file = pos == std::string::npos ? path : path.substr(pos + 1);
+        }
+    }
+
+    ConfigWatcher::~ConfigWatcher()
+    {
+        stop();
+    }
+
+    bool ConfigWatcher::start()
+    {
+        if (m_running)
+        {
+            return true;
+        }
+
+        m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify_fd < 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigWatcher inotify_init1 error, errno = " << errno
+                                << " " << strerror(errno);
+            return false;
+        }
+
+        if (inotify_add_watch(m_inotify_fd, m_dir.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) < 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigWatcher inotify_add_watch error, dir = " << m_dir
+                                << " errno = " << errno << " " << strerror(errno);
+            close(m_inotify_fd);
+            m_inotify_fd = -1;
+            return false;
+        }
+
+        if (pipe2(m_wakeup_fd, O_NONBLOCK | O_CLOEXEC) < 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigWatcher pipe2 error, errno = " << errno << " " << strerror(errno);
+            close(m_inotify_fd);
+            m_inotify_fd = -1;
+            return false;
+        }
+
+        m_running = true;
+        m_thread.reset(new Thread(std::bind(&ConfigWatcher::run, this), "config_watcher"));
+        return true;
+    }
+
+    void ConfigWatcher::stop()
+    {
+        if (!m_running.exchange(false))
+        {
+            return;
+        }
+
+        wakeup('q');
+        m_thread->join();
+        m_thread.reset();
+        if (m_debounce_timer)
+        {
+            // 等待可能正在执行的定时器回调结束, 之后才能关闭管道
+            m_debounce_timer->cancel();
+            m_debounce_timer.reset();
+        }
+
+        close(m_inotify_fd);
+        close(m_wakeup_fd[0]);
+        close(m_wakeup_fd[1]);
+        m_inotify_fd = -1;
+        m_wakeup_fd[0] = m_wakeup_fd[1] = -1;
+    }
+
+    void ConfigWatcher::reload()
+    {
+        // 任意一个文件解析失败则放弃本次变更, 避免只应用一部分
+        bool ok = m_file.empty() ? Config::LoadFromDir(m_dir)
+                                 : Config::LoadFromFiles(std::vector<std::string>(1, m_path));
+        LOG_INFO(LOG_ROOT) << "ConfigWatcher reload " << m_path << (ok ? " ok" : " failed");
+    }
+
+    void ConfigWatcher::wakeup(char cmd)
+    {
+        // 管道写满时后台线程必然还有未读的命令会唤醒它, 可以忽略EAGAIN
+        if (write(m_wakeup_fd[1], &cmd, 1) < 0 && errno != EAGAIN)
+        {
+            LOG_ERROR(LOG_ROOT) << "ConfigWatcher wakeup error, errno = " << errno << " " << strerror(errno);
+        }
+    }
+
+    void ConfigWatcher::run()
+    {
+        struct pollfd fds[2];
+        fds[0].fd = m_inotify_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_wakeup_fd[0];
+        fds[1].events = POLLIN;
+
+        alignas(struct inotify_event) char buf[4096];
+        while (m_running)
+        {
+            int rt = poll(fds, 2, -1);
+            if (rt < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                LOG_ERROR(LOG_ROOT) << "ConfigWatcher poll error, errno = " << errno << " " << strerror(errno);
+                break;
+            }
+
+            bool reloadPending = false;
+            if (fds[1].revents & POLLIN)
+            {
+                char cmds[64];
+                ssize_t n;
+                bool quit = false;
+                while ((n = read(m_wakeup_fd[0], cmds, sizeof(cmds))) > 0)
+                {
+                    quit = quit || std::find(cmds, cmds + n, 'q') != cmds + n;
+                    reloadPending = reloadPending || std::find(cmds, cmds + n, 'r') != cmds + n;
+                }
+                if (quit)
+                {
+                    break;
+                }
+            }
+
+            bool changed = false;
+            if (fds[0].revents & POLLIN)
+            {
+                ssize_t len;
+                while ((len = read(m_inotify_fd, buf, sizeof(buf))) > 0)
+                {
+                    for (char *p = buf; p < buf + len;)
+                    {
+                        struct inotify_event *ev = reinterpret_cast<struct inotify_event *>(p);
+                        p += sizeof(struct inotify_event) + ev->len;
+                        if (ev->len == 0)
+                        {
+                            continue;
+                        }
+                        if (m_file.empty() ? Config::IsYamlFile(ev->name) : m_file == ev->name)
+                        {
+                            changed = true;
+                        }
+                    }
+                }
+
+                // 静默时间内再有变更则重新计时, 定时器已执行完时重新添加
+                if (changed && (!m_debounce_timer || !m_debounce_timer->refresh()))
+                {
+                    m_debounce_timer = m_timer_manager->addTimer(m_debounce_ms, std::bind(&ConfigWatcher::wakeup, this, 'r'));
+                }
+            }
+
+            // 定时器到期的同时又有新的变更时, 等新的静默时间结束再一起加载
+            if (reloadPending && !changed)
+            {
+                reload();
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __CONFIG_WATCHER_H__
+#define __CONFIG_WATCHER_H__
+
+#include <memory>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "../thread/thread.h"
+#include "../timer/timer.h"
+
+namespace sylar
+{
+    /**
+     * @brief 配置文件热加载
+     * @details 使用inotify监听配置文件(或目录下所有 .yml 和 .yaml 文件), 连续写入在debounce时间内合并为一次:
+     *          每次变更重新开始防抖定时器, 到期后定时器回调只经管道唤醒后台线程, 由后台线程解析并通过
+     *          Config::LoadFromYaml 批量应用(不占用全局定时器线程), 回调在整批提交之后触发.
+     *          监听的是文件所在目录, 编辑器"写临时文件再rename"的保存方式同样能感知
+     */
+    class ConfigWatcher
+    {
+    public:
+        using ptr = std::shared_ptr<ConfigWatcher>;
+
+        /**
+         * @brief 构造函数
+         * @param[in] path 配置文件或配置目录
+         * @param[in] debounceMs 合并连续变更的静默时间(毫秒)
+         */
+        ConfigWatcher(const std::string &path, uint32_t debounceMs = 200);
+        ~ConfigWatcher();
+
+        // 开始监听, 失败返回false
+        bool start();
+        void stop();
+
+        // 立即重新加载一次
+        void reload();
+
+        const std::string &getPath() const { return m_path; }
+
+    private:
+        void run();
+
+        // 向后台线程发送命令: 'r' 重新加载, 'q' 退出
+        void wakeup(char cmd);
+
+    private:
+        std::string m_path;            // 配置文件或目录
+        std::string m_dir;             // 实际监听的目录
+        std::string m_file;            // 监听单个文件时的文件名, 监听目录时为空
+        uint32_t m_debounce_ms;        // 静默时间
+        int m_inotify_fd = -1;         // inotify句柄
+        int m_wakeup_fd[2] = {-1, -1}; // 用于唤醒后台线程重新加载或退出
+        std::atomic<bool> m_running;   // 是否在运行
+        Thread::ptr m_thread;          // 后台线程
+        TimerManager::ptr m_timer_manager; // 全局定时器
+        Timer::ptr m_debounce_timer;       // 防抖定时器, 只在后台线程和stop中访问
+    };
+}
+
+#endif // __CONFIG_WATCHER_H__
@@ -0,0 +1,455 @@
+#include "fiber.h"
+#include "../config/config.h"
+#include "../log/log.h"
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__SANITIZE_THREAD__)
+#include <sanitizer/tsan_interface.h>
+#endif
+
+/**
+ * 上下文切换
+ * sylar_fiber_switch(from, to): 把被调用者保存的寄存器压到当前栈上, 栈指针存入*from,
+ * 换到栈to上弹出它保存的寄存器并返回, 即回到to上次切出的位置.
+ * 新协程的初始帧由 Fiber::initContext 构造, 第一次切换时"返回"到 sylar_fiber_trampoline,
+ * 由它以协程指针为参数调用 Fiber::MainFunc
+ */
+extern "C"
+{
+    void sylar_fiber_switch(void **from, void *to);
+    void sylar_fiber_trampoline();
+}
+
+#if defined(__x86_64__)
+// 保存 rbp rbx r12-r15 以及 MXCSR 和 x87 控制字
+asm(R"(
+    .text
+    .globl sylar_fiber_switch
+    .hidden sylar_fiber_switch
+    .type sylar_fiber_switch, @function
+    .align 16
+sylar_fiber_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size sylar_fiber_switch, .-sylar_fiber_switch
+
+    .globl sylar_fiber_trampoline
+    .hidden sylar_fiber_trampoline
+    .type sylar_fiber_trampoline, @function
+    .align 16
+sylar_fiber_trampoline:
+    movq %r12, %rdi
+    andq $-16, %rsp
+    callq *%r13
+    ud2
+    .size sylar_fiber_trampoline, .-sylar_fiber_trampoline
+)");
+#elif defined(__aarch64__)
+// 保存 x19-x30 以及 d8-d15
+asm(R"(
+    .text
+    .globl sylar_fiber_switch
+    .hidden sylar_fiber_switch
+    .type sylar_fiber_switch, %function
+    .align 4
+sylar_fiber_switch:
+    sub sp, sp, #0xb0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    add sp, sp, #0xb0
+    ret
+    .size sylar_fiber_switch, .-sylar_fiber_switch
+
+    .globl sylar_fiber_trampoline
+    .hidden sylar_fiber_trampoline
+    .type sylar_fiber_trampoline, %function
+    .align 4
+sylar_fiber_trampoline:
+    mov x0, x19
+    blr x20
+    brk #0
+    .size sylar_fiber_trampoline, .-sylar_fiber_trampoline
+)");
+#else
+#error "sylar fiber context switch supports only x86-64 and aarch64"
+#endif
+
+namespace sylar
+{
+    static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
+        Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
+
+    static ConfigVar<uint32_t>::ptr g_fiber_stack_cache =
+        Config::Lookup<uint32_t>("fiber.stack_cache", 64, "max idle fiber stacks cached per thread");
+
+    static size_t GetPageSize()
+    {
+        static size_t s_page_size = sysconf(_SC_PAGESIZE);
+        return s_page_size;
+    }
+
+    // 线程退出时缓存已析构, 之后归还的栈直接释放
+    static thread_local bool t_stack_cache_closed = false;
+
+    // 线程的空闲栈缓存, 线程退出时释放
+    struct FiberStackCache
+    {
+        std::vector<FiberStack *> stacks;
+
+        ~FiberStackCache()
+        {
+            t_stack_cache_closed = true;
+            for (auto stack : stacks)
+            {
+                FiberStack::Free(stack);
+            }
+        }
+    };
+
+    static thread_local FiberStackCache t_stack_cache;
+
+    FiberStack *FiberStack::Alloc(size_t size)
+    {
+        size_t page = GetPageSize();
+        size = (size + page - 1) / page * page;
+
+        if (!t_stack_cache_closed)
+        {
+            auto &stacks = t_stack_cache.stacks;
+            for (auto it = stacks.rbegin(); it != stacks.rend(); ++it)
+            {
+                if ((*it)->m_size == size)
+                {
+                    FiberStack *stack = *it;
+                    stacks.erase(std::next(it).base());
+                    return stack;
+                }
+            }
+        }
+
+        // 只占用虚拟地址空间, 物理页在第一次写入时才分配
+        void *mapping = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            LOG_ERROR(LOG_ROOT) << "FiberStack mmap error, size = " << size
+                                << " errno = " << errno << " " << strerror(errno);
+            return nullptr;
+        }
+        if (mprotect(mapping, page, PROT_NONE))
+        {
+            LOG_ERROR(LOG_ROOT) << "FiberStack mprotect guard page error, errno = " << errno
+                                << " " << strerror(errno);
+            munmap(mapping, size + page);
+            return nullptr;
+        }
+        return new FiberStack(mapping, size + page, static_cast<char *>(mapping) + page, size);
+    }
+
+    void FiberStack::Free(FiberStack *stack)
+    {
+        if (!stack)
+        {
+            return;
+        }
+        if (!t_stack_cache_closed && t_stack_cache.stacks.size() < g_fiber_stack_cache->getValue())
+        {
+            t_stack_cache.stacks.push_back(stack);
+            return;
+        }
+        munmap(stack->m_mapping, stack->m_mapping_size);
+        delete stack;
+    }
+
+    size_t FiberStack::CachedCount()
+    {
+        return t_stack_cache_closed ? 0 : t_stack_cache.stacks.size();
+    }
+
+    static std::atomic<uint64_t> s_fiber_id(0);
+    static std::atomic<uint64_t> s_fiber_count(0);
+    static std::atomic<size_t> s_local_index(0);
+
+    static thread_local Fiber *t_fiber = nullptr;  // 当前运行的协程
+    static thread_local Fiber::ptr t_thread_fiber; // 线程主协程
+
+    // 协程可能在另一个线程上恢复, 切换之后不能沿用切换之前算出的线程局部变量地址,
+    // 因此不内联, 每次调用都重新计算
+    static __attribute__((noinline)) Fiber *GetCurrentFiber()
+    {
+        return t_fiber;
+    }
+
+    static __attribute__((noinline)) void SetCurrentFiber(Fiber *fiber)
+    {
+        t_fiber = fiber;
+    }
+
+    // ThreadSanitizer 需要知道栈切换, 否则在协程栈上会误报甚至崩溃
+    static void *TsanCreateFiber(bool main)
+    {
+#if defined(__SANITIZE_THREAD__)
+        return main ? __tsan_get_current_fiber() : __tsan_create_fiber(0);
+#else
+        return nullptr;
+#endif
+    }
+
+    static void TsanDestroyFiber(void *fiber)
+    {
+#if defined(__SANITIZE_THREAD__)
+        __tsan_destroy_fiber(fiber);
+#endif
+    }
+
+    static void TsanSwitchToFiber(void *fiber)
+    {
+#if defined(__SANITIZE_THREAD__)
+        __tsan_switch_to_fiber(fiber, 0);
+#endif
+    }
+
+    Fiber::Fiber()
+        : m_state(RUNNING), m_tsanFiber(TsanCreateFiber(true))
+    {
+    }
+
+    Fiber::Fiber(std::function<void()> cb, size_t stacksize)
+        : m_id(++s_fiber_id), m_cb(cb)
+    {
+        m_stack = FiberStack::Alloc(stacksize ? stacksize : g_fiber_stack_size->getValue());
+        if (!m_stack)
+        {
+            throw std::bad_alloc();
+        }
+        ++s_fiber_count;
+        m_tsanFiber = TsanCreateFiber(false);
+        initContext();
+    }
+
+    Fiber::~Fiber()
+    {
+        if (!m_stack)
+        {
+            // 线程退出时析构主协程, 之后的线程局部变量析构中仍可能打日志, 不能留下悬空的当前协程
+            if (GetCurrentFiber() == this)
+            {
+                SetCurrentFiber(nullptr);
+            }
+            return;
+        }
+        if (m_state == READY || m_state == RUNNING)
+        {
+            // 栈上对象的析构函数不会再执行
+            LOG_ERROR(LOG_ROOT) << "Fiber destroyed while suspended, id = " << m_id
+                                << " state = " << getState();
+        }
+        TsanDestroyFiber(m_tsanFiber);
+        FiberStack::Free(m_stack);
+        --s_fiber_count;
+    }
+
+    void Fiber::initContext()
+    {
+        uintptr_t top = reinterpret_cast<uintptr_t>(m_stack->getTop()) & ~static_cast<uintptr_t>(15);
+        uint64_t entry = reinterpret_cast<uintptr_t>(&Fiber::MainFunc);
+        uint64_t trampoline = reinterpret_cast<uintptr_t>(&sylar_fiber_trampoline);
+        uint64_t arg = reinterpret_cast<uintptr_t>(this);
+#if defined(__x86_64__)
+        // 控制字, r15, r14, r13, r12, rbx, rbp, 返回地址, 对齐
+        uint64_t *sp = reinterpret_cast<uint64_t *>(top) - 9;
+        memset(sp, 0, 9 * sizeof(uint64_t));
+        sp[0] = 0x1F80 | (static_cast<uint64_t>(0x037F) << 32); // MXCSR 与 x87 控制字的默认值
+        sp[3] = entry;                                         // r13
+        sp[4] = arg;                                           // r12
+        sp[7] = trampoline;
+#elif defined(__aarch64__)
+        // d8-d15, x19-x28, x29, x30, 对齐
+        uint64_t *sp = reinterpret_cast<uint64_t *>(top) - 22;
+        memset(sp, 0, 22 * sizeof(uint64_t));
+        sp[8] = arg;         // x19
+        sp[9] = entry;       // x20
+        sp[19] = trampoline; // x30
+#endif
+        m_sp = sp;
+    }
+
+    void Fiber::reset(std::function<void()> cb)
+    {
+        if (!m_stack || (m_state != INIT && m_state != TERM && m_state != EXCEPT))
+        {
+            LOG_ERROR(LOG_ROOT) << "Fiber::reset invalid state, id = " << m_id << " state = " << getState();
+            throw std::logic_error("Fiber::reset invalid state");
+        }
+        m_cb = cb;
+        m_locals.clear();
+        initContext();
+        m_state = INIT;
+    }
+
+    void Fiber::resume()
+    {
+        if (m_state != INIT && m_state != READY)
+        {
+            LOG_ERROR(LOG_ROOT) << "Fiber::resume invalid state, id = " << m_id << " state = " << getState();
+            throw std::logic_error("Fiber::resume invalid state");
+        }
+        Fiber *cur = Current();
+        m_caller = cur;
+        m_state = RUNNING;
+        SetCurrentFiber(this);
+        TsanSwitchToFiber(m_tsanFiber);
+        sylar_fiber_switch(&cur->m_sp, m_sp);
+
+        // 回到这里时目标协程已经完全切出, yield的协程此时才可以被再次resume
+        State running = RUNNING;
+        m_state.compare_exchange_strong(running, READY, std::memory_order_release,
+                                        std::memory_order_relaxed);
+    }
+
+    void Fiber::yield()
+    {
+        if (GetCurrentFiber() != this || !m_caller)
+        {
+            LOG_ERROR(LOG_ROOT) << "Fiber::yield not the running fiber, id = " << m_id;
+            throw std::logic_error("Fiber::yield not the running fiber");
+        }
+        Fiber *caller = m_caller;
+        m_caller = nullptr;
+        SetCurrentFiber(caller);
+        TsanSwitchToFiber(caller->m_tsanFiber);
+        sylar_fiber_switch(&m_sp, caller->m_sp);
+    }
+
+    void Fiber::MainFunc(void *arg)
+    {
+        Fiber *fiber = static_cast<Fiber *>(arg);
+        try
+        {
+            fiber->m_cb();
+            fiber->m_cb = nullptr;
+            fiber->m_state = TERM;
+        }
+        catch (std::exception &e)
+        {
+            fiber->m_cb = nullptr;
+            fiber->m_state = EXCEPT;
+            LOG_ERROR(LOG_ROOT) << "Fiber except: " << e.what() << " fiber_id = " << fiber->m_id;
+        }
+        catch (...)
+        {
+            fiber->m_cb = nullptr;
+            fiber->m_state = EXCEPT;
+            LOG_ERROR(LOG_ROOT) << "Fiber except, fiber_id = " << fiber->m_id;
+        }
+
+        // 此后不会再回到这个栈帧, 这里不能留下需要析构的局部对象
+        Fiber *caller = fiber->m_caller;
+        fiber->m_caller = nullptr;
+        SetCurrentFiber(caller);
+        TsanSwitchToFiber(caller->m_tsanFiber);
+        sylar_fiber_switch(&fiber->m_sp, caller->m_sp);
+    }
+
+    Fiber *Fiber::Current()
+    {
+        Fiber *cur = GetCurrentFiber();
+        if (!cur)
+        {
+            t_thread_fiber.reset(new Fiber);
+            cur = t_thread_fiber.get();
+            SetCurrentFiber(cur);
+        }
+        return cur;
+    }
+
+    Fiber::ptr Fiber::GetThis()
+    {
+        return Current()->shared_from_this();
+    }
+
+    uint64_t Fiber::GetFiberId()
+    {
+        Fiber *cur = GetCurrentFiber();
+        return cur ? cur->m_id : 0;
+    }
+
+    void Fiber::Yield()
+    {
+        Current()->yield();
+    }
+
+    uint64_t Fiber::TotalFibers()
+    {
+        return s_fiber_count;
+    }
+
+    size_t Fiber::AllocLocalIndex()
+    {
+        return s_local_index++;
+    }
+
+    std::shared_ptr<void> &Fiber::GetLocal(size_t index)
+    {
+        std::vector<std::shared_ptr<void>> &locals = Current()->m_locals;
+        if (index >= locals.size())
+        {
+            locals.resize(index + 1);
+        }
+        return locals[index];
+    }
+
+    void *Fiber::PeekLocal(size_t index)
+    {
+        Fiber *cur = GetCurrentFiber();
+        if (!cur || index >= cur->m_locals.size())
+        {
+            return nullptr;
+        }
+        return cur->m_locals[index].get();
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef __FIBER_H__
+#define __FIBER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace sylar
+{
+    /**
+     * @brief 协程栈
+     * @details 使用mmap分配, 最低地址处保留一个不可访问的保护页, 栈溢出时立即触发SIGSEGV而不是踩坏相邻内存;
+     *          释放的栈缓存在当前线程的空闲列表中, 下次分配同样大小的栈时直接复用, 省去mmap/munmap
+     */
+    class FiberStack
+    {
+    public:
+        /**
+         * @brief 分配栈
+         * @param[in] size 可用大小, 向上取整到页大小
+         * @return 分配失败返回nullptr
+         */
+        static FiberStack *Alloc(size_t size);
+
+        // 归还栈, 超过缓存上限时直接释放
+        static void Free(FiberStack *stack);
+
+        // 当前线程缓存的空闲栈个数
+        static size_t CachedCount();
+
+        void *getBottom() const { return m_base; }
+        // 栈顶(最高地址), 栈从这里向下增长
+        void *getTop() const { return static_cast<char *>(m_base) + m_size; }
+        size_t getSize() const { return m_size; }
+
+    private:
+        FiberStack(void *mapping, size_t mappingSize, void *base, size_t size)
+            : m_mapping(mapping), m_mapping_size(mappingSize), m_base(base), m_size(size) {}
+
+        void *m_mapping;       // mmap返回的地址, 包含保护页
+        size_t m_mapping_size; // mmap的大小
+        void *m_base;          // 可用栈的最低地址
+        size_t m_size;         // 可用栈大小
+    };
+
+    /**
+     * @brief 有栈协程
+     * @details 非对称协程: resume 从当前协程切换到目标协程, 目标协程 yield 时回到调用 resume 的协程.
+     *          上下文切换是手写汇编(x86-64/aarch64), 只保存被调用者保存的寄存器, 不像ucontext那样
+     *          每次切换都调用sigprocmask.
+     *          每个线程第一次使用协程时自动创建主协程代表线程原本的栈, 主协程的id为0.
+     *          协程可以在一个线程上yield后在另一个线程上resume
+     */
+    class Fiber : public std::enable_shared_from_this<Fiber>
+    {
+        friend class Scheduler;
+
+    public:
+        using ptr = std::shared_ptr<Fiber>;
+
+        enum State
+        {
+            INIT,    // 已创建, 未运行
+            READY,   // 已yield, 可以再次resume
+            RUNNING, // 正在运行
+            TERM,    // 正常结束
+            EXCEPT   // 抛出异常结束
+        };
+
+        /**
+         * @brief 构造函数
+         * @param[in] cb 协程执行的函数
+         * @param[in] stacksize 栈大小, 0表示使用配置 fiber.stack_size
+         */
+        Fiber(std::function<void()> cb, size_t stacksize = 0);
+        ~Fiber();
+
+        // 复用已结束(或未运行)协程的栈执行新的函数, 协程局部变量一并清空
+        void reset(std::function<void()> cb);
+
+        // 切换到当前协程执行, 协程yield或结束后返回
+        void resume();
+
+        /**
+         * @brief 让出执行权, 回到resume当前协程的协程; 只能由正在运行的协程自己调用
+         * @details 状态在切换完成、协程完全离开自己的栈之后才由resume一方改为READY,
+         *          其他线程看到READY时即可安全地resume它
+         */
+        void yield();
+
+        uint64_t getId() const { return m_id; }
+        State getState() const { return m_state.load(std::memory_order_acquire); }
+
+        // 当前正在运行的协程, 线程第一次调用时创建主协程
+        static Fiber::ptr GetThis();
+
+        // 当前正在运行的协程的id, 不在协程中时返回0
+        static uint64_t GetFiberId();
+
+        // 让当前协程让出执行权
+        static void Yield();
+
+        // 存活的协程总数(不含主协程)
+        static uint64_t TotalFibers();
+
+        // 分配一个协程局部变量的下标, 由 FiberLocal 使用
+        static size_t AllocLocalIndex();
+
+        // 当前协程下标index处的局部变量
+        static std::shared_ptr<void> &GetLocal(size_t index);
+
+        // 同 GetLocal, 但不创建主协程, 当前线程没有协程或该下标还未设置时返回nullptr
+        static void *PeekLocal(size_t index);
+
+    private:
+        // 主协程
+        Fiber();
+
+        // GetThis 的裸指针版本, resume/yield 时不增减引用计数
+        static Fiber *Current();
+
+        // 在新栈上构造首次切换用的初始帧
+        void initContext();
+
+        // 协程函数的入口, 在协程栈上运行
+        static void MainFunc(void *arg);
+
+    private:
+        uint64_t m_id = 0;
+        std::atomic<State> m_state{INIT};
+        void *m_sp = nullptr;          // 切出时保存的栈指针
+        FiberStack *m_stack = nullptr; // 协程栈, 主协程为空
+        Fiber *m_caller = nullptr;     // resume当前协程的协程
+        void *m_tsanFiber = nullptr;   // ThreadSanitizer构建时的协程上下文
+        std::function<void()> m_cb;
+        std::vector<std::shared_ptr<void>> m_locals; // 协程局部变量
+        Fiber::ptr m_self;                           // 在调度器队列中时由自身持有引用
+        bool m_recyclable = false;                   // 由调度器创建, 结束后可回收复用
+    };
+
+    /**
+     * @brief 协程局部变量
+     * @details 每个协程各自持有一份T, 第一次访问时默认构造, 协程析构或reset时销毁;
+     *          不在协程中时使用线程主协程的那一份. 下标不回收, 应定义为全局或静态变量
+     */
+    template <typename T>
+    class FiberLocal
+    {
+    public:
+        FiberLocal() : m_index(Fiber::AllocLocalIndex()) {}
+
+        T *get()
+        {
+            std::shared_ptr<void> &slot = Fiber::GetLocal(m_index);
+            if (!slot)
+            {
+                slot = std::make_shared<T>();
+            }
+            return static_cast<T *>(slot.get());
+        }
+
+        // 只读访问, 还未创建时返回nullptr而不是默认构造(也不会为当前线程创建主协程)
+        T *peek() { return static_cast<T *>(Fiber::PeekLocal(m_index)); }
+
+        void set(const T &val) { *get() = val; }
+
+        T &operator*() { return *get(); }
+        T *operator->() { return get(); }
+
+    private:
+        FiberLocal(const FiberLocal &) = delete;
+        FiberLocal &operator=(const FiberLocal &) = delete;
+
+        size_t m_index;
+    };
+}
+
+#endif // __FIBER_H__
@@ -0,0 +1,534 @@
+#include "scheduler.h"
+#include "../config/config.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <thread>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace sylar
+{
+    static ConfigVar<uint32_t>::ptr g_scheduler_threads =
+        Config::Lookup<uint32_t>("scheduler.threads", 0, "scheduler worker threads, 0 means cpu cores");
+
+    static ConfigVar<std::string>::ptr g_scheduler_thread_name =
+        Config::Lookup<std::string>("scheduler.thread_name", "worker", "scheduler worker thread name prefix");
+
+    static const size_t kLocalQueueSize = 4096;    // 每个工作线程队列的容量
+    static const size_t kGlobalQueueSize = 65536;  // 全局队列的容量, 满了进入溢出队列
+    static const uint32_t kMaxLifoRuns = 3;        // 连续从LIFO槽运行的上限
+    static const uint64_t kGlobalCheckInterval = 61; // 每运行这么多个任务先看一次全局队列, 避免其饿死
+    static const size_t kFiberPoolSize = 256;      // 每个工作线程缓存的可复用协程个数
+    static const int kStealRounds = 2;             // 休眠前窃取的轮数
+    static const int kParkSpins = 10;              // 休眠前自旋(后几次让出CPU)重试的次数
+
+    static const uintptr_t kCallbackTag = 1; // 函数任务的标记位
+
+    static void FutexWait(std::atomic<uint32_t> *addr, uint32_t val)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+    }
+
+    static void FutexWake(std::atomic<uint32_t> *addr)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    struct Scheduler::Worker
+    {
+        Worker(Scheduler *s, size_t i)
+            : scheduler(s), index(i), deque(kLocalQueueSize), sleeping(0),
+              rng(0x9E3779B97F4A7C15ULL * (i + 1)) {}
+
+        // xorshift, 选择窃取对象
+        uint64_t random()
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            return rng;
+        }
+
+        Scheduler *scheduler;
+        size_t index;
+        WorkStealDeque<Task> deque;
+        Task lifo = 0;                // LIFO槽, 只有本线程访问
+        uint32_t lifoRuns = 0;        // 连续从LIFO槽运行的次数
+        uint64_t ticks = 0;           // 已运行的任务数
+        bool yieldToReady = false;    // 当前协程请求重新排队
+        std::atomic<uint32_t> sleeping; // futex字, 1表示休眠
+        uint64_t rng;
+        std::vector<Fiber::ptr> freeFibers; // 可复用的协程
+        Thread::ptr thread;
+    };
+
+    Scheduler::Scheduler(size_t threads, const std::string &name)
+        : m_name(name.empty() ? g_scheduler_thread_name->getValue() : name),
+          m_global(kGlobalQueueSize), m_overflowSize(0), m_pending(0),
+          m_stopping(false), m_stopped(false), m_idleCount(0)
+    {
+        if (threads == 0)
+        {
+            threads = g_scheduler_threads->getValue();
+        }
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; ++i)
+        {
+            m_workers.emplace_back(new Worker(this, i));
+        }
+        m_idle.reserve(threads);
+    }
+
+    Scheduler::~Scheduler()
+    {
+        stop();
+    }
+
+    // 工作线程的主协程不会迁移, 这里的线程局部变量只在切换之前访问
+    __attribute__((noinline)) Scheduler::Worker *&Scheduler::CurrentWorker()
+    {
+        static thread_local Worker *t_worker = nullptr;
+        return t_worker;
+    }
+
+    Scheduler *Scheduler::GetThis()
+    {
+        Worker *worker = CurrentWorker();
+        return worker ? worker->scheduler : nullptr;
+    }
+
+    void Scheduler::YieldToReady()
+    {
+        Worker *worker = CurrentWorker();
+        if (!worker || Fiber::GetFiberId() == 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "Scheduler::YieldToReady not in a scheduler fiber";
+            return;
+        }
+        worker->yieldToReady = true;
+        Fiber::Yield();
+    }
+
+    void Scheduler::start()
+    {
+        if (m_started)
+        {
+            return;
+        }
+        m_started = true;
+        for (size_t i = 0; i < m_workers.size(); ++i)
+        {
+            Worker *worker = m_workers[i].get();
+            worker->thread.reset(new Thread(std::bind(&Scheduler::run, this, worker),
+                                            m_name + "_" + std::to_string(i)));
+        }
+    }
+
+    void Scheduler::stop()
+    {
+        if (m_stopped)
+        {
+            return;
+        }
+        Worker *worker = CurrentWorker();
+        if (worker && worker->scheduler == this)
+        {
+            LOG_ERROR(LOG_ROOT) << "Scheduler::stop called on worker thread, name = " << m_name;
+            return;
+        }
+
+        m_stopping = true;
+        if (m_started)
+        {
+            wakeAll();
+            for (auto &i : m_workers)
+            {
+                i->thread->join();
+                i->thread.reset();
+            }
+        }
+        else
+        {
+            // 没有启动过, 丢弃已提交的任务
+            Task task;
+            while ((task = popGlobal()))
+            {
+                if (task & kCallbackTag)
+                {
+                    delete reinterpret_cast<std::function<void()> *>(task & ~kCallbackTag);
+                }
+                else
+                {
+                    reinterpret_cast<Fiber *>(task)->m_self.reset();
+                }
+            }
+        }
+        m_stopped = true;
+    }
+
+    bool Scheduler::schedule(Fiber::ptr fiber)
+    {
+        if (!fiber || m_stopped)
+        {
+            return false;
+        }
+        Fiber::State state = fiber->getState();
+        if (state == Fiber::RUNNING)
+        {
+            if (fiber->getId() == Fiber::GetFiberId())
+            {
+                LOG_ERROR(LOG_ROOT) << "Scheduler::schedule the running fiber itself, id = " << fiber->getId();
+                return false;
+            }
+            // 在另一个线程上正在切出
+            SpinBackoff backoff;
+            while ((state = fiber->getState()) == Fiber::RUNNING)
+            {
+                backoff.pause();
+            }
+        }
+        if (state == Fiber::TERM || state == Fiber::EXCEPT)
+        {
+            return false;
+        }
+        Fiber *raw = fiber.get();
+        raw->m_self = std::move(fiber);
+        if (!enqueue(reinterpret_cast<Task>(raw), state == Fiber::READY))
+        {
+            raw->m_self.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool Scheduler::schedule(std::function<void()> cb)
+    {
+        if (!cb || m_stopped)
+        {
+            return false;
+        }
+        std::function<void()> *task = new std::function<void()>(std::move(cb));
+        if (!enqueue(reinterpret_cast<Task>(task) | kCallbackTag, false))
+        {
+            delete task;
+            return false;
+        }
+        return true;
+    }
+
+    Fiber::ptr Scheduler::allocFiber(Worker *worker, std::function<void()> &&cb)
+    {
+        if (worker->freeFibers.empty())
+        {
+            Fiber::ptr fiber = std::make_shared<Fiber>(std::move(cb));
+            fiber->m_recyclable = true;
+            return fiber;
+        }
+        Fiber::ptr fiber = std::move(worker->freeFibers.back());
+        worker->freeFibers.pop_back();
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+
+    void Scheduler::recycleFiber(Worker *worker, Fiber::ptr &&fiber)
+    {
+        // 只回收调度器自己创建且没有其他引用的协程
+        if (fiber->m_recyclable && fiber.use_count() == 1 && worker->freeFibers.size() < kFiberPoolSize)
+        {
+            fiber->reset(nullptr);
+            worker->freeFibers.push_back(std::move(fiber));
+        }
+    }
+
+    bool Scheduler::enqueue(Task task, bool woken)
+    {
+        // 先登记再检查 m_stopping, 与工作线程退出前检查 m_pending 配对(都是seq_cst):
+        // 外部提交要么看到正在停止而被拒绝, 要么工作线程看到它而继续运行直到它执行完
+        m_pending.fetch_add(1);
+
+        Worker *worker = CurrentWorker();
+        if (!worker || worker->scheduler != this)
+        {
+            if (m_stopping.load())
+            {
+                // 工作线程可能已看到未归零的计数而休眠, 归零时唤醒它们退出
+                if (m_pending.fetch_sub(1) == 1)
+                {
+                    wakeAll();
+                }
+                return false;
+            }
+            pushGlobal(task);
+            notify();
+            return true;
+        }
+
+        if (woken)
+        {
+            // 新唤醒的协程替换LIFO槽, 原来的协程进入队列
+            std::swap(task, worker->lifo);
+            if (!task)
+            {
+                return true;
+            }
+        }
+        if (!worker->deque.push(task))
+        {
+            pushGlobal(task);
+        }
+        notify();
+        return true;
+    }
+
+    void Scheduler::pushGlobal(Task task)
+    {
+        if (m_global.tryPush(task))
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lockGuard(m_overflowMutex);
+        m_overflow.push_back(task);
+        ++m_overflowSize;
+    }
+
+    Scheduler::Task Scheduler::popGlobal()
+    {
+        Task task = 0;
+        if (m_global.tryPop(task))
+        {
+            return task;
+        }
+        if (m_overflowSize.load(std::memory_order_acquire) == 0)
+        {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lockGuard(m_overflowMutex);
+        if (m_overflow.empty())
+        {
+            return 0;
+        }
+        task = m_overflow.front();
+        m_overflow.pop_front();
+        --m_overflowSize;
+        return task;
+    }
+
+    Scheduler::Task Scheduler::steal(Worker *worker)
+    {
+        size_t n = m_workers.size();
+        if (n <= 1)
+        {
+            return 0;
+        }
+        Task task = 0;
+        for (int round = 0; round < kStealRounds; ++round)
+        {
+            size_t start = worker->random() % n;
+            for (size_t i = 0; i < n; ++i)
+            {
+                Worker *victim = m_workers[(start + i) % n].get();
+                if (victim != worker && victim->deque.steal(task))
+                {
+                    return task;
+                }
+            }
+        }
+        return 0;
+    }
+
+    Scheduler::Task Scheduler::nextTask(Worker *worker)
+    {
+        Task task = 0;
+        if (++worker->ticks % kGlobalCheckInterval == 0 && (task = popGlobal()))
+        {
+            return task;
+        }
+
+        if (worker->lifo)
+        {
+            Task lifo = worker->lifo;
+            worker->lifo = 0;
+            if (worker->lifoRuns < kMaxLifoRuns)
+            {
+                ++worker->lifoRuns;
+                return lifo;
+            }
+            // 超过上限, 先运行队列中的任务, LIFO槽中的协程放入队列供其他线程窃取
+            worker->lifoRuns = 0;
+            if (worker->deque.pop(task) || (task = popGlobal()))
+            {
+                if (!worker->deque.push(lifo))
+                {
+                    pushGlobal(lifo);
+                }
+                notify();
+                return task;
+            }
+            return lifo;
+        }
+
+        worker->lifoRuns = 0;
+        if (worker->deque.pop(task) || (task = popGlobal()))
+        {
+            return task;
+        }
+        return steal(worker);
+    }
+
+    bool Scheduler::hasWork()
+    {
+        if (!m_global.empty() || m_overflowSize.load(std::memory_order_relaxed) > 0)
+        {
+            return true;
+        }
+        for (auto &i : m_workers)
+        {
+            if (!i->deque.empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Scheduler::notify()
+    {
+        // 与 park 中"先登记休眠再检查队列"配对, 保证不会丢失唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_idleCount.load(std::memory_order_relaxed) > 0)
+        {
+            wakeOne();
+        }
+    }
+
+    void Scheduler::park(Worker *worker)
+    {
+        worker->sleeping.store(1, std::memory_order_relaxed);
+        {
+            Spinlock::Lock lock(m_idleMutex);
+            m_idle.push_back(worker);
+        }
+        m_idleCount.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (hasWork() || (m_stopping && m_pending.load() == 0))
+        {
+            // 登记之后又有了任务, 撤销休眠; 已被其他线程取走说明它正在唤醒自己
+            bool removed = false;
+            {
+                Spinlock::Lock lock(m_idleMutex);
+                auto it = std::find(m_idle.begin(), m_idle.end(), worker);
+                if (it != m_idle.end())
+                {
+                    m_idle.erase(it);
+                    removed = true;
+                }
+            }
+            if (removed)
+            {
+                m_idleCount.fetch_sub(1, std::memory_order_relaxed);
+                worker->sleeping.store(0, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        while (worker->sleeping.load(std::memory_order_acquire) == 1)
+        {
+            FutexWait(&worker->sleeping, 1);
+        }
+    }
+
+    void Scheduler::wakeOne()
+    {
+        Worker *worker = nullptr;
+        {
+            Spinlock::Lock lock(m_idleMutex);
+            if (m_idle.empty())
+            {
+                return;
+            }
+            worker = m_idle.back();
+            m_idle.pop_back();
+        }
+        m_idleCount.fetch_sub(1, std::memory_order_relaxed);
+        worker->sleeping.store(0, std::memory_order_release);
+        FutexWake(&worker->sleeping);
+    }
+
+    void Scheduler::wakeAll()
+    {
+        while (m_idleCount.load() > 0)
+        {
+            wakeOne();
+        }
+    }
+
+    void Scheduler::run(Worker *worker)
+    {
+        CurrentWorker() = worker;
+        // 在线程主协程上调度
+        Fiber::GetThis();
+
+        while (true)
+        {
+            Task task = nextTask(worker);
+            SpinBackoff backoff;
+            for (int i = 0; !task && i < kParkSpins; ++i)
+            {
+                backoff.pause();
+                task = nextTask(worker);
+            }
+            if (!task)
+            {
+                if (m_stopping && m_pending.load() == 0)
+                {
+                    break;
+                }
+                park(worker);
+                continue;
+            }
+
+            Fiber::ptr fiber;
+            if (task & kCallbackTag)
+            {
+                std::unique_ptr<std::function<void()>> cb(
+                    reinterpret_cast<std::function<void()> *>(task & ~kCallbackTag));
+                fiber = allocFiber(worker, std::move(*cb));
+            }
+            else
+            {
+                fiber = std::move(reinterpret_cast<Fiber *>(task)->m_self);
+            }
+            worker->yieldToReady = false;
+            fiber->resume();
+
+            Fiber::State state = fiber->getState();
+            if (state == Fiber::READY && worker->yieldToReady)
+            {
+                // 主动让出的协程放入全局队列, 排在已有任务之后
+                Fiber *raw = fiber.get();
+                raw->m_self = std::move(fiber);
+                m_pending.fetch_add(1, std::memory_order_relaxed);
+                pushGlobal(reinterpret_cast<Task>(raw));
+                notify();
+            }
+            else if (state == Fiber::TERM || state == Fiber::EXCEPT)
+            {
+                recycleFiber(worker, std::move(fiber));
+            }
+            // 其余情况是挂起, 由持有协程的一方再次schedule
+
+            if (m_pending.fetch_sub(1) == 1 && m_stopping)
+            {
+                wakeAll();
+            }
+        }
+
+        worker->freeFibers.clear();
+        CurrentWorker() = nullptr;
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "fiber.h"
+#include "../thread/mutex.h"
+#include "../thread/thread.h"
+#include "../util/lockfree_queue.h"
+#include "../util/work_steal_deque.h"
+
+namespace sylar
+{
+    /**
+     * @brief 工作窃取的N:M协程调度器
+     * @details 每个工作线程有一个 Chase-Lev 双端队列和一个LIFO槽:
+     *          - 工作线程上新创建的任务放入自己队列的底部;
+     *          - 工作线程上唤醒的协程放入LIFO槽, 下一个就运行它, 趁其数据还在缓存中;
+     *            连续从LIFO槽运行的次数有上限, 避免两个协程互相唤醒时饿死队列中的任务;
+     *          - 非工作线程提交的任务放入全局队列;
+     *          - 本地没有任务时先取全局队列, 再从随机选择的其他工作线程队列顶部窃取;
+     *          - 仍然没有任务时在futex上休眠, 提交任务时只唤醒一个休眠的工作线程.
+     *          线程数和线程名前缀可通过配置 scheduler.threads / scheduler.thread_name 设置
+     */
+    class Scheduler
+    {
+    public:
+        using ptr = std::shared_ptr<Scheduler>;
+
+        /**
+         * @brief 构造函数
+         * @param[in] threads 工作线程数, 0表示使用配置 scheduler.threads (其为0时取CPU核数)
+         * @param[in] name 线程名前缀, 空表示使用配置 scheduler.thread_name
+         */
+        Scheduler(size_t threads = 0, const std::string &name = "");
+        ~Scheduler();
+
+        void start();
+
+        // 等待已提交的任务全部执行完后停止工作线程, 此后非工作线程的提交被拒绝; 不能在工作线程上调用
+        void stop();
+
+        /**
+         * @brief 调度协程
+         * @details 新建(INIT)的协程进入队列; 已yield(READY)的协程视为被唤醒, 在工作线程上调用时进入LIFO槽.
+         *          协程在另一个线程上正在切出时会短暂等待其切出完成
+         * @return 已停止(非工作线程在stop开始之后提交也算)或协程已结束时返回false
+         */
+        bool schedule(Fiber::ptr fiber);
+
+        // 调度函数, 在调度器复用的协程中执行
+        bool schedule(std::function<void()> cb);
+
+        size_t getThreadCount() const { return m_workers.size(); }
+        const std::string &getName() const { return m_name; }
+
+        // 当前工作线程所属的调度器, 不在工作线程上时返回nullptr
+        static Scheduler *GetThis();
+
+        /**
+         * @brief 当前协程让出执行权并重新排队
+         * @details 直接调用 Fiber::Yield 表示挂起, 需要再次 schedule 才会继续运行
+         */
+        static void YieldToReady();
+
+    private:
+        struct Worker;
+
+        // 队列中的任务: 协程为 Fiber*, 函数为 std::function<void()>* 且最低位置1, 0表示没有任务;
+        // 函数在工作线程上开始运行时才分配协程, 大量提交时不会预先占用栈
+        using Task = uintptr_t;
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        // 当前线程的工作线程, 不是工作线程时返回nullptr
+        static Worker *&CurrentWorker();
+
+        void run(Worker *worker);
+
+        // 放入队列并在需要时唤醒一个休眠的工作线程; 正在停止时拒绝非工作线程的提交, 返回false
+        bool enqueue(Task task, bool woken);
+        void pushGlobal(Task task);
+        void notify();
+
+        // 取下一个要运行的协程
+        Task nextTask(Worker *worker);
+        Task popGlobal();
+        Task steal(Worker *worker);
+        bool hasWork();
+
+        // 当前工作线程休眠直到被唤醒
+        void park(Worker *worker);
+        void wakeOne();
+        void wakeAll();
+
+        // 在工作线程上取一个可复用的协程执行cb
+        Fiber::ptr allocFiber(Worker *worker, std::function<void()> &&cb);
+        void recycleFiber(Worker *worker, Fiber::ptr &&fiber);
+
+    private:
+        std::string m_name;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+
+        MpmcQueue<Task> m_global;          // 全局队列
+        std::mutex m_overflowMutex;        // 全局队列满时的溢出队列
+        std::deque<Task> m_overflow;
+        std::atomic<size_t> m_overflowSize;
+
+        std::atomic<uint64_t> m_pending; // 已提交还未执行完(或挂起)的调度次数
+        std::atomic<bool> m_stopping;
+        std::atomic<bool> m_stopped;
+        bool m_started = false;
+
+        Spinlock m_idleMutex;
+        std::vector<Worker *> m_idle; // 休眠的工作线程
+        std::atomic<size_t> m_idleCount;
+    };
+}
+
+#endif // __SCHEDULER_H__
@@ -3,6 +3,14 @@
 #include <tuple>
 #include <functional>
 #include <cstdarg> //  for va_start() and va_end()
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <zlib.h>
+#if defined(__SSE2__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include "../config/config.h"
 
 namespace sylar
@@ -128,6 +136,30 @@ namespace sylar
 		}
 	};
 
+	class MDCFormatItem : public LogFormatter::FormatItem
+	{
+	public:
+		MDCFormatItem(const std::string &key = "")
+			: m_key(key) {}
+
+		void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+		{
+			const MDC::Snapshot::ptr &mdc = event->getMDC();
+			if (!mdc)
+			{
+				return;
+			}
+			const std::string *val = m_key.empty() ? &mdc->rendered : mdc->get(m_key);
+			if (val)
+			{
+				os.write(val->data(), val->size());
+			}
+		}
+
+	private:
+		std::string m_key;
+	};
+
 	class DataTimeFormatItem : public LogFormatter::FormatItem
 	{
 	public:
@@ -213,6 +245,134 @@ namespace sylar
 		}
 	};
 
+	/***********************************************************MDC Functions****************************************/
+	struct MDCContext
+	{
+		std::vector<std::pair<std::string, std::string>> entries;
+		MDC::Snapshot::ptr snapshot; // 上下文变更后重新生成
+	};
+
+	// 协程局部: 协程被其他线程窃取后上下文随之迁移, 同一线程上交替运行的协程互不干扰
+	static FiberLocal<MDCContext> &GetMDCLocal()
+	{
+		static FiberLocal<MDCContext> s_local;
+		return s_local;
+	}
+
+	// 上下文变更时渲染一次, 之后每条日志只增加快照引用计数
+	static void RebuildMDC(MDCContext &ctx)
+	{
+		if (ctx.entries.empty())
+		{
+			ctx.snapshot.reset();
+			return;
+		}
+
+		std::shared_ptr<MDC::Snapshot> snap(new MDC::Snapshot);
+		snap->entries = ctx.entries;
+		for (auto &i : ctx.entries)
+		{
+			if (!snap->rendered.empty())
+			{
+				snap->rendered.push_back(' ');
+			}
+			snap->rendered.append(i.first).append(1, '=').append(i.second);
+		}
+		ctx.snapshot = snap;
+	}
+
+	const std::string *MDC::Snapshot::get(const std::string &key) const
+	{
+		for (auto &i : entries)
+		{
+			if (i.first == key)
+			{
+				return &i.second;
+			}
+		}
+		return nullptr;
+	}
+
+	void MDC::Put(const std::string &key, const std::string &value)
+	{
+		MDCContext &ctx = *GetMDCLocal();
+		for (auto &i : ctx.entries)
+		{
+			if (i.first == key)
+			{
+				if (i.second == value)
+				{
+					return;
+				}
+				i.second = value;
+				RebuildMDC(ctx);
+				return;
+			}
+		}
+		ctx.entries.push_back(std::make_pair(key, value));
+		RebuildMDC(ctx);
+	}
+
+	void MDC::Remove(const std::string &key)
+	{
+		MDCContext *ctx = GetMDCLocal().peek();
+		if (!ctx)
+		{
+			return;
+		}
+		for (auto it = ctx->entries.begin(); it != ctx->entries.end(); ++it)
+		{
+			if (it->first == key)
+			{
+				ctx->entries.erase(it);
+				RebuildMDC(*ctx);
+				return;
+			}
+		}
+	}
+
+	void MDC::Clear()
+	{
+		MDCContext *ctx = GetMDCLocal().peek();
+		if (ctx)
+		{
+			ctx->entries.clear();
+			ctx->snapshot.reset();
+		}
+	}
+
+	MDC::Snapshot::ptr MDC::GetSnapshot()
+	{
+		// 每条日志都会调用, 没有设置过上下文时不创建
+		MDCContext *ctx = GetMDCLocal().peek();
+		return ctx ? ctx->snapshot : MDC::Snapshot::ptr();
+	}
+
+	MDC::Guard::Guard(const std::string &key, const std::string &value)
+		: m_key(key)
+	{
+		MDC::Snapshot::ptr snap = MDC::GetSnapshot();
+		const std::string *old = snap ? snap->get(key) : nullptr;
+		if (old)
+		{
+			m_old_value = *old;
+			m_had_old = true;
+		}
+		MDC::Put(key, value);
+	}
+
+	MDC::Guard::~Guard()
+	{
+		if (m_had_old)
+		{
+			MDC::Put(m_key, m_old_value);
+		}
+		else
+		{
+			MDC::Remove(m_key);
+		}
+	}
+
 	/***********************************************************LogEvent Functions***********************************/
 	LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
 					   const char *file, int32_t line, uint32_t elapse, uint32_t thread_id,
@@ -224,6 +384,7 @@ namespace sylar
 		  m_coroutineId(coroutine_id),
 		  m_time(time),
 		  m_threadName(thread_name),
+		  m_mdc(MDC::GetSnapshot()),
 		  m_logger(logger),
 		  m_level(level) {}
 
@@ -246,6 +407,52 @@ namespace sylar
 		}
 	}
 
+	// 借助派生类取得std::stringbuf受保护成员的成员指针, 不复制地访问其缓冲区
+	struct ContentBufAccess : public std::stringbuf
+	{
+		static const char *data(const std::stringbuf *buf, size_t &len)
+		{
+			char *begin = (buf->*&ContentBufAccess::pbase)();
+			char *end = std::max((buf->*&ContentBufAccess::pptr)(), (buf->*&ContentBufAccess::egptr)());
+			len = begin ? end - begin : 0;
+			return begin;
+		}
+	};
+
+	const char *LogEvent::getContentData(size_t &len) const
+	{
+		return ContentBufAccess::data(m_content_stream.rdbuf(), len);
+	}
+
+	LogField &LogEvent::newField(const std::string &key, LogField::Type type)
+	{
+		m_fields.push_back(LogField());
+		LogField &f = m_fields.back();
+		f.key = key;
+		f.type = type;
+		return f;
+	}
+
+	void LogEvent::addField(const std::string &key, bool val)
+	{
+		newField(key, LogField::BOOL).b = val;
+	}
+
+	void LogEvent::addField(const std::string &key, double val)
+	{
+		newField(key, LogField::DOUBLE).d = val;
+	}
+
+	void LogEvent::addField(const std::string &key, const char *val)
+	{
+		newField(key, LogField::STRING).str = val ? val : "";
+	}
+
+	void LogEvent::addField(const std::string &key, const std::string &val)
+	{
+		newField(key, LogField::STRING).str = val;
+	}
+
 	LogEventWarpper::LogEventWarpper(LogEvent::ptr event)
 		: m_event(event) {}
 
@@ -389,6 +596,7 @@ namespace sylar
 		// %T -- Tab
 		// %C -- 协程id
 		// %N -- 线程id
+		// %X -- 诊断上下文, %X{key} 指定键
 		static std::map<std::string, std::function<FormatItem::ptr(const std::string &str)>> s_format_items = {
 #define XX(str, Func)                                                               \
 	{                                                                               \
@@ -406,7 +614,8 @@ namespace sylar
 			XX(l, LineFormatItem),
 			XX(T, TabFormatItem),
 			XX(C, CoroutineFormatItem),
-			XX(N, ThreadNameFormatItem)
+			XX(N, ThreadNameFormatItem),
+			XX(X, MDCFormatItem)
 #undef XX
 		};
 
@@ -433,6 +642,265 @@ namespace sylar
 		}
 	}
 
+	LogFormatter::ptr LogFormatter::Create(const std::string &pattern)
+	{
+		if (pattern == "json")
+		{
+			return LogFormatter::ptr(new JsonLogFormatter);
+		}
+		return LogFormatter::ptr(new LogFormatter(pattern));
+	}
+
+	/**********************************************JsonLogFormatter Functions**********************************/
+	// 需要转义的字符: '"' '\\' 以及 0x00-0x1F 控制字符
+	static void JsonEscapeScalar(std::string &out, const char *data, size_t len)
+	{
+		static const char *hex = "0123456789abcdef";
+		size_t begin = 0;
+		for (size_t i = 0; i < len; ++i)
+		{
+			unsigned char c = static_cast<unsigned char>(data[i]);
+			if (c != '"' && c != '\\' && c >= 0x20)
+			{
+				continue;
+			}
+
+			out.append(data + begin, i - begin);
+			begin = i + 1;
+			switch (c)
+			{
+			case '"':
+				out.append("\\\"", 2);
+				break;
+			case '\\':
+				out.append("\\\\", 2);
+				break;
+			case '\n':
+				out.append("\\n", 2);
+				break;
+			case '\r':
+				out.append("\\r", 2);
+				break;
+			case '\t':
+				out.append("\\t", 2);
+				break;
+			default:
+			{
+				char buf[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+				out.append(buf, sizeof(buf));
+				break;
+			}
+			}
+		}
+		out.append(data + begin, len - begin);
+	}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	// 每次检查32字节, 整块无需转义时直接追加
+	__attribute__((target("avx2"))) static void JsonEscapeAVX2(std::string &out, const char *data, size_t len)
+	{
+		const __m256i quote = _mm256_set1_epi8('"');
+		const __m256i slash = _mm256_set1_epi8('\\');
+		const __m256i ctrl = _mm256_set1_epi8(0x1F);
+		size_t i = 0;
+		while (i + 32 <= len)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+			__m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+														 _mm256_cmpeq_epi8(v, slash)),
+										_mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl), v));
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+			if (mask == 0)
+			{
+				out.append(data + i, 32);
+				i += 32;
+				continue;
+			}
+			size_t n = __builtin_ctz(mask);
+			out.append(data + i, n);
+			JsonEscapeScalar(out, data + i + n, 1);
+			i += n + 1;
+		}
+		JsonEscapeScalar(out, data + i, len - i);
+	}
+#endif
+
+#if defined(__SSE2__)
+	// 每次检查16字节, x86-64上SSE2必然可用
+	static void JsonEscapeSSE2(std::string &out, const char *data, size_t len)
+	{
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i slash = _mm_set1_epi8('\\');
+		const __m128i ctrl = _mm_set1_epi8(0x1F);
+		size_t i = 0;
+		while (i + 16 <= len)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+			__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+									 _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+			if (mask == 0)
+			{
+				out.append(data + i, 16);
+				i += 16;
+				continue;
+			}
+			size_t n = __builtin_ctz(mask);
+			out.append(data + i, n);
+			JsonEscapeScalar(out, data + i + n, 1);
+			i += n + 1;
+		}
+		JsonEscapeScalar(out, data + i, len - i);
+	}
+#endif
+
+	static void JsonEscape(std::string &out, const char *data, size_t len)
+	{
+#if defined(__x86_64__) && defined(__GNUC__)
+		static const bool s_has_avx2 = __builtin_cpu_supports("avx2");
+		if (s_has_avx2)
+		{
+			JsonEscapeAVX2(out, data, len);
+			return;
+		}
+#endif
+#if defined(__SSE2__)
+		JsonEscapeSSE2(out, data, len);
+#else
+		JsonEscapeScalar(out, data, len);
+#endif
+	}
+
+	static void JsonAppendString(std::string &out, const char *data, size_t len)
+	{
+		out.push_back('"');
+		JsonEscape(out, data, len);
+		out.push_back('"');
+	}
+
+	// first为false时先输出逗号
+	static void JsonAppendKey(std::string &out, const std::string &key, bool first = false)
+	{
+		if (!first)
+		{
+			out.push_back(',');
+		}
+		JsonAppendString(out, key.data(), key.size());
+		out.push_back(':');
+	}
+
+	JsonLogFormatter::JsonLogFormatter()
+		: LogFormatter("")
+	{
+		m_pattern = "json";
+	}
+
+	void JsonLogFormatter::formatTo(std::string &buf, std::shared_ptr<Logger> logger, LogLevel::Level level,
+									LogEvent::ptr event)
+	{
+		char num[64];
+		struct tm tm;
+		time_t time = event->getTime();
+		localtime_r(&time, &tm);
+		size_t n = strftime(num, sizeof(num), "%Y-%m-%d %H:%M:%S", &tm);
+
+		buf.append("{\"time\":\"", 9);
+		buf.append(num, n);
+		buf.append("\",\"level\":\"", 11);
+		buf.append(LogLevel::levelToString(level));
+		buf.append("\",\"logger\":", 11);
+		const std::string &name = event->getLogger()->getName();
+		JsonAppendString(buf, name.data(), name.size());
+		n = snprintf(num, sizeof(num), ",\"thread\":%u,\"coroutine\":%u,\"elapse\":%u,\"line\":%d",
+					 event->getThreadId(), event->getCoroutineId(), event->getElapse(), event->getLine());
+		buf.append(num, n);
+		buf.append(",\"thread_name\":", 15);
+		JsonAppendString(buf, event->getThreadName().data(), event->getThreadName().size());
+		buf.append(",\"file\":", 8);
+		JsonAppendString(buf, event->getFile(), strlen(event->getFile()));
+		buf.append(",\"msg\":", 7);
+		size_t len = 0;
+		const char *content = event->getContentData(len);
+		JsonAppendString(buf, content, len);
+
+		// 诊断上下文和结构化字段各自放在一个子对象中, 不会与固定字段重名
+		const MDC::Snapshot::ptr &mdc = event->getMDC();
+		if (mdc && !mdc->entries.empty())
+		{
+			buf.append(",\"mdc\":{", 8);
+			bool first = true;
+			for (auto &i : mdc->entries)
+			{
+				JsonAppendKey(buf, i.first, first);
+				JsonAppendString(buf, i.second.data(), i.second.size());
+				first = false;
+			}
+			buf.push_back('}');
+		}
+
+		const std::vector<LogField> &fields = event->getFields();
+		if (!fields.empty())
+		{
+			buf.append(",\"fields\":{", 11);
+		}
+		for (size_t i = 0; i < fields.size(); ++i)
+		{
+			const LogField &f = fields[i];
+			JsonAppendKey(buf, f.key, i == 0);
+			switch (f.type)
+			{
+			case LogField::INT:
+				n = snprintf(num, sizeof(num), "%lld", static_cast<long long>(f.i));
+				buf.append(num, n);
+				break;
+			case LogField::UINT:
+				n = snprintf(num, sizeof(num), "%llu", static_cast<unsigned long long>(f.u));
+				buf.append(num, n);
+				break;
+			case LogField::DOUBLE:
+				if (std::isfinite(f.d))
+				{
+					n = snprintf(num, sizeof(num), "%.17g", f.d);
+					buf.append(num, n);
+				}
+				else
+				{
+					buf.append("null", 4);
+				}
+				break;
+			case LogField::BOOL:
+				buf.append(f.b ? "true" : "false");
+				break;
+			case LogField::STRING:
+				JsonAppendString(buf, f.str.data(), f.str.size());
+				break;
+			}
+		}
+		if (!fields.empty())
+		{
+			buf.push_back('}');
+		}
+		buf.append("}\n", 2);
+	}
+
+	std::string JsonLogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level,
+										 LogEvent::ptr event)
+	{
+		std::string buf;
+		buf.reserve(256);
+		formatTo(buf, logger, level, event);
+		return buf;
+	}
+
+	std::ostream &JsonLogFormatter::format(std::ostream &os, std::shared_ptr<Logger> logger,
+										   LogLevel::Level level, LogEvent::ptr event)
+	{
+		std::string buf;
+		buf.reserve(256);
+		formatTo(buf, logger, level, event);
+		return os.write(buf.data(), buf.size());
+	}
+
 	/************************************Logger Functions*******************************************************/
 	Logger::Logger(const std::string &logName)
 		: m_name(logName), m_level(LogLevel::DEBUG)
@@ -445,7 +913,7 @@ namespace sylar
 		if (level >= m_level)
 		{
 			auto self = shared_from_this();
-			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			RWMutex::ReadLock lock(m_mutex);
 			if (!m_appenders.empty())
 			{
 				for (auto &i : m_appenders)
@@ -487,18 +955,17 @@ namespace sylar
 
 	void Logger::addAppender(LogAppender::ptr appender)
 	{
-		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		RWMutex::WriteLock lock(m_mutex);
 		if (!appender->getFormatter())
 		{
-			std::lock_guard<std::mutex> lockGuard2(appender->m_mutex);
-			appender->m_formatter = m_formatter;
+			appender->inheritFormatter(m_formatter);
 		}
 		m_appenders.push_back(appender);
 	}
 
 	void Logger::delAppender(LogAppender::ptr appender)
 	{
-		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		RWMutex::WriteLock lock(m_mutex);
 		for (auto it = m_appenders.begin(); it != m_appenders.end(); ++it)
 		{
 			if (*it == appender)
@@ -511,29 +978,25 @@ namespace sylar
 
 	void Logger::clearAppenders()
 	{
-		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		RWMutex::WriteLock lock(m_mutex);
 		m_appenders.clear();
 	}
 
 	void Logger::setFormatter(LogFormatter::ptr formatter)
 	{
-		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		RWMutex::WriteLock lock(m_mutex);
 		m_formatter = formatter;
 
 		for (auto &i : m_appenders)
 		{
-			std::lock_guard<std::mutex> lockGuard2(i->m_mutex);
-			if (!i->m_has_formatter)
-			{
-				i->m_formatter = m_formatter;
-			}
+			i->inheritFormatter(m_formatter);
 		}
 	}
 
 	void Logger::setFormatter(const std::string &formatter)
 	{
 		//std::cout << "---:" << formatter << std::endl;
-		sylar::LogFormatter::ptr newFormatter(new sylar::LogFormatter(formatter));
+		sylar::LogFormatter::ptr newFormatter = LogFormatter::Create(formatter);
 		if (newFormatter->isError())
 		{
 			std::cout << "Logger setFormatter name = " << m_name
@@ -545,31 +1008,42 @@ namespace sylar
 
 	LogFormatter::ptr Logger::getFormatter() const
 	{
-		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		RWMutex::ReadLock lock(m_mutex);
 		return m_formatter;
 	}
 
 	std::string Logger::toYamlString()
 	{
-		YAML::Node node;
-		node["name"] = m_name;
+		YAML::Emitter out;
+		toYaml(out);
+		return std::string(out.c_str(), out.size());
+	}
+
+	void Logger::toYaml(YAML::Emitter &out)
+	{
+		RWMutex::ReadLock lock(m_mutex);
+		out << YAML::BeginMap;
+		out << YAML::Key << "name" << YAML::Value << m_name;
 		if (m_level != LogLevel::UNKNOWN)
 		{
-			node["level"] = LogLevel::levelToString(m_level);
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(m_level);
 		}
 
 		if (m_formatter)
 		{
-			node["formatter"] = m_formatter->getPattern();
+			out << YAML::Key << "formatter" << YAML::Value << m_formatter->getPattern();
 		}
 
-		for (auto &i : m_appenders)
+		if (!m_appenders.empty())
 		{
-			node["appenders"].push_back(YAML::Load(i->toYamlString()));
+			out << YAML::Key << "appenders" << YAML::Value << YAML::BeginSeq;
+			for (auto &i : m_appenders)
+			{
+				i->toYaml(out);
+			}
+			out << YAML::EndSeq;
 		}
-		std::stringstream ss;
-		ss << node;
-		return ss.str();
+		out << YAML::EndMap;
 	}
 
 	/***************************LogAppender Functions****************************************************/
@@ -582,41 +1056,37 @@ namespace sylar
 		}
 	}
 
-	std::string StdoutLogAppender::toYamlString()
+	void StdoutLogAppender::toYamlFields(YAML::Emitter &out)
 	{
-		YAML::Node node;
-		node["type"] = "StdoutLogAppender";
+		out << YAML::Key << "type" << YAML::Value << "StdoutLogAppender";
 		if (m_level != LogLevel::UNKNOWN)
 		{
-			node["level"] = LogLevel::levelToString(m_level);
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(m_level);
 		}
 
 		if (m_has_formatter && m_formatter)
 		{
-			node["formatter"] = m_formatter->getPattern();
+			out << YAML::Key << "formatter" << YAML::Value << m_formatter->getPattern();
 		}
-		std::stringstream ss;
-		ss << node;
-		return ss.str();
 	}
 
 	FileLogAppender::FileLogAppender(const std::string &filename)
-		: m_filename(filename)
+		: m_filename(filename), m_timer_manager(TimerMgr::GetInstance())
 	{
 		reopenFile();
+		m_reopen_timer = m_timer_manager->addTimer(3000, std::bind(&FileLogAppender::reopenFile, this), true);
+	}
+
+	FileLogAppender::~FileLogAppender()
+	{
+		// 等待可能正在执行的重新打开结束
+		m_reopen_timer->cancel();
 	}
 
 	void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
 	{
 		if (level >= m_level)
 		{
-			uint64_t nowTime = event->getTime();
-			if (nowTime >= (m_last_time + 3))
-			{
-				reopenFile();
-				m_last_time = nowTime;
-			}
-
 			std::lock_guard<std::mutex> lockGuard(m_mutex);
 			if (!m_formatter->format(m_filestream, logger, level, event))
 			{
@@ -625,23 +1095,19 @@ namespace sylar
 		}
 	}
 
-	std::string FileLogAppender::toYamlString()
+	void FileLogAppender::toYamlFields(YAML::Emitter &out)
 	{
-		YAML::Node node;
-		node["type"] = "FileLogAppender";
-		node["file"] = m_filename;
+		out << YAML::Key << "type" << YAML::Value << "FileLogAppender";
+		out << YAML::Key << "file" << YAML::Value << m_filename;
 		if (m_level != LogLevel::UNKNOWN)
 		{
-			node["level"] = LogLevel::levelToString(m_level);
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(m_level);
 		}
 
 		if (m_has_formatter && m_formatter)
 		{
-			node["formatter"] = m_formatter->getPattern();
+			out << YAML::Key << "formatter" << YAML::Value << m_formatter->getPattern();
 		}
-		std::stringstream ss;
-		ss << node;
-		return ss.str();
 	}
 
 	void LogAppender::setFormatter(LogFormatter::ptr formatter)
@@ -664,6 +1130,29 @@ namespace sylar
 		return m_formatter;
 	}
 
+	std::string LogAppender::toYamlString()
+	{
+		YAML::Emitter out;
+		toYaml(out);
+		return std::string(out.c_str(), out.size());
+	}
+
+	void LogAppender::toYaml(YAML::Emitter &out)
+	{
+		out << YAML::BeginMap;
+		toYamlFields(out);
+		out << YAML::EndMap;
+	}
+
+	void LogAppender::inheritFormatter(LogFormatter::ptr formatter)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		if (!m_has_formatter)
+		{
+			m_formatter = formatter;
+		}
+	}
+
 	bool FileLogAppender::reopenFile()
 	{
 		std::lock_guard<std::mutex> lockGuard(m_mutex);
@@ -676,60 +1165,594 @@ namespace sylar
 		return !!m_filestream; // m_filestream无法直接转换成bool型，使用operator!()间接将其转换为bool型
 	}
 
-	/*********************************************LoggerManager Functions*************************************/
-	LoggerManager::LoggerManager()
+	CompressedFileLogAppender::CompressedFileLogAppender(const std::string &filename, int compressLevel,
+														 size_t blockSize)
+		: m_filename(filename),
+		  m_compress_level(std::min(std::max(compressLevel, -1), 9)), // zlib只接受-1(默认)和0-9
+		  m_block_size(blockSize ? blockSize : 64 * 1024),
+		  m_timer_manager(TimerMgr::GetInstance())
 	{
-		m_root.reset(new Logger);
-		m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
-
-		m_loggers[m_root->m_name] = m_root;
-
-		init();
+		m_buffer.reserve(m_block_size);
+		m_thread.reset(new Thread(std::bind(&CompressedFileLogAppender::run, this), "log_compress"));
+		m_flush_timer = m_timer_manager->addTimer(1000, std::bind(&CompressedFileLogAppender::flush, this), true);
+		m_reopen_timer = m_timer_manager->addTimer(3000, std::bind(&CompressedFileLogAppender::reopenFile, this),
+												   true);
 	}
 
-	Logger::ptr LoggerManager::getLogger(const std::string &name)
+	CompressedFileLogAppender::~CompressedFileLogAppender()
 	{
-		auto it = m_loggers.find(name);
-		if (it != m_loggers.end())
+		m_flush_timer->cancel();
+		m_reopen_timer->cancel();
 		{
-			return it->second;
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			m_stop = true;
 		}
-
-		Logger::ptr logger(new Logger(name));
-		logger->m_root = m_root;
-		m_loggers[name] = logger;
-		return logger;
+		m_cond.notify_one();
+		m_thread->join();
 	}
 
-	std::string LoggerManager::toYamlString()
+	void CompressedFileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
 	{
-		YAML::Node node;
-		for (auto &i : m_loggers)
+		if (level >= m_level)
 		{
-			node.push_back(YAML::Load(i.second->toYamlString()));
+			std::string line = getFormatter()->format(logger, level, event);
+
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			// 后台线程跟不上时丢弃并计数, 不阻塞业务线程, 也避免内存无限增长
+			if (m_buffer.size() >= m_block_size * 8)
+			{
+				++m_dropped;
+				return;
+			}
+			m_buffer.append(line);
+			if (m_buffer.size() >= m_block_size)
+			{
+				m_cond.notify_one();
+			}
 		}
-		std::stringstream ss;
-		ss << node;
-		return ss.str();
 	}
 
-	void LoggerManager::init()
+	void CompressedFileLogAppender::flush()
 	{
+		{
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			m_flush = true;
+		}
+		m_cond.notify_one();
 	}
 
-	struct LogAppenderDefine
+	void CompressedFileLogAppender::reopenFile()
 	{
-		int type = 0; // 1: file, 2: stdout
+		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		m_reopen = true;
+	}
+
+	uint64_t CompressedFileLogAppender::getDropped()
+	{
+		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		return m_dropped;
+	}
+
+	void CompressedFileLogAppender::run()
+	{
+		std::string block;
+		block.reserve(m_block_size);
+		uint64_t reported = 0; // 已写入文件的丢弃条数
+		bool reopen = false;   // 收到重新打开请求后, 直到真正写入一块才清除
+		while (true)
+		{
+			bool stop = false;
+			uint64_t dropped = 0;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cond.wait(lock, [this]()
+							{ return m_stop || m_flush || m_buffer.size() >= m_block_size; });
+				block.swap(m_buffer);
+				m_flush = false;
+				stop = m_stop;
+				reopen = reopen || m_reopen;
+				m_reopen = false;
+				dropped = m_dropped;
+			}
+
+			if (dropped != reported)
+			{
+				block.append("CompressedFileLogAppender dropped ")
+					.append(std::to_string(dropped - reported))
+					.append(" log records\n");
+				reported = dropped;
+			}
+			// 后台线程落后时一次可能取到多块数据, 按m_block_size切分, 每块压缩成独立的gzip member,
+			// 尽量在换行处切开, 单个member的大小和压缩耗时保持有界
+			size_t pos = 0;
+			while (pos < block.size())
+			{
+				size_t len = block.size() - pos;
+				if (len > m_block_size)
+				{
+					size_t nl = block.rfind('\n', pos + m_block_size - 1);
+					len = (nl != std::string::npos && nl >= pos) ? nl + 1 - pos : m_block_size;
+				}
+				writeBlock(block.data() + pos, len, reopen);
+				reopen = false;
+				pos += len;
+			}
+			block.clear();
+			if (stop)
+			{
+				break;
+			}
+		}
+	}
+
+	void CompressedFileLogAppender::writeBlock(const char *data, size_t size, bool reopen)
+	{
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		// windowBits + 16: 输出gzip格式
+		if (deflateInit2(&zs, m_compress_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			std::cout << "CompressedFileLogAppender deflateInit2 error, file = " << m_filename << std::endl;
+			return;
+		}
+
+		std::string out;
+		out.resize(deflateBound(&zs, size));
+		zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+		zs.avail_in = static_cast<uInt>(size);
+		zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+		zs.avail_out = static_cast<uInt>(out.size());
+		int rt = deflate(&zs, Z_FINISH);
+		size_t len = out.size() - zs.avail_out;
+		deflateEnd(&zs);
+		if (rt != Z_STREAM_END)
+		{
+			std::cout << "CompressedFileLogAppender deflate error, file = " << m_filename << std::endl;
+			return;
+		}
+
+		// 与FileLogAppender一样定期重新打开, 文件被轮转或删除后自动重建
+		if (reopen || !m_filestream.is_open() || !m_filestream)
+		{
+			m_filestream.close();
+			m_filestream.clear();
+			m_filestream.open(m_filename, std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+		}
+		// 每块都是完整的gzip member, 写完即刷新, 进程异常退出时文件仍可解压
+		if (!m_filestream.write(out.data(), len) || !m_filestream.flush())
+		{
+			std::cout << "CompressedFileLogAppender write error, file = " << m_filename << std::endl;
+		}
+	}
+
+	void CompressedFileLogAppender::toYamlFields(YAML::Emitter &out)
+	{
+		out << YAML::Key << "type" << YAML::Value << "CompressedFileLogAppender";
+		out << YAML::Key << "file" << YAML::Value << m_filename;
+		out << YAML::Key << "compress_level" << YAML::Value << m_compress_level;
+		out << YAML::Key << "block_size" << YAML::Value << m_block_size;
+		if (m_level != LogLevel::UNKNOWN)
+		{
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(m_level);
+		}
+
+		if (m_has_formatter && m_formatter)
+		{
+			out << YAML::Key << "formatter" << YAML::Value << m_formatter->getPattern();
+		}
+	}
+
+	// 某个RingBufferLogAppender在单个线程中的环形缓冲区
+	struct LogRing
+	{
+		std::weak_ptr<void> owner;		   // 所属Appender的m_token, 失效说明Appender已析构
+		uint64_t generation = 0;		   // 所属Appender的m_generation
+		std::vector<LogEvent::ptr> events; // 缓存的日志事件
+		size_t head = 0;				   // 下一个写入位置
+		size_t size = 0;				   // 已缓存条数
+	};
+
+	// 当前线程的全部环形缓冲区, 以Appender的m_token为键; 线程退出时随之释放
+	static std::unordered_map<const void *, LogRing> &GetLogRings()
+	{
+		static thread_local std::unordered_map<const void *, LogRing> s_rings;
+		return s_rings;
+	}
+
+	static LogRing &GetLogRing(const std::shared_ptr<char> &token, uint64_t generation)
+	{
+		auto &rings = GetLogRings();
+		auto it = rings.find(token.get());
+		if (it == rings.end())
+		{
+			// 新建缓冲区时顺带清理已析构的Appender留下的缓冲区
+			for (auto i = rings.begin(); i != rings.end();)
+			{
+				if (i->second.owner.expired())
+				{
+					i = rings.erase(i);
+				}
+				else
+				{
+					++i;
+				}
+			}
+			it = rings.emplace(token.get(), LogRing()).first;
+		}
+
+		LogRing &ring = it->second;
+		// 地址被新的Appender复用, 或者调用过clearAppenders
+		if (ring.owner.expired() || ring.generation != generation)
+		{
+			ring.owner = token;
+			ring.generation = generation;
+			ring.events.clear();
+			ring.head = 0;
+			ring.size = 0;
+		}
+		return ring;
+	}
+
+	RingBufferLogAppender::RingBufferLogAppender(size_t capacity, LogLevel::Level trigger)
+		: m_capacity(capacity ? capacity : 1), m_trigger(trigger),
+		  m_token(std::make_shared<char>()), m_appenders(std::make_shared<const AppenderList>())
+	{
+		m_level = kDefaultLevel;
+	}
+
+	std::shared_ptr<const RingBufferLogAppender::AppenderList> RingBufferLogAppender::getAppenders() const
+	{
+		return std::atomic_load_explicit(&m_appenders, std::memory_order_acquire);
+	}
+
+	void RingBufferLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
+	{
+		LogRing &ring = GetLogRing(m_token, m_generation.load(std::memory_order_relaxed));
+		std::vector<LogEvent::ptr> backlog;
+		if (level >= m_trigger)
+		{
+			// 触发: 取出该线程缓存中还没有输出过的日志, 按写入顺序输出
+			size_t begin = (ring.head + m_capacity - ring.size) % m_capacity;
+			for (size_t i = 0; i < ring.size; ++i)
+			{
+				LogEvent::ptr &e = ring.events[(begin + i) % m_capacity];
+				if (e->getLevel() < m_level)
+				{
+					backlog.push_back(std::move(e));
+				}
+				e.reset();
+			}
+			ring.head = 0;
+			ring.size = 0;
+		}
+		else
+		{
+			// 不格式化, 只保存事件的引用; 满了覆盖最旧的
+			if (ring.events.empty())
+			{
+				ring.events.resize(m_capacity);
+			}
+			ring.events[ring.head] = event;
+			ring.head = (ring.head + 1) % m_capacity;
+			if (ring.size < m_capacity)
+			{
+				++ring.size;
+			}
+			if (level < m_level)
+			{
+				return;
+			}
+		}
+
+		auto appenders = getAppenders();
+		for (auto &e : backlog)
+		{
+			for (auto &a : *appenders)
+			{
+				a->log(logger, e->getLevel(), e);
+			}
+		}
+		for (auto &a : *appenders)
+		{
+			a->log(logger, level, event);
+		}
+	}
+
+	void RingBufferLogAppender::toYamlFields(YAML::Emitter &out)
+	{
+		out << YAML::Key << "type" << YAML::Value << "RingBufferLogAppender";
+		if (m_level != LogLevel::UNKNOWN)
+		{
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(m_level);
+		}
+		out << YAML::Key << "capacity" << YAML::Value << m_capacity;
+		out << YAML::Key << "trigger" << YAML::Value << LogLevel::levelToString(m_trigger);
+
+		auto appenders = getAppenders();
+		if (!appenders->empty())
+		{
+			out << YAML::Key << "appenders" << YAML::Value << YAML::BeginSeq;
+			for (auto &i : *appenders)
+			{
+				i->toYaml(out);
+			}
+			out << YAML::EndSeq;
+		}
+	}
+
+	void RingBufferLogAppender::inheritFormatter(LogFormatter::ptr formatter)
+	{
+		LogAppender::inheritFormatter(formatter);
+
+		for (auto &i : *getAppenders())
+		{
+			i->inheritFormatter(formatter);
+		}
+	}
+
+	void RingBufferLogAppender::addAppender(LogAppender::ptr appender)
+	{
+		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		if (!appender->getFormatter() && m_formatter)
+		{
+			appender->inheritFormatter(m_formatter);
+		}
+		// 写者之间由m_mutex互斥, 读者只取快照
+		std::shared_ptr<AppenderList> appenders = std::make_shared<AppenderList>(*m_appenders);
+		appenders->push_back(appender);
+		std::atomic_store_explicit(&m_appenders, std::shared_ptr<const AppenderList>(appenders),
+								   std::memory_order_release);
+	}
+
+	void RingBufferLogAppender::clearAppenders()
+	{
+		std::lock_guard<std::mutex> lockGuard(m_mutex);
+		std::atomic_store_explicit(&m_appenders, std::make_shared<const AppenderList>(),
+								   std::memory_order_release);
+		m_generation.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// FNV-1a, 用作日志指纹
+	static uint64_t HashBytes(uint64_t hash, const void *data, size_t len)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < len; ++i)
+		{
+			hash ^= p[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	DedupLogAppender::DedupLogAppender(LogAppender::ptr appender, uint32_t window)
+		: m_appender(appender), m_window(window), m_timer_manager(TimerMgr::GetInstance())
+	{
+		m_level = LogLevel::UNKNOWN;
+	}
+
+	DedupLogAppender::~DedupLogAppender()
+	{
+		Timer::ptr timer;
+		{
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			timer.swap(m_window_timer);
+		}
+		// 回调中会获取m_mutex, 不能持锁取消
+		if (timer)
+		{
+			timer->cancel();
+		}
+
+		Logger::ptr logger;
+		LogEvent::ptr summary;
+		{
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			summary = takeRepeated(logger);
+		}
+		if (summary)
+		{
+			m_appender->log(logger, summary->getLevel(), summary);
+		}
+	}
+
+	void DedupLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)
+	{
+		if (level < m_level)
+		{
+			return;
+		}
+
+		// 调用点的文件名是字面量, 直接用指针参与指纹
+		const char *file = event->getFile();
+		int32_t line = event->getLine();
+		size_t len = 0;
+		const char *content = event->getContentData(len);
+		uint64_t hash = HashBytes(0xcbf29ce484222325ULL, &file, sizeof(file));
+		hash = HashBytes(hash, &line, sizeof(line));
+		hash = HashBytes(hash, &level, sizeof(level));
+		hash = HashBytes(hash, content, len);
+
+		// 锁内只做计数, 下级Appender的IO在锁外进行
+		Timer::ptr finished;
+		Logger::ptr summaryLogger;
+		LogEvent::ptr summary;
+		{
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			// 指纹相同时与上一条日志逐项比较, 排除哈希冲突
+			if (m_last_event && hash == m_last_hash && event->getTime() < m_first_time + m_window &&
+				file == m_last_event->getFile() && line == m_last_event->getLine() &&
+				level == m_last_event->getLevel())
+			{
+				size_t lastLen = 0;
+				const char *last = m_last_event->getContentData(lastLen);
+				if (len == lastLen && memcmp(content, last, len) == 0)
+				{
+					if (m_repeated++ == 0)
+					{
+						// 本轮第一次折叠, 窗口结束时输出折叠条数
+						uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+										   system_clock::now().time_since_epoch())
+										   .count();
+						uint64_t deadline = (m_first_time + m_window) * 1000;
+						m_window_timer = m_timer_manager->addTimer(deadline > now ? deadline - now : 0,
+																   std::bind(&DedupLogAppender::onWindowExpired,
+																			 this, m_round));
+					}
+					m_last_logger = logger;
+					m_last_event = event;
+					return;
+				}
+			}
+
+			summary = takeRepeated(summaryLogger);
+			finished.swap(m_window_timer);
+			m_last_hash = hash;
+			m_last_event = event;
+			m_first_time = event->getTime();
+			++m_round;
+		}
+		// 上一轮的定时器可能正在等待m_mutex, 释放锁后再取消
+		if (finished)
+		{
+			finished->cancel();
+		}
+		// 多个线程同时结束一轮时, 汇总与新日志之间的先后不保证严格有序
+		if (summary)
+		{
+			m_appender->log(summaryLogger, summary->getLevel(), summary);
+		}
+		m_appender->log(logger, level, event);
+	}
+
+	void DedupLogAppender::onWindowExpired(uint64_t round)
+	{
+		Logger::ptr logger;
+		LogEvent::ptr summary;
+		{
+			std::lock_guard<std::mutex> lockGuard(m_mutex);
+			if (round == m_round)
+			{
+				summary = takeRepeated(logger);
+			}
+		}
+		if (summary)
+		{
+			m_appender->log(logger, summary->getLevel(), summary);
+		}
+	}
+
+	LogEvent::ptr DedupLogAppender::takeRepeated(Logger::ptr &logger)
+	{
+		if (m_repeated == 0)
+		{
+			return nullptr;
+		}
+
+		LogEvent::ptr summary(new LogEvent(m_last_logger, m_last_event->getLevel(), m_last_event->getFile(),
+										   m_last_event->getLine(), m_last_event->getElapse(),
+										   m_last_event->getThreadId(), m_last_event->getCoroutineId(),
+										   m_last_event->getTime(), m_last_event->getThreadName()));
+		summary->getContentStream() << "last message repeated " << m_repeated << " times";
+
+		m_repeated = 0;
+		logger.swap(m_last_logger);
+		return summary;
+	}
+
+	void DedupLogAppender::toYamlFields(YAML::Emitter &out)
+	{
+		m_appender->toYamlFields(out);
+		out << YAML::Key << "dedup" << YAML::Value << m_window;
+	}
+
+	void DedupLogAppender::inheritFormatter(LogFormatter::ptr formatter)
+	{
+		LogAppender::inheritFormatter(formatter);
+		m_appender->inheritFormatter(formatter);
+	}
+
+	/*********************************************LoggerManager Functions*************************************/
+	LoggerManager::LoggerManager()
+	{
+		m_root.reset(new Logger);
+		m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
+
+		m_loggers[m_root->m_name] = m_root;
+
+		init();
+	}
+
+	Logger::ptr LoggerManager::getLogger(const std::string &name)
+	{
+		{
+			RWSpinlock::ReadLock lock(m_mutex);
+			auto it = m_loggers.find(name);
+			if (it != m_loggers.end())
+			{
+				return it->second;
+			}
+		}
+
+		// 在锁外创建, 写锁内再检查一次, 并发创建同名日志器时只保留先插入的
+		Logger::ptr logger(new Logger(name));
+		logger->m_root = m_root;
+		RWSpinlock::WriteLock lock(m_mutex);
+		auto res = m_loggers.insert(std::make_pair(name, logger));
+		return res.first->second;
+	}
+
+	std::string LoggerManager::toYamlString()
+	{
+		// 自旋锁内只拷贝日志器列表, 序列化放到锁外
+		std::vector<Logger::ptr> loggers;
+		{
+			RWSpinlock::ReadLock lock(m_mutex);
+			loggers.reserve(m_loggers.size());
+			for (auto &i : m_loggers)
+			{
+				loggers.push_back(i.second);
+			}
+		}
+
+		YAML::Emitter out;
+		out << YAML::BeginSeq;
+		for (auto &i : loggers)
+		{
+			i->toYaml(out);
+		}
+		out << YAML::EndSeq;
+		return std::string(out.c_str(), out.size());
+	}
+
+	void LoggerManager::init()
+	{
+	}
+
+	struct LogAppenderDefine
+	{
+		int type = 0; // 1: file, 2: stdout, 3: ring buffer, 4: compressed file
 		LogLevel::Level level = LogLevel::Level::UNKNOWN;
 		std::string formatter;
 		std::string file;
+		size_t capacity = 0;                                 // ring buffer: 每个线程缓存条数
+		LogLevel::Level trigger = LogLevel::Level::UNKNOWN; // ring buffer: 触发级别
+		std::vector<LogAppenderDefine> appenders;            // ring buffer: 下级Appender
+		uint32_t dedup = 0;                                  // 重复日志折叠窗口(秒), 0表示不折叠
+		int compress_level = 0;                              // compressed file: 压缩级别
+		size_t block_size = 0;                               // compressed file: 压缩块大小
 
 		bool operator==(const LogAppenderDefine &rhs) const
 		{
 			return type == rhs.type &&
 				   level == rhs.level &&
 				   formatter == rhs.formatter &&
-				   file == rhs.file;
+				   file == rhs.file &&
+				   capacity == rhs.capacity &&
+				   trigger == rhs.trigger &&
+				   appenders == rhs.appenders &&
+				   dedup == rhs.dedup &&
+				   compress_level == rhs.compress_level &&
+				   block_size == rhs.block_size;
 		}
 	};
 
@@ -756,14 +1779,149 @@ namespace sylar
 		bool isValid() const { return !name.empty(); }
 	};
 
-	// string to LogDefine
+	// 解析单个appender配置, 失败返回false
+	static bool ParseAppenderDefine(const YAML::Node &a, LogAppenderDefine &lad)
+	{
+		if (!a["type"].IsDefined())
+		{
+			std::cout << "log config error: appender type is null, " << a
+					  << std::endl;
+			return false;
+		}
+		std::string type = a["type"].as<std::string>();
+		if (type == "FileLogAppender")
+		{
+			lad.type = 1;
+			if (!a["file"].IsDefined())
+			{
+				std::cout << "log config error: fileappender file is null, " << a
+						  << std::endl;
+				return false;
+			}
+			lad.file = a["file"].as<std::string>();
+		}
+		else if (type == "StdoutLogAppender")
+		{
+			lad.type = 2;
+		}
+		else if (type == "CompressedFileLogAppender")
+		{
+			lad.type = 4;
+			if (!a["file"].IsDefined())
+			{
+				std::cout << "log config error: compressed fileappender file is null, " << a
+						  << std::endl;
+				return false;
+			}
+			lad.file = a["file"].as<std::string>();
+			lad.compress_level = a["compress_level"].IsDefined() ? a["compress_level"].as<int>() : 6;
+			if (lad.compress_level < -1 || lad.compress_level > 9)
+			{
+				std::cout << "log config error: compress_level out of range [-1, 9], clamped, " << a
+						  << std::endl;
+				lad.compress_level = std::min(std::max(lad.compress_level, -1), 9);
+			}
+			lad.block_size = a["block_size"].IsDefined() ? a["block_size"].as<size_t>() : 64 * 1024;
+		}
+		else if (type == "RingBufferLogAppender")
+		{
+			lad.type = 3;
+			lad.level = RingBufferLogAppender::kDefaultLevel;
+			lad.capacity = a["capacity"].IsDefined() ? a["capacity"].as<size_t>() : 256;
+			lad.trigger = a["trigger"].IsDefined()
+							  ? LogLevel::stringToLevel(a["trigger"].as<std::string>())
+							  : LogLevel::ERROR;
+			if (a["appenders"].IsDefined())
+			{
+				for (size_t j = 0; j < a["appenders"].size(); ++j)
+				{
+					LogAppenderDefine child;
+					if (ParseAppenderDefine(a["appenders"][j], child))
+					{
+						lad.appenders.push_back(child);
+					}
+				}
+			}
+		}
+		else
+		{
+			std::cout << "log config error: appender type is invalid, " << a
+					  << std::endl;
+			return false;
+		}
+
+		if (a["level"].IsDefined())
+		{
+			lad.level = LogLevel::stringToLevel(a["level"].as<std::string>());
+		}
+		if (a["formatter"].IsDefined())
+		{
+			lad.formatter = a["formatter"].as<std::string>();
+		}
+		if (a["dedup"].IsDefined())
+		{
+			lad.dedup = a["dedup"].as<uint32_t>();
+		}
+		return true;
+	}
+
+	static void EmitAppenderDefine(YAML::Emitter &out, const LogAppenderDefine &a)
+	{
+		out << YAML::BeginMap;
+		if (a.type == 1)
+		{
+			out << YAML::Key << "type" << YAML::Value << "FileLogAppender";
+			out << YAML::Key << "file" << YAML::Value << a.file;
+		}
+		else if (a.type == 2)
+		{
+			out << YAML::Key << "type" << YAML::Value << "StdoutLogAppender";
+		}
+		else if (a.type == 4)
+		{
+			out << YAML::Key << "type" << YAML::Value << "CompressedFileLogAppender";
+			out << YAML::Key << "file" << YAML::Value << a.file;
+			out << YAML::Key << "compress_level" << YAML::Value << a.compress_level;
+			out << YAML::Key << "block_size" << YAML::Value << a.block_size;
+		}
+		else if (a.type == 3)
+		{
+			out << YAML::Key << "type" << YAML::Value << "RingBufferLogAppender";
+			out << YAML::Key << "capacity" << YAML::Value << a.capacity;
+			out << YAML::Key << "trigger" << YAML::Value << LogLevel::levelToString(a.trigger);
+			if (!a.appenders.empty())
+			{
+				out << YAML::Key << "appenders" << YAML::Value << YAML::BeginSeq;
+				for (auto &c : a.appenders)
+				{
+					EmitAppenderDefine(out, c);
+				}
+				out << YAML::EndSeq;
+			}
+		}
+		if (a.level != LogLevel::UNKNOWN)
+		{
+			out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(a.level);
+		}
+
+		if (!a.formatter.empty())
+		{
+			out << YAML::Key << "formatter" << YAML::Value << a.formatter;
+		}
+		if (a.dedup)
+		{
+			out << YAML::Key << "dedup" << YAML::Value << a.dedup;
+		}
+		out << YAML::EndMap;
+	}
+
+	// node to LogDefine
 	template <>
-	class LexicalCast<std::string, LogDefine>
+	class NodeCast<LogDefine>
 	{
 	public:
-		LogDefine operator()(const std::string &v)
+		LogDefine operator()(const YAML::Node &n)
 		{
-			YAML::Node n = YAML::Load(v);
 			LogDefine ld;
 			if (!n["name"].IsDefined())
 			{
@@ -785,182 +1943,166 @@ namespace sylar
 			{
 				for (size_t j = 0; j < n["appenders"].size(); ++j)
 				{
-					auto a = n["appenders"][j];
-					if (!a["type"].IsDefined())
-					{
-						std::cout << "log config error: appender type is null, " << a
-								  << std::endl;
-						continue;
-					}
-					std::string type = a["type"].as<std::string>();
 					LogAppenderDefine lad;
-					if (type == "FileLogAppender")
-					{
-						lad.type = 1;
-						if (!a["file"].IsDefined())
-						{
-							std::cout << "log config error: fileappender file is null, " << a
-									  << std::endl;
-							continue;
-						}
-						lad.file = a["file"].as<std::string>();
-						if (a["formatter"].IsDefined())
-						{
-							lad.formatter = a["formatter"].as<std::string>();
-						}
-					}
-					else if (type == "StdoutLogAppender")
-					{
-						lad.type = 2;
-						if (a["formatter"].IsDefined())
-						{
-							lad.formatter = a["formatter"].as<std::string>();
-						}
-					}
-					else
+					if (ParseAppenderDefine(n["appenders"][j], lad))
 					{
-						std::cout << "log config error: appender type is invalid, " << a
-								  << std::endl;
-						continue;
+						ld.appenders.push_back(lad);
 					}
-
-					ld.appenders.push_back(lad);
 				}
 			}
 			return ld;
 		}
 	};
 
-	// LogDefine to string
+	// string to LogDefine
 	template <>
-	class LexicalCast<LogDefine, std::string>
+	class LexicalCast<std::string, LogDefine>
 	{
 	public:
-		std::string operator()(const LogDefine &i)
+		LogDefine operator()(const std::string &v)
 		{
-			YAML::Node n;
-			n["name"] = i.name;
+			return NodeCast<LogDefine>()(YAML::Load(v));
+		}
+	};
+
+	// LogDefine to emitter
+	template <>
+	class ConfigEmit<LogDefine>
+	{
+	public:
+		void operator()(YAML::Emitter &out, const LogDefine &i)
+		{
+			out << YAML::BeginMap;
+			out << YAML::Key << "name" << YAML::Value << i.name;
 			if (i.level != LogLevel::UNKNOWN)
 			{
-				n["level"] = LogLevel::levelToString(i.level);
+				out << YAML::Key << "level" << YAML::Value << LogLevel::levelToString(i.level);
 			}
 			if (!i.formatter.empty())
 			{
-				n["formatter"] = i.formatter;
+				out << YAML::Key << "formatter" << YAML::Value << i.formatter;
 			}
 
-			for (auto &a : i.appenders)
+			if (!i.appenders.empty())
 			{
-				YAML::Node na;
-				if (a.type == 1)
+				out << YAML::Key << "appenders" << YAML::Value << YAML::BeginSeq;
+				for (auto &a : i.appenders)
 				{
-					na["type"] = "FileLogAppender";
-					na["file"] = a.file;
-				}
-				else if (a.type == 2)
-				{
-					na["type"] = "StdoutLogAppender";
-				}
-				if (a.level != LogLevel::UNKNOWN)
-				{
-					na["level"] = LogLevel::levelToString(a.level);
+					EmitAppenderDefine(out, a);
 				}
+				out << YAML::EndSeq;
+			}
+			out << YAML::EndMap;
+		}
+	};
 
-				if (!a.formatter.empty())
-				{
-					na["formatter"] = a.formatter;
-				}
+	// LogDefine to string
+	template <>
+	class LexicalCast<LogDefine, std::string>
+	{
+	public:
+		std::string operator()(const LogDefine &i)
+		{
+			return ConfigEmitToString(i);
+		}
+	};
 
-				n["appenders"].push_back(na);
+	// 根据配置创建appender
+	static LogAppender::ptr CreateAppender(const std::string &logName, const LogAppenderDefine &a)
+	{
+		LogAppender::ptr ap;
+		if (a.type == 1)
+		{
+			ap.reset(new FileLogAppender(a.file));
+		}
+		else if (a.type == 2)
+		{
+			ap.reset(new StdoutLogAppender);
+		}
+		else if (a.type == 4)
+		{
+			ap.reset(new CompressedFileLogAppender(a.file, a.compress_level, a.block_size));
+		}
+		else if (a.type == 3)
+		{
+			RingBufferLogAppender::ptr ring(new RingBufferLogAppender(a.capacity, a.trigger));
+			for (auto &c : a.appenders)
+			{
+				ring->addAppender(CreateAppender(logName, c));
 			}
-			std::stringstream ss;
-			ss << n;
-			return ss.str();
+			ap = ring;
 		}
-	};
+		ap->setLevel(a.level);
+		if (!a.formatter.empty())
+		{
+			LogFormatter::ptr fmt = LogFormatter::Create(a.formatter);
+			if (!fmt->isError())
+			{
+				ap->setFormatter(fmt);
+			}
+			else
+			{
+				std::cout << " log.name=" << logName
+						  << " appender type=" << a.type
+						  << " formatter=" << a.formatter
+						  << " is invalid." << std::endl;
+			}
+		}
+		if (a.dedup)
+		{
+			ap.reset(new DedupLogAppender(ap, a.dedup));
+		}
+		return ap;
+	}
 
 	sylar::ConfigVar<std::set<LogDefine>>::ptr g_log_defines =
 		sylar::Config::Lookup("logs", std::set<LogDefine>(), "logs config");
 
+	// 按LogDefine重新配置对应的Logger
+	static void ApplyLogDefine(const LogDefine &define)
+	{
+		sylar::Logger::ptr logger = LOG_NAME(define.name);
+		logger->setLevel(define.level);
+		if (!define.formatter.empty())
+		{
+			logger->setFormatter(define.formatter);
+		}
+
+		logger->clearAppenders();
+		for (auto &a : define.appenders)
+		{
+			logger->addAppender(CreateAppender(define.name, a));
+		}
+	}
+
 	struct LogInitializer
 	{
 		LogInitializer()
 		{
-			g_log_defines->addListener(0xF1E231, [](const std::set<LogDefine> &oldValue,
-													const std::set<LogDefine> &newValue)
-									   {
-										   LOG_INFO(LOG_ROOT) << "logger config changed...";
-										   for (auto &i : newValue)
+			// 只处理新增、修改、删除的Logger, 未变化的Logger不重建
+			g_log_defines->addDiffListener(0xF1E231, [](const ConfigDiff<std::set<LogDefine>> &diff)
 										   {
-											   auto it = oldValue.find(i);
-											   sylar::Logger::ptr logger;
-											   if (it == oldValue.end())
+											   LOG_INFO(LOG_ROOT) << "logger config changed...";
+											   for (auto &i : diff.added)
 											   {
 												   //新增Logger
-												   logger = LOG_NAME(i.name);
-											   }
-											   else
-											   {
-												   if (!(i == *it))
-												   {
-													   // 修改Logger
-													   logger = LOG_NAME(i.name);
-												   }
-												   else
-												   {
-													   continue;
-												   }
-											   }
-											   logger->setLevel(i.level);
-											   if (!i.formatter.empty())
-											   {
-												   logger->setFormatter(i.formatter);
+												   ApplyLogDefine(i);
 											   }
 
-											   logger->clearAppenders();
-											   for (auto &a : i.appenders)
+											   for (auto &i : diff.changed)
 											   {
-												   sylar::LogAppender::ptr ap;
-												   if (a.type == 1)
-												   {
-													   ap.reset(new FileLogAppender(a.file));
-												   }
-												   else if (a.type == 2)
-												   {
-													   ap.reset(new StdoutLogAppender);
-												   }
-												   ap->setLevel(a.level);
-												   if (!a.formatter.empty())
-												   {
-													   LogFormatter::ptr fmt(new LogFormatter(a.formatter));
-													   if (!fmt->isError())
-													   {
-														   ap->setFormatter(fmt);
-													   }
-													   else
-													   {
-														   std::cout << " log.name=" << i.name
-																	 << " appender type=" << a.type
-																	 << " formatter=" << a.formatter
-																	 << " is invalid." << std::endl;
-													   }
-												   }
-												   logger->addAppender(ap);
+												   // 修改Logger
+												   ApplyLogDefine(i.newValue);
 											   }
-										   }
 
-										   for (auto &i : oldValue)
-										   {
-											   auto it = newValue.find(i);
-											   if (it == newValue.end())
+											   for (auto &i : diff.removed)
 											   {
 												   // 删除Logger
 												   auto logger = LOG_NAME(i.name);
 												   logger->setLevel(static_cast<LogLevel::Level>(0));
 												   logger->clearAppenders();
 											   }
-										   }
-									   });
+										   });
 		}
 	};
 
@@ -13,8 +13,14 @@
 #include <chrono>
 #include "../util/util.h"
 #include "../util/singleton.h"
+#include "../thread/thread.h"
+#include "../fiber/fiber.h"
+#include "../timer/timer.h"
 #include <map>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <type_traits>
 
 using std::chrono::system_clock;
 
@@ -24,11 +30,10 @@ using std::chrono::system_clock;
     sylar::LogEventWarpper(sylar::LogEvent::ptr(                                                  \
                                new sylar::LogEvent(logger, level, __FILE__, __LINE__,             \
                                                    0, getThreadId(),                              \
-                                                   0000,                                          \
+                                                   sylar::Fiber::GetFiberId(),                    \
                                                    static_cast<uint64_t>(system_clock::to_time_t( \
                                                        system_clock::now())),                     \
-                                                   std::string("A"))))                            \
-        .getContentStream()
+                                                   sylar::Thread::GetName())))
 
 #define LOG_DEBUG(logger) STREAM_LOG_LEVEL(logger, sylar::LogLevel::Level::DEBUG)
 #define LOG_INFO(logger) STREAM_LOG_LEVEL(logger, sylar::LogLevel::Level::INFO)
@@ -41,10 +46,10 @@ using std::chrono::system_clock;
     if (logger->getLevel() <= level)                                                                    \
     sylar::LogEventWarpper(sylar::LogEvent::ptr(                                                        \
                                new sylar::LogEvent(logger, level, __FILE__, __LINE__, 0, getThreadId(), \
-                                                   0000,                                                \
+                                                   sylar::Fiber::GetFiberId(),                          \
                                                    static_cast<uint64_t>(system_clock::to_time_t(       \
                                                        system_clock::now())),                           \
-                                                   std::string("threadName"))))                         \
+                                                   sylar::Thread::GetName())))                          \
         .getEvent()                                                                                     \
         ->format(fmt, __VA_ARGS__)
 
@@ -57,6 +62,11 @@ using std::chrono::system_clock;
 #define LOG_ROOT sylar::LoggerMgr::GetInstance()->getRoot()
 #define LOG_NAME(name) sylar::LoggerMgr::GetInstance()->getLogger(name)
 
+namespace YAML
+{
+    class Emitter;
+}
+
 namespace sylar
 {
     struct LogLevel
@@ -75,6 +85,77 @@ namespace sylar
         static LogLevel::Level stringToLevel(const std::string &str);
     };
 
+    // 结构化日志字段：按原始类型保存，由格式器负责输出
+    struct LogField
+    {
+        enum Type
+        {
+            INT = 0,
+            UINT = 1,
+            DOUBLE = 2,
+            BOOL = 3,
+            STRING = 4
+        };
+
+        std::string key; // 字段名
+        Type type;       // 字段类型
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            bool b;
+        };
+        std::string str; // STRING类型的值
+    };
+
+    /**
+     * @brief 协程本地的诊断上下文(MDC)
+     * @details 保存在 FiberLocal 中, 协程被调度器迁移到其他线程后上下文跟随协程;
+     *          不在协程中时使用线程主协程的那一份.
+     *          上下文变更时重新渲染为不可变快照, 日志事件创建时只持有快照的引用,
+     *          %X / %X{key} 直接输出快照中预先渲染好的字符串
+     */
+    class MDC
+    {
+    public:
+        // 上下文快照
+        struct Snapshot
+        {
+            using ptr = std::shared_ptr<const Snapshot>;
+
+            std::vector<std::pair<std::string, std::string>> entries; // 键值对(按写入顺序)
+            std::string rendered;                                     // 预渲染结果 "k1=v1 k2=v2"
+
+            const std::string *get(const std::string &key) const;
+        };
+
+        static void Put(const std::string &key, const std::string &value);
+        static void Remove(const std::string &key);
+        static void Clear();
+
+        /**
+         * @brief 获取当前协程的上下文快照, 上下文为空时返回nullptr
+         */
+        static Snapshot::ptr GetSnapshot();
+
+        // 作用域内设置上下文, 析构时恢复原值
+        class Guard
+        {
+        public:
+            Guard(const std::string &key, const std::string &value);
+            ~Guard();
+
+        private:
+            Guard(const Guard &) = delete;
+            Guard &operator=(const Guard &) = delete;
+
+            std::string m_key;
+            std::string m_old_value;
+            bool m_had_old = false;
+        };
+    };
+
     class Logger;
     // 日志事件：将每个日志记录行为视作一个事件，供日志器使用
     class LogEvent
@@ -106,13 +187,47 @@ namespace sylar
         std::uint64_t getTime() const { return m_time; }
         const std::string &getThreadName() const { return m_threadName; }
         std::string getContent() const { return m_content_stream.str(); }
+        // 不复制地取日志内容, 返回起始地址, len为长度; 内容流再次写入后失效
+        const char *getContentData(size_t &len) const;
         std::shared_ptr<Logger> getLogger() const { return m_logger; }
         LogLevel::Level getLevel() const { return m_level; }
         std::stringstream &getContentStream() { return m_content_stream; }
+        const std::vector<LogField> &getFields() const { return m_fields; }
+        const MDC::Snapshot::ptr &getMDC() const { return m_mdc; }
 
         void format(const char *fmt, ...);
         void format(const char *fmt, va_list vl);
 
+        /**
+         * @brief 添加结构化字段(不做字符串转换)
+         * @param[in] key 字段名
+         * @param[in] val 字段值
+         */
+        void addField(const std::string &key, bool val);
+        void addField(const std::string &key, double val);
+        void addField(const std::string &key, const char *val);
+        void addField(const std::string &key, const std::string &val);
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+        addField(const std::string &key, T val)
+        {
+            LogField &f = newField(key, LogField::INT);
+            f.i = static_cast<int64_t>(val);
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value &&
+                                !std::is_same<T, bool>::value>::type
+        addField(const std::string &key, T val)
+        {
+            LogField &f = newField(key, LogField::UINT);
+            f.u = static_cast<uint64_t>(val);
+        }
+
+    private:
+        LogField &newField(const std::string &key, LogField::Type type);
+
     private:
         const char *m_file = nullptr;       // 文件名
         std::int32_t m_line = 0;            // 行号
@@ -122,6 +237,8 @@ namespace sylar
         std::uint64_t m_time = 0;           // 时间戳
         std::string m_threadName;           // 线程名称
         std::stringstream m_content_stream; // 日志内容流
+        std::vector<LogField> m_fields;     // 结构化字段
+        MDC::Snapshot::ptr m_mdc;           // 诊断上下文快照
         std::shared_ptr<Logger> m_logger;   // 日志器
         LogLevel::Level m_level;            // 日志级别
     };
@@ -136,6 +253,30 @@ namespace sylar
         std::stringstream &getContentStream();
         LogEvent::ptr getEvent() const { return m_event; }
 
+        /**
+         * @brief 添加结构化字段, 支持链式调用: LOG_INFO(logger).kv("user", id) << "msg"
+         */
+        template <typename T>
+        LogEventWarpper &kv(const std::string &key, const T &val)
+        {
+            m_event->addField(key, val);
+            return *this;
+        }
+
+        template <typename T>
+        LogEventWarpper &operator<<(const T &val)
+        {
+            m_event->getContentStream() << val;
+            return *this;
+        }
+
+        // std::endl 等流操纵符
+        LogEventWarpper &operator<<(std::ostream &(*manip)(std::ostream &))
+        {
+            m_event->getContentStream() << manip;
+            return *this;
+        }
+
     private:
         LogEvent::ptr m_event;
     };
@@ -162,14 +303,22 @@ namespace sylar
          *  %T 制表符
          *  %C 协程id
          *  %N 线程名称
+         *  %X 诊断上下文(MDC), %X{key} 输出指定键的值
          *
          *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%C%T[%p]%T[%c]%T%f:%l%T%m%n"
          */
         LogFormatter(const std::string &pattern);
+        virtual ~LogFormatter() {}
 
-        std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-        std::ostream &format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level,
-                             LogEvent::ptr event);
+        /**
+         * @brief 根据配置创建格式器
+         * @param[in] pattern 格式模板, "json" 表示 JsonLogFormatter
+         */
+        static LogFormatter::ptr Create(const std::string &pattern);
+
+        virtual std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        virtual std::ostream &format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level,
+                                     LogEvent::ptr event);
         void init();
         bool isError() const { return m_error; }
 
@@ -194,12 +343,35 @@ namespace sylar
 
         const std::string getPattern() const { return m_pattern; }
 
-    private:
+    protected:
         std::string m_pattern;                // 日志格式模板
         std::vector<FormatItem::ptr> m_items; // 日志格式解析后格式
         bool m_error = false;
     };
 
+    /**
+     * @brief JSON格式器
+     * @details 每条日志输出为一行JSON对象, 包含时间、级别、日志器、线程、协程、文件、行号和消息;
+     *          诊断上下文放在 "mdc" 对象中, 通过kv()添加的结构化字段放在 "fields" 对象中, 都不会与固定字段重名;
+     *          字符串转义使用SSE2/AVX2加速.
+     *          配置中 formatter: json 即可选用
+     */
+    class JsonLogFormatter : public LogFormatter
+    {
+    public:
+        using ptr = std::shared_ptr<JsonLogFormatter>;
+
+        JsonLogFormatter();
+
+        std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::ostream &format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level,
+                             LogEvent::ptr event) override;
+
+    private:
+        void formatTo(std::string &buf, std::shared_ptr<Logger> logger, LogLevel::Level level,
+                      LogEvent::ptr event);
+    };
+
     // 日志输出器：设置日志的输出地点
     class LogAppender
     {
@@ -212,13 +384,29 @@ namespace sylar
 
         virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
 
-        virtual std::string toYamlString() = 0;
+        // 序列化为YAML字符串
+        std::string toYamlString();
+
+        // 以映射的形式写入emitter
+        void toYaml(YAML::Emitter &out);
+
+        /**
+         * @brief 写入映射中的各个字段(不含BeginMap/EndMap)
+         * @details 包装其他输出器的输出器可以把被包装者的字段和自己的字段写入同一个映射
+         */
+        virtual void toYamlFields(YAML::Emitter &out) = 0;
 
         void setFormatter(LogFormatter::ptr formatter);
         LogFormatter::ptr getFormatter() const;
         void setLevel(LogLevel::Level level) { m_level = level; }
         LogLevel::Level getLevel() const { return m_level; }
 
+        /**
+         * @brief 继承日志器的格式器(仅在未单独设置格式器时生效)
+         * @param[in] formatter 日志器的格式器
+         */
+        virtual void inheritFormatter(LogFormatter::ptr formatter);
+
     protected:
         LogLevel::Level m_level = LogLevel::DEBUG;
         bool m_has_formatter = false;
@@ -255,6 +443,7 @@ namespace sylar
         LogFormatter::ptr getFormatter() const;
 
         std::string toYamlString();
+        void toYaml(YAML::Emitter &out);
 
     private:
         std::string m_name;                                  // 日志名称
@@ -262,7 +451,7 @@ namespace sylar
         std::list<std::shared_ptr<LogAppender>> m_appenders; // Appender集合
         std::shared_ptr<LogFormatter> m_formatter;           // 日志格式器
         Logger::ptr m_root;                                  // 主日志器
-        mutable std::mutex m_mutex;
+        mutable RWMutex m_mutex;                             // 输出日志只读Appender集合, 加读锁
     };
 
     // 输出到控制台的Appender
@@ -272,25 +461,184 @@ namespace sylar
         using ptr = std::shared_ptr<StdoutLogAppender>;
 
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
-        virtual std::string toYamlString() override;
+        virtual void toYamlFields(YAML::Emitter &out) override;
     };
 
-    // 输出到文件的Appender
+    /**
+     * @brief 输出到文件的Appender
+     * @details 每3秒在全局定时器线程上重新打开一次文件, 文件被移走(日志轮转)后自动重建
+     */
     class FileLogAppender : public LogAppender
     {
     public:
         using ptr = std::shared_ptr<FileLogAppender>;
 
         FileLogAppender(const std::string &filename);
+        ~FileLogAppender();
 
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
-        virtual std::string toYamlString() override;
+        virtual void toYamlFields(YAML::Emitter &out) override;
         bool reopenFile();
 
     private:
         std::string m_filename;     // 文件路径
         std::ofstream m_filestream; // 文件流
-        uint64_t m_last_time = 0;   // 上次重新打开时间
+        TimerManager::ptr m_timer_manager; // 全局定时器, 持有引用保证析构时仍然有效
+        Timer::ptr m_reopen_timer;         // 定期重新打开文件
+    };
+
+    /**
+     * @brief 压缩文件Appender
+     * @details 日志在调用线程格式化后追加到内存缓冲, 由后台线程按块(block_size)压缩写入文件.
+     *          每个块都是一个完整的gzip member, 可以单独解压, 整个文件可直接用 zcat 查看;
+     *          文件被截断时只影响最后一个块. 不足一个块的数据每秒落盘一次, 文件每3秒重新打开一次.
+     *          后台线程跟不上(积压超过8个块)时新的日志被丢弃并计数, 丢弃条数随后写入文件
+     */
+    class CompressedFileLogAppender : public LogAppender
+    {
+    public:
+        using ptr = std::shared_ptr<CompressedFileLogAppender>;
+
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径
+         * @param[in] compressLevel 压缩级别(0-9, -1为zlib默认), 超出范围时截断到该范围
+         * @param[in] blockSize 压缩块大小(字节)
+         */
+        CompressedFileLogAppender(const std::string &filename, int compressLevel = 6,
+                                  size_t blockSize = 64 * 1024);
+        ~CompressedFileLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        virtual void toYamlFields(YAML::Emitter &out) override;
+
+        // 通知后台线程立即压缩写入已缓冲的日志
+        void flush();
+
+        // 通知后台线程在下次写入前重新打开文件
+        void reopenFile();
+
+        // 因积压过多而丢弃的日志条数
+        uint64_t getDropped();
+
+    private:
+        // 后台压缩线程
+        void run();
+        // 在后台线程上压缩并写入一个块
+        void writeBlock(const char *data, size_t size, bool reopen);
+
+    private:
+        std::string m_filename;               // 文件路径
+        int m_compress_level;                 // 压缩级别
+        size_t m_block_size;                  // 压缩块大小
+        std::string m_buffer;                 // 待压缩的日志
+        bool m_stop = false;                  // 停止后台线程
+        bool m_flush = false;                 // 立即落盘
+        bool m_reopen = false;                // 下次写入前重新打开文件
+        uint64_t m_dropped = 0;               // 丢弃的日志条数
+        std::condition_variable m_cond;       // 通知后台线程
+        std::ofstream m_filestream;           // 文件流, 只在后台线程上使用
+        Thread::ptr m_thread;                 // 后台压缩线程
+        TimerManager::ptr m_timer_manager;    // 全局定时器
+        Timer::ptr m_flush_timer;             // 每秒通知落盘
+        Timer::ptr m_reopen_timer;            // 定期重新打开文件
+    };
+
+    /**
+     * @brief 环形缓冲Appender(飞行记录仪模式)
+     * @details 所有级别的日志都不做格式化地缓存到调用线程的thread_local环形缓冲区中(以Appender为键),
+     *          缓冲区保存的是该线程最近capacity条日志; 缓存不加锁, 线程退出时其缓冲区随之释放.
+     *          输出级别(m_level)及以上的日志同时直接转发给下级Appender;
+     *          当出现不低于触发级别的日志时, 先将缓存中低于输出级别的日志按原顺序输出到下级Appender
+     *          (其余的已经输出过), 再输出触发日志本身.
+     *          下级Appender列表写时复制, 转发时只取一次快照
+     */
+    class RingBufferLogAppender : public LogAppender
+    {
+    public:
+        using ptr = std::shared_ptr<RingBufferLogAppender>;
+
+        // 默认输出级别, 低于该级别的日志只在触发时输出
+        static const LogLevel::Level kDefaultLevel = LogLevel::INFO;
+
+        /**
+         * @brief 构造函数
+         * @param[in] capacity 每个线程缓存的日志条数
+         * @param[in] trigger 触发输出缓存的日志级别
+         */
+        RingBufferLogAppender(size_t capacity = 256, LogLevel::Level trigger = LogLevel::ERROR);
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        virtual void toYamlFields(YAML::Emitter &out) override;
+        void inheritFormatter(LogFormatter::ptr formatter) override;
+
+        void addAppender(LogAppender::ptr appender);
+        void clearAppenders();
+        size_t getCapacity() const { return m_capacity; }
+        LogLevel::Level getTrigger() const { return m_trigger; }
+
+    private:
+        using AppenderList = std::vector<LogAppender::ptr>;
+
+        // 取下级Appender列表的快照
+        std::shared_ptr<const AppenderList> getAppenders() const;
+
+    private:
+        size_t m_capacity;                                 // 每个线程的缓存容量
+        LogLevel::Level m_trigger;                         // 触发级别
+        std::shared_ptr<char> m_token;                     // 各线程缓冲区的键, 析构后缓冲区在该线程下次新建缓冲区时清理
+        std::atomic<uint64_t> m_generation{0};             // clearAppenders时递增, 丢弃各线程已缓存的日志
+        std::shared_ptr<const AppenderList> m_appenders;   // 下级Appender, 写时复制
+    };
+
+    /**
+     * @brief 重复日志折叠Appender
+     * @details 放在任意Appender之前, 以调用点(文件+行号)和内容哈希作为指纹, 指纹相同时再逐项比较内容;
+     *          时间窗口内连续出现的相同日志只输出第一条, 窗口结束(由全局定时器触发)或出现不同的日志时
+     *          输出一条 "repeated N times"
+     */
+    class DedupLogAppender : public LogAppender
+    {
+    public:
+        using ptr = std::shared_ptr<DedupLogAppender>;
+
+        /**
+         * @brief 构造函数
+         * @param[in] appender 被包装的Appender
+         * @param[in] window 折叠时间窗口(秒)
+         */
+        DedupLogAppender(LogAppender::ptr appender, uint32_t window);
+        ~DedupLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        virtual void toYamlFields(YAML::Emitter &out) override;
+        void inheritFormatter(LogFormatter::ptr formatter) override;
+
+        LogAppender::ptr getAppender() const { return m_appender; }
+        uint32_t getWindow() const { return m_window; }
+
+    private:
+        /**
+         * @brief 取出本轮被折叠条数的汇总日志并开始计数新的一轮, 持有m_mutex时调用
+         * @param[out] logger 汇总日志的日志器
+         * @return 没有被折叠的日志时返回nullptr
+         */
+        LogEvent::ptr takeRepeated(Logger::ptr &logger);
+
+        // 时间窗口到期, round不是当前轮次时说明已被新的日志结束
+        void onWindowExpired(uint64_t round);
+
+    private:
+        LogAppender::ptr m_appender;                      // 被包装的Appender
+        uint32_t m_window;                                // 折叠时间窗口(秒)
+        uint64_t m_last_hash = 0;          // 上一条日志的指纹
+        uint64_t m_first_time = 0;         // 本轮重复第一条日志的时间
+        uint64_t m_round = 0;              // 轮次, 每出现一条不同的日志加1
+        uint64_t m_repeated = 0;           // 被折叠的条数
+        Logger::ptr m_last_logger;         // 上一条被折叠的日志的日志器
+        LogEvent::ptr m_last_event;        // 上一条日志(比较内容, 生成汇总), 不复制内容
+        TimerManager::ptr m_timer_manager; // 全局定时器
+        Timer::ptr m_window_timer;         // 本轮时间窗口结束时输出折叠条数
     };
 
     class LoggerManager
@@ -305,7 +653,7 @@ namespace sylar
         std::string toYamlString();
 
     private:
-        mutable std::mutex m_mutex;
+        mutable RWSpinlock m_mutex;
         std::map<std::string, Logger::ptr> m_loggers; // 日志容器
         Logger::ptr m_root;                           // 主日志器
     };
@@ -0,0 +1,462 @@
+#ifndef __MUTEX_H__
+#define __MUTEX_H__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdexcept>
+
+namespace sylar
+{
+    // 自旋等待时提示CPU当前处于忙等, 降低功耗并让出超线程的执行资源
+    inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    /**
+     * @brief 自旋退避
+     * @details 每次pause的自旋次数翻倍, 超过上限后改为sched_yield让出CPU
+     */
+    class SpinBackoff
+    {
+    public:
+        void pause()
+        {
+            if (m_count <= kMaxSpin)
+            {
+                for (uint32_t i = 0; i < m_count; ++i)
+                {
+                    CpuRelax();
+                }
+                m_count <<= 1;
+            }
+            else
+            {
+                sched_yield();
+            }
+        }
+
+    private:
+        static const uint32_t kMaxSpin = 64;
+        uint32_t m_count = 1;
+    };
+
+    // 局部锁: 构造时加锁, 析构时解锁
+    template <typename T>
+    class ScopedLockImpl
+    {
+    public:
+        explicit ScopedLockImpl(T &mutex)
+            : m_mutex(mutex)
+        {
+            m_mutex.lock();
+            m_locked = true;
+        }
+
+        ~ScopedLockImpl() { unlock(); }
+
+        void lock()
+        {
+            if (!m_locked)
+            {
+                m_mutex.lock();
+                m_locked = true;
+            }
+        }
+
+        void unlock()
+        {
+            if (m_locked)
+            {
+                m_mutex.unlock();
+                m_locked = false;
+            }
+        }
+
+    private:
+        ScopedLockImpl(const ScopedLockImpl &) = delete;
+        ScopedLockImpl &operator=(const ScopedLockImpl &) = delete;
+
+        T &m_mutex;
+        bool m_locked;
+    };
+
+    // 局部读锁
+    template <typename T>
+    class ReadScopedLockImpl
+    {
+    public:
+        explicit ReadScopedLockImpl(T &mutex)
+            : m_mutex(mutex)
+        {
+            m_mutex.rdlock();
+            m_locked = true;
+        }
+
+        ~ReadScopedLockImpl() { unlock(); }
+
+        void lock()
+        {
+            if (!m_locked)
+            {
+                m_mutex.rdlock();
+                m_locked = true;
+            }
+        }
+
+        void unlock()
+        {
+            if (m_locked)
+            {
+                m_mutex.unlock();
+                m_locked = false;
+            }
+        }
+
+    private:
+        ReadScopedLockImpl(const ReadScopedLockImpl &) = delete;
+        ReadScopedLockImpl &operator=(const ReadScopedLockImpl &) = delete;
+
+        T &m_mutex;
+        bool m_locked;
+    };
+
+    // 局部写锁
+    template <typename T>
+    class WriteScopedLockImpl
+    {
+    public:
+        explicit WriteScopedLockImpl(T &mutex)
+            : m_mutex(mutex)
+        {
+            m_mutex.wrlock();
+            m_locked = true;
+        }
+
+        ~WriteScopedLockImpl() { unlock(); }
+
+        void lock()
+        {
+            if (!m_locked)
+            {
+                m_mutex.wrlock();
+                m_locked = true;
+            }
+        }
+
+        void unlock()
+        {
+            if (m_locked)
+            {
+                m_mutex.unlock();
+                m_locked = false;
+            }
+        }
+
+    private:
+        WriteScopedLockImpl(const WriteScopedLockImpl &) = delete;
+        WriteScopedLockImpl &operator=(const WriteScopedLockImpl &) = delete;
+
+        T &m_mutex;
+        bool m_locked;
+    };
+
+    // 信号量
+    class Semaphore
+    {
+    public:
+        explicit Semaphore(uint32_t count = 0)
+        {
+            if (sem_init(&m_semaphore, 0, count))
+            {
+                throw std::logic_error("sem_init error");
+            }
+        }
+
+        ~Semaphore() { sem_destroy(&m_semaphore); }
+
+        // 计数为0时阻塞, 被信号中断时继续等待
+        void wait()
+        {
+            while (sem_wait(&m_semaphore) && errno == EINTR)
+            {
+            }
+        }
+
+        void notify() { sem_post(&m_semaphore); }
+
+    private:
+        Semaphore(const Semaphore &) = delete;
+        Semaphore &operator=(const Semaphore &) = delete;
+
+        sem_t m_semaphore;
+    };
+
+    // 互斥量(pthread_mutex)
+    class Mutex
+    {
+    public:
+        using Lock = ScopedLockImpl<Mutex>;
+
+        Mutex() { pthread_mutex_init(&m_mutex, nullptr); }
+        ~Mutex() { pthread_mutex_destroy(&m_mutex); }
+
+        void lock() { pthread_mutex_lock(&m_mutex); }
+        void unlock() { pthread_mutex_unlock(&m_mutex); }
+
+    private:
+        Mutex(const Mutex &) = delete;
+        Mutex &operator=(const Mutex &) = delete;
+
+        pthread_mutex_t m_mutex;
+    };
+
+    // 读写锁(pthread_rwlock), 适合读多写少且临界区较长(可能阻塞)的场景
+    class RWMutex
+    {
+    public:
+        using ReadLock = ReadScopedLockImpl<RWMutex>;
+        using WriteLock = WriteScopedLockImpl<RWMutex>;
+
+        RWMutex() { pthread_rwlock_init(&m_lock, nullptr); }
+        ~RWMutex() { pthread_rwlock_destroy(&m_lock); }
+
+        void rdlock() { pthread_rwlock_rdlock(&m_lock); }
+        void wrlock() { pthread_rwlock_wrlock(&m_lock); }
+        void unlock() { pthread_rwlock_unlock(&m_lock); }
+
+    private:
+        RWMutex(const RWMutex &) = delete;
+        RWMutex &operator=(const RWMutex &) = delete;
+
+        pthread_rwlock_t m_lock;
+    };
+
+    /**
+     * @brief 自旋锁(test-and-test-and-set + 指数退避)
+     * @details 只适合临界区很短且不会阻塞的场景; 不可重入
+     */
+    class Spinlock
+    {
+    public:
+        using Lock = ScopedLockImpl<Spinlock>;
+
+        Spinlock() : m_locked(false) {}
+
+        void lock()
+        {
+            SpinBackoff backoff;
+            while (m_locked.exchange(true, std::memory_order_acquire))
+            {
+                // 只读等待, 不反复写缓存行
+                while (m_locked.load(std::memory_order_relaxed))
+                {
+                    backoff.pause();
+                }
+            }
+        }
+
+        bool tryLock()
+        {
+            return !m_locked.load(std::memory_order_relaxed) &&
+                   !m_locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock() { m_locked.store(false, std::memory_order_release); }
+
+    private:
+        Spinlock(const Spinlock &) = delete;
+        Spinlock &operator=(const Spinlock &) = delete;
+
+        std::atomic<bool> m_locked;
+    };
+
+    /**
+     * @brief 读写自旋锁, 写优先
+     * @details 有写者等待时新的读者不再进入, 避免写者饿死; 因此持有读锁时不能再次加读锁.
+     *          只适合临界区很短且不会阻塞的读多写少场景
+     */
+    class RWSpinlock
+    {
+    public:
+        using ReadLock = ReadScopedLockImpl<RWSpinlock>;
+        using WriteLock = WriteScopedLockImpl<RWSpinlock>;
+
+        RWSpinlock() : m_state(0) {}
+
+        void rdlock()
+        {
+            SpinBackoff backoff;
+            while (true)
+            {
+                uint32_t state = m_state.load(std::memory_order_relaxed);
+                if (!(state & (kWriter | kWaiting)) &&
+                    m_state.compare_exchange_weak(state, state + kReader,
+                                                  std::memory_order_acquire, std::memory_order_relaxed))
+                {
+                    return;
+                }
+                backoff.pause();
+            }
+        }
+
+        void wrlock()
+        {
+            SpinBackoff backoff;
+            while (true)
+            {
+                uint32_t state = m_state.load(std::memory_order_relaxed);
+                if ((state & ~kWaiting) == 0)
+                {
+                    if (m_state.compare_exchange_weak(state, kWriter,
+                                                      std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                }
+                else if (!(state & kWaiting))
+                {
+                    m_state.fetch_or(kWaiting, std::memory_order_relaxed);
+                }
+                backoff.pause();
+            }
+        }
+
+        // 读者持有时写标记一定为0, 写者持有时读者计数一定为0
+        void unlock()
+        {
+            if (m_state.load(std::memory_order_relaxed) & kWriter)
+            {
+                m_state.fetch_and(~kWriter, std::memory_order_release);
+            }
+            else
+            {
+                m_state.fetch_sub(kReader, std::memory_order_release);
+            }
+        }
+
+    private:
+        RWSpinlock(const RWSpinlock &) = delete;
+        RWSpinlock &operator=(const RWSpinlock &) = delete;
+
+        static const uint32_t kWriter = 1;  // 写者持有
+        static const uint32_t kWaiting = 2; // 有写者等待
+        static const uint32_t kReader = 4;  // 读者计数单位
+
+        std::atomic<uint32_t> m_state;
+    };
+
+    /**
+     * @brief 顺序锁
+     * @details 写者之间用自旋锁互斥, 写入前后各递增一次序号(奇数表示正在写);
+     *          读者不加锁, 读取前后序号不同则重试. 适合读远多于写、数据很小的场景
+     *          do { seq = lock.readBegin(); ...读取... } while (lock.readRetry(seq));
+     *          被保护的数据需要以原子方式读写, 可直接使用 SeqLockValue
+     */
+    class SeqLock
+    {
+    public:
+        using WriteLock = WriteScopedLockImpl<SeqLock>;
+
+        SeqLock() : m_seq(0) {}
+
+        uint32_t readBegin() const
+        {
+            SpinBackoff backoff;
+            uint32_t seq;
+            while ((seq = m_seq.load(std::memory_order_acquire)) & 1)
+            {
+                backoff.pause();
+            }
+            return seq;
+        }
+
+        bool readRetry(uint32_t seq) const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return m_seq.load(std::memory_order_relaxed) != seq;
+        }
+
+        void wrlock()
+        {
+            m_lock.lock();
+            m_seq.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void unlock()
+        {
+            m_seq.fetch_add(1, std::memory_order_release);
+            m_lock.unlock();
+        }
+
+    private:
+        SeqLock(const SeqLock &) = delete;
+        SeqLock &operator=(const SeqLock &) = delete;
+
+        std::atomic<uint32_t> m_seq;
+        Spinlock m_lock;
+    };
+
+    /**
+     * @brief 顺序锁保护的值, T需要可平凡拷贝
+     * @details 值按机器字拆分为原子变量读写, 读者之间以及读写之间都没有数据竞争;
+     *          读取不加锁、不分配内存, 写入时只与其他写者互斥
+     */
+    template <typename T>
+    class SeqLockValue
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SeqLockValue requires a trivially copyable type");
+
+    public:
+        explicit SeqLockValue(const T &val = T()) { store(val); }
+
+        T load() const
+        {
+            uint64_t buf[kWords];
+            uint32_t seq;
+            do
+            {
+                seq = m_lock.readBegin();
+                for (size_t i = 0; i < kWords; ++i)
+                {
+                    buf[i] = m_words[i].load(std::memory_order_relaxed);
+                }
+            } while (m_lock.readRetry(seq));
+
+            T val;
+            memcpy(&val, buf, sizeof(T));
+            return val;
+        }
+
+        void store(const T &val)
+        {
+            uint64_t buf[kWords] = {0};
+            memcpy(buf, &val, sizeof(T));
+
+            SeqLock::WriteLock lock(m_lock);
+            for (size_t i = 0; i < kWords; ++i)
+            {
+                m_words[i].store(buf[i], std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        SeqLock m_lock;
+        std::atomic<uint64_t> m_words[kWords];
+    };
+}
+
+#endif // __MUTEX_H__
@@ -0,0 +1,189 @@
+#include "thread.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <sched.h>
+
+namespace sylar
+{
+    static thread_local Thread *t_thread = nullptr;
+    static thread_local std::string t_thread_name;
+
+    Thread *Thread::GetThis()
+    {
+        return t_thread;
+    }
+
+    const std::string &Thread::GetName()
+    {
+        if (t_thread_name.empty())
+        {
+            // 主线程和其他方式创建的线程, 第一次使用时从内核取一次
+            char name[16] = {0};
+            if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && name[0])
+            {
+                t_thread_name = name;
+            }
+            else
+            {
+                t_thread_name = "UNKNOWN";
+            }
+        }
+        return t_thread_name;
+    }
+
+    void Thread::SetName(const std::string &name)
+    {
+        if (name.empty())
+        {
+            return;
+        }
+        t_thread_name = name;
+        // 内核限制线程名最长15个字符
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    }
+
+    std::vector<int> Thread::GetNumaNodeCpus(int node)
+    {
+        std::vector<int> cpus;
+        std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (node < 0 || !std::getline(ifs, list))
+        {
+            return cpus;
+        }
+
+        // 格式如 "0-3,8-11"
+        std::stringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            int first = 0;
+            int last = 0;
+            int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (n == 1)
+            {
+                last = first;
+            }
+            else if (n != 2)
+            {
+                continue;
+            }
+            for (int i = first; i <= last; ++i)
+            {
+                cpus.push_back(i);
+            }
+        }
+        return cpus;
+    }
+
+    bool Thread::SetAffinity(const ThreadAffinity &affinity)
+    {
+        if (affinity.empty())
+        {
+            return true;
+        }
+
+        std::vector<int> cpus = affinity.cpus;
+        if (affinity.numaNode >= 0)
+        {
+            std::vector<int> nodeCpus = GetNumaNodeCpus(affinity.numaNode);
+            if (cpus.empty())
+            {
+                cpus.swap(nodeCpus);
+            }
+            else
+            {
+                std::vector<int> both;
+                for (int cpu : cpus)
+                {
+                    if (std::find(nodeCpus.begin(), nodeCpus.end(), cpu) != nodeCpus.end())
+                    {
+                        both.push_back(cpu);
+                    }
+                }
+                cpus.swap(both);
+            }
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (CPU_COUNT(&set) == 0)
+        {
+            LOG_ERROR(LOG_ROOT) << "Thread::SetAffinity no cpu matches, numa node = " << affinity.numaNode
+                                << " cpus = " << affinity.cpus.size();
+            return false;
+        }
+
+        int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rt)
+        {
+            LOG_ERROR(LOG_ROOT) << "Thread::SetAffinity pthread_setaffinity_np error, rt = " << rt
+                                << " " << strerror(rt);
+            return false;
+        }
+        return true;
+    }
+
+    Thread::Thread(std::function<void()> cb, const std::string &name, const ThreadAffinity &affinity)
+        : m_cb(cb), m_name(name.empty() ? "UNKNOWN" : name), m_affinity(affinity)
+    {
+        int rt = pthread_create(&m_thread, nullptr, &Thread::run, this);
+        if (rt)
+        {
+            LOG_ERROR(LOG_ROOT) << "pthread_create thread fail, rt = " << rt << " name = " << m_name;
+            throw std::logic_error("pthread_create error");
+        }
+        m_semaphore.wait();
+    }
+
+    Thread::~Thread()
+    {
+        if (m_thread)
+        {
+            pthread_detach(m_thread);
+        }
+    }
+
+    void Thread::join()
+    {
+        if (m_thread)
+        {
+            int rt = pthread_join(m_thread, nullptr);
+            if (rt)
+            {
+                LOG_ERROR(LOG_ROOT) << "pthread_join thread fail, rt = " << rt << " name = " << m_name;
+                throw std::logic_error("pthread_join error");
+            }
+            m_thread = 0;
+        }
+    }
+
+    void *Thread::run(void *arg)
+    {
+        Thread *thread = static_cast<Thread *>(arg);
+        t_thread = thread;
+        thread->m_id = getThreadId();
+        SetName(thread->m_name);
+        SetAffinity(thread->m_affinity);
+
+        std::function<void()> cb;
+        cb.swap(thread->m_cb);
+
+        thread->m_semaphore.notify();
+
+        cb();
+        return 0;
+    }
+}
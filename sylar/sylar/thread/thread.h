@@ -0,0 +1,87 @@
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include "mutex.h"
+
+namespace sylar
+{
+    /**
+     * @brief 线程绑核设置
+     * @details cpus 与 numaNode 都为空时不做限制; 同时设置时取两者的交集.
+     *          绑定NUMA节点只限制线程运行的CPU, 线程首次写入的内存由内核就近分配在该节点上
+     */
+    struct ThreadAffinity
+    {
+        std::vector<int> cpus; // 允许运行的CPU编号
+        int numaNode = -1;     // 允许运行的NUMA节点, -1表示不限制
+
+        bool empty() const { return cpus.empty() && numaNode < 0; }
+    };
+
+    /**
+     * @brief 线程
+     * @details 线程名称同时设置到内核(pthread_setname_np, 截断为15个字符, 可在top/gdb中看到)
+     *          和日志(%N); 构造函数等待新线程完成命名和绑核后才返回, 返回时 getId 已有效
+     */
+    class Thread
+    {
+    public:
+        using ptr = std::shared_ptr<Thread>;
+
+        /**
+         * @brief 创建并启动线程
+         * @param[in] cb 线程执行的函数
+         * @param[in] name 线程名称
+         * @param[in] affinity 绑核设置, 绑核失败只记录日志, 线程照常运行
+         */
+        Thread(std::function<void()> cb, const std::string &name,
+               const ThreadAffinity &affinity = ThreadAffinity());
+        // 未join的线程会被detach
+        ~Thread();
+
+        pid_t getId() const { return m_id; }
+        const std::string &getName() const { return m_name; }
+
+        void join();
+
+        // 当前线程对应的Thread, 不是由Thread创建的线程返回nullptr
+        static Thread *GetThis();
+
+        // 当前线程的名称, 不是由Thread创建的线程取内核中的线程名
+        static const std::string &GetName();
+
+        // 设置当前线程的名称
+        static void SetName(const std::string &name);
+
+        /**
+         * @brief 设置当前线程的绑核
+         * @return 设置成功, 或affinity为空时返回true
+         */
+        static bool SetAffinity(const ThreadAffinity &affinity);
+
+        // NUMA节点包含的CPU编号, 节点不存在时返回空
+        static std::vector<int> GetNumaNodeCpus(int node);
+
+    private:
+        Thread(const Thread &) = delete;
+        Thread &operator=(const Thread &) = delete;
+
+        static void *run(void *arg);
+
+    private:
+        pid_t m_id = -1;
+        pthread_t m_thread = 0;
+        std::function<void()> m_cb;
+        std::string m_name;
+        ThreadAffinity m_affinity;
+        Semaphore m_semaphore; // 新线程完成初始化后通知构造函数返回
+    };
+}
+
+#endif // __THREAD_H__
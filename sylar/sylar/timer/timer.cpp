@@ -0,0 +1,450 @@
+#include "timer.h"
+#include "../log/log.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+namespace sylar
+{
+    static const uint64_t kNearBits = 8;
+    static const uint64_t kFarBits = 6;
+    static const uint64_t kNearMask = (1ULL << kNearBits) - 1;
+    static const uint64_t kFarMask = (1ULL << kFarBits) - 1;
+    // 第1~3级槽位对应的tick位移
+    static const uint64_t kFarShift[3] = {kNearBits, kNearBits + kFarBits, kNearBits + 2 * kFarBits};
+    // 时间轮能直接放下的最大间隔
+    static const uint64_t kMaxDelta = 1ULL << (kNearBits + 3 * kFarBits);
+    static const uint64_t kNoTick = ~0ULL;
+
+    // 当前线程是哪个管理器的定时器线程
+    static thread_local TimerManager *t_timer_manager = nullptr;
+
+    Timer::Timer(TimerManager *manager, uint64_t ms, std::function<void()> cb, bool recurring)
+        : m_manager(manager), m_ms(ms), m_recurring(recurring), m_cb(std::move(cb))
+    {
+    }
+
+    bool Timer::cancel()
+    {
+        return m_manager->cancel(this);
+    }
+
+    bool Timer::refresh()
+    {
+        return m_manager->reset(this, m_ms, true);
+    }
+
+    bool Timer::reset(uint64_t ms, bool fromNow)
+    {
+        return m_manager->reset(this, ms, fromNow);
+    }
+
+    TimerManager::TimerManager(uint32_t tickMs, const std::string &name)
+        : m_tick_ms(tickMs ? tickMs : 1), m_start_time(std::chrono::steady_clock::now())
+    {
+        memset(m_near, 0, sizeof(m_near));
+        memset(m_far, 0, sizeof(m_far));
+        m_thread.reset(new Thread(std::bind(&TimerManager::run, this), name));
+    }
+
+    TimerManager::~TimerManager()
+    {
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            m_stopping = true;
+        }
+        m_cond.notify_one();
+        if (t_timer_manager == this)
+        {
+            // 最后一个引用在自己的回调中释放, 无法等待定时器线程退出
+            LOG_ERROR(LOG_ROOT) << "TimerManager destroyed on its own timer thread";
+            abort();
+        }
+        m_thread->join();
+
+        // 定时器的回调可能持有任意对象, 在锁外释放
+        std::vector<Timer::ptr> timers;
+        {
+            std::lock_guard<std::mutex> lockGuard(m_mutex);
+            for (Timer **slot : {&m_near[0], &m_far[0][0], &m_far[1][0], &m_far[2][0]})
+            {
+                size_t n = slot == &m_near[0] ? 256 : 64;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    while (slot[i])
+                    {
+                        Timer *timer = slot[i];
+                        unlink(timer);
+                        timer->m_cancelled = true;
+                        timers.push_back(std::move(timer->m_self));
+                    }
+                }
+            }
+        }
+    }
+
+    Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
+    {
+        Timer::ptr timer(new Timer(this, ms, std::move(cb), recurring));
+        std::lock_guard<std::mutex> lockGuard(m_mutex);
+        arm(timer.get(), nowTick(true));
+        return timer;
+    }
+
+    Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond,
+                                               bool recurring)
+    {
+        Timer::ptr timer(new Timer(this, ms, std::move(cb), recurring));
+        timer->m_cond = std::move(cond);
+        timer->m_has_cond = true;
+        std::lock_guard<std::mutex> lockGuard(m_mutex);
+        arm(timer.get(), nowTick(true));
+        return timer;
+    }
+
+    uint64_t TimerManager::getNextTimer()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_mutex);
+        uint64_t next = nextTick();
+        if (next == kNoTick)
+        {
+            return ~0ULL;
+        }
+        uint64_t now = nowTick();
+        return next > now ? (next - now) * m_tick_ms : 0;
+    }
+
+    bool TimerManager::hasTimer()
+    {
+        std::lock_guard<std::mutex> lockGuard(m_mutex);
+        return m_count > 0;
+    }
+
+    uint64_t TimerManager::nowTick(bool roundUp) const
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start_time);
+        uint64_t tickNs = m_tick_ms * 1000000ULL;
+        return (static_cast<uint64_t>(ns.count()) + (roundUp ? tickNs - 1 : 0)) / tickNs;
+    }
+
+    uint64_t TimerManager::toTicks(uint64_t ms) const
+    {
+        return std::max<uint64_t>(1, (ms + m_tick_ms - 1) / m_tick_ms);
+    }
+
+    void TimerManager::arm(Timer *timer, uint64_t start)
+    {
+        timer->m_start = start;
+        timer->m_expire = start + toTicks(timer->m_ms);
+        link(timer);
+        if (!timer->m_self)
+        {
+            timer->m_self = timer->shared_from_this();
+        }
+        // 比定时器线程当前等待的时刻更早到期, 唤醒它重新计算
+        if (timer->m_expire < m_wait_tick)
+        {
+            m_cond.notify_one();
+        }
+    }
+
+    void TimerManager::link(Timer *timer)
+    {
+        // 当前tick已经处理过, 最早在下一个tick到期
+        uint64_t expire = std::max(timer->m_expire, m_current_tick + 1);
+        timer->m_expire = expire;
+        uint64_t delta = expire - m_current_tick;
+
+        Timer **slot;
+        if (delta <= kNearMask)
+        {
+            slot = &m_near[expire & kNearMask];
+        }
+        else if (delta < (1ULL << kFarShift[1]))
+        {
+            slot = &m_far[0][(expire >> kFarShift[0]) & kFarMask];
+        }
+        else if (delta < (1ULL << kFarShift[2]))
+        {
+            slot = &m_far[1][(expire >> kFarShift[1]) & kFarMask];
+        }
+        else
+        {
+            // 超出范围的放在最远的槽位, 下移时再按实际到期时间放置
+            uint64_t place = delta < kMaxDelta ? expire : m_current_tick + kMaxDelta - 1;
+            slot = &m_far[2][(place >> kFarShift[2]) & kFarMask];
+        }
+        linkTo(timer, slot);
+    }
+
+    void TimerManager::linkTo(Timer *timer, Timer **slot)
+    {
+        if (slot >= m_near && slot < m_near + 256)
+        {
+            ++m_near_count;
+        }
+        timer->m_prev = nullptr;
+        timer->m_next = *slot;
+        if (*slot)
+        {
+            (*slot)->m_prev = timer;
+        }
+        *slot = timer;
+        timer->m_slot = slot;
+        ++m_count;
+    }
+
+    void TimerManager::unlink(Timer *timer)
+    {
+        if (timer->m_prev)
+        {
+            timer->m_prev->m_next = timer->m_next;
+        }
+        else
+        {
+            *timer->m_slot = timer->m_next;
+        }
+        if (timer->m_next)
+        {
+            timer->m_next->m_prev = timer->m_prev;
+        }
+        if (timer->m_slot >= m_near && timer->m_slot < m_near + 256)
+        {
+            --m_near_count;
+        }
+        --m_count;
+        timer->m_prev = timer->m_next = nullptr;
+        timer->m_slot = nullptr;
+    }
+
+    void TimerManager::cascade(Timer **slot)
+    {
+        // 下移后一定落在更低的级别(或超出范围的仍在最高级的其他槽位), 不会回到本槽位.
+        // 下移发生在处理当前tick之前, 恰好在当前tick(槽位起点)到期的放入当前tick的槽位,
+        // 不能经过 link 推迟到下一个tick
+        while (*slot)
+        {
+            Timer *timer = *slot;
+            unlink(timer);
+            if (timer->m_expire <= m_current_tick)
+            {
+                linkTo(timer, &m_near[m_current_tick & kNearMask]);
+            }
+            else
+            {
+                link(timer);
+            }
+        }
+    }
+
+    void TimerManager::advance(uint64_t target, std::vector<Timer::ptr> &expired)
+    {
+        while (m_current_tick < target)
+        {
+            if (m_near_count == 0)
+            {
+                // 第0级为空, 直接跳到下一次下移之前
+                uint64_t last = m_current_tick | kNearMask;
+                if (m_count == 0 || last >= target)
+                {
+                    m_current_tick = target;
+                    break;
+                }
+                m_current_tick = last;
+            }
+
+            uint64_t tick = ++m_current_tick;
+            if ((tick & kNearMask) == 0)
+            {
+                // 从高到低下移, 高级别下移的定时器不会落入随后要下移的槽位
+                if ((tick & ((1ULL << kFarShift[1]) - 1)) == 0)
+                {
+                    if ((tick & ((1ULL << kFarShift[2]) - 1)) == 0)
+                    {
+                        cascade(&m_far[2][(tick >> kFarShift[2]) & kFarMask]);
+                    }
+                    cascade(&m_far[1][(tick >> kFarShift[1]) & kFarMask]);
+                }
+                cascade(&m_far[0][(tick >> kFarShift[0]) & kFarMask]);
+            }
+
+            Timer **slot = &m_near[tick & kNearMask];
+            while (*slot)
+            {
+                Timer *timer = *slot;
+                unlink(timer);
+                timer->m_pending = true;
+                expired.push_back(std::move(timer->m_self));
+            }
+        }
+    }
+
+    uint64_t TimerManager::nextTick() const
+    {
+        if (m_count == 0)
+        {
+            return kNoTick;
+        }
+
+        uint64_t next = kNoTick;
+        if (m_near_count > 0)
+        {
+            for (uint64_t tick = m_current_tick + 1; tick <= m_current_tick + kNearMask; ++tick)
+            {
+                if (m_near[tick & kNearMask])
+                {
+                    next = tick;
+                    break;
+                }
+            }
+        }
+        // 高级别的非空槽位需要在其起点下移
+        for (int level = 0; level < 3; ++level)
+        {
+            uint64_t shift = kFarShift[level];
+            for (uint64_t i = 1; i <= kFarMask + 1; ++i)
+            {
+                uint64_t tick = ((m_current_tick >> shift) + i) << shift;
+                if (tick >= next)
+                {
+                    break;
+                }
+                if (m_far[level][(tick >> shift) & kFarMask])
+                {
+                    next = tick;
+                    break;
+                }
+            }
+        }
+        return next;
+    }
+
+    bool TimerManager::cancel(Timer *timer)
+    {
+        Timer::ptr self;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (timer->m_cancelled)
+        {
+            return false;
+        }
+        timer->m_cancelled = true;
+        timer->m_pending = false;
+        if (timer->m_slot)
+        {
+            unlink(timer);
+        }
+        self = std::move(timer->m_self);
+        if (t_timer_manager != this)
+        {
+            m_run_cond.wait(lock, [this, timer]()
+                            { return m_running != timer; });
+        }
+        return true;
+    }
+
+    bool TimerManager::reset(Timer *timer, uint64_t ms, bool fromNow)
+    {
+        std::lock_guard<std::mutex> lockGuard(m_mutex);
+        if (timer->m_cancelled || (!timer->m_slot && !timer->m_pending && m_running != timer))
+        {
+            return false;
+        }
+        if (timer->m_slot)
+        {
+            unlink(timer);
+        }
+        timer->m_pending = false;
+        timer->m_ms = ms;
+        arm(timer, fromNow ? nowTick(true) : timer->m_start);
+        return true;
+    }
+
+    void TimerManager::run()
+    {
+        t_timer_manager = this;
+        std::vector<Timer::ptr> expired;
+        std::vector<Timer::ptr> released;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopping)
+        {
+            advance(nowTick(), expired);
+            if (expired.empty())
+            {
+                uint64_t next = nextTick();
+                m_wait_tick = next;
+                if (next == kNoTick)
+                {
+                    m_cond.wait(lock);
+                }
+                else
+                {
+                    m_cond.wait_until(lock, m_start_time + std::chrono::milliseconds(next * m_tick_ms));
+                }
+                m_wait_tick = 0;
+                continue;
+            }
+
+            for (auto &timer : expired)
+            {
+                // 收集之后被取消或重新计时
+                if (!timer->m_pending)
+                {
+                    continue;
+                }
+                timer->m_pending = false;
+                m_running = timer.get();
+                lock.unlock();
+
+                bool alive = true;
+                {
+                    std::shared_ptr<void> cond;
+                    if (timer->m_has_cond)
+                    {
+                        cond = timer->m_cond.lock();
+                        alive = !!cond;
+                    }
+                    if (alive)
+                    {
+                        try
+                        {
+                            timer->m_cb();
+                        }
+                        catch (std::exception &e)
+                        {
+                            LOG_ERROR(LOG_ROOT) << "Timer callback except: " << e.what();
+                        }
+                        catch (...)
+                        {
+                            LOG_ERROR(LOG_ROOT) << "Timer callback except";
+                        }
+                    }
+                }
+
+                lock.lock();
+                m_running = nullptr;
+                m_run_cond.notify_all();
+                if (timer->m_cancelled || timer->m_slot)
+                {
+                    // 回调中被取消或重新计时
+                    continue;
+                }
+                if (!alive)
+                {
+                    timer->m_cancelled = true;
+                }
+                else if (timer->m_recurring)
+                {
+                    // 从上次到期时间接着算, 落后太多时由link推到下一个tick
+                    arm(timer.get(), timer->m_expire);
+                }
+            }
+
+            // 定时器和回调持有的对象在锁外释放
+            released.swap(expired);
+            lock.unlock();
+            released.clear();
+            lock.lock();
+        }
+        t_timer_manager = nullptr;
+    }
+}
@@ -0,0 +1,164 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../thread/thread.h"
+#include "../util/singleton.h"
+
+namespace sylar
+{
+    class TimerManager;
+
+    /**
+     * @brief 定时器
+     * @details 由 TimerManager::addTimer 创建, 到期后回调在管理器的定时器线程上执行.
+     *          定时器的操作都经过创建它的管理器, 管理器需要比这些操作活得更久
+     */
+    class Timer : public std::enable_shared_from_this<Timer>
+    {
+        friend class TimerManager;
+
+    public:
+        using ptr = std::shared_ptr<Timer>;
+
+        /**
+         * @brief 取消定时器
+         * @details 回调正在定时器线程上执行时等待其结束, 返回后回调不会再被执行;
+         *          因此不要在持有回调中也会获取的锁时调用, 否则会死锁. 在回调中取消自身不会等待
+         * @return 已经取消过返回false
+         */
+        bool cancel();
+
+        // 从现在起重新计时, 已取消或已执行完(非循环)返回false
+        bool refresh();
+
+        /**
+         * @brief 修改周期
+         * @param[in] ms 新的周期(毫秒)
+         * @param[in] fromNow true从现在起计时, false从本次计时的起点算起
+         * @return 已取消或已执行完(非循环)返回false
+         */
+        bool reset(uint64_t ms, bool fromNow);
+
+        uint64_t getMs() const { return m_ms; }
+        bool isRecurring() const { return m_recurring; }
+
+    private:
+        Timer(TimerManager *manager, uint64_t ms, std::function<void()> cb, bool recurring);
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+    private:
+        TimerManager *m_manager;
+        uint64_t m_ms;              // 周期(毫秒)
+        bool m_recurring;           // 是否循环
+        std::function<void()> m_cb; // 回调, 创建后不再修改
+        std::weak_ptr<void> m_cond; // 条件对象, 销毁后定时器自动取消
+        bool m_has_cond = false;
+        uint64_t m_start = 0;       // 本次计时的起点(tick)
+        uint64_t m_expire = 0;      // 到期时间(tick)
+        Timer *m_prev = nullptr;    // 所在槽位的双向链表
+        Timer *m_next = nullptr;
+        Timer **m_slot = nullptr;   // 所在槽位, 不在时间轮中为nullptr
+        bool m_pending = false;     // 已到期等待执行
+        bool m_cancelled = false;
+        Timer::ptr m_self;          // 在时间轮中时由自身持有引用
+    };
+
+    /**
+     * @brief 定时器管理器(分层时间轮)
+     * @details 第0级256个槽, 每槽1个tick; 其上3级各64个槽, 每槽是下一级转一圈的时间, 以1ms的tick约可覆盖18.6小时,
+     *          更远的定时器放在最高级最远的槽中, 下移时重新放置. 添加和取消都是O(1): 挂到/摘下槽位链表;
+     *          时间走到上一级某槽的起点时, 把槽中的定时器下移(cascade)到更低的级别.
+     *          后台线程睡眠到下一个非空槽位(或下一次需要下移的时刻), 到期回调依次在该线程上执行,
+     *          耗时的工作应在回调中转交给 Scheduler. 不能在自己的回调中析构管理器
+     */
+    class TimerManager
+    {
+        friend class Timer;
+
+    public:
+        using ptr = std::shared_ptr<TimerManager>;
+
+        /**
+         * @brief 构造函数, 启动定时器线程
+         * @param[in] tickMs 时间轮的精度(毫秒)
+         * @param[in] name 定时器线程名称
+         */
+        TimerManager(uint32_t tickMs = 1, const std::string &name = "timer");
+        ~TimerManager();
+
+        /**
+         * @brief 添加定时器
+         * @param[in] ms 超时时间(毫秒), 按tick向上取整
+         * @param[in] cb 回调
+         * @param[in] recurring 是否循环, 循环定时器按到期时间(而不是回调结束时间)计算下一次, 不会累积漂移
+         */
+        Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+
+        /**
+         * @brief 添加条件定时器
+         * @details 执行回调前先锁定cond, 执行期间cond不会被销毁; cond已销毁时不执行回调并自动取消
+         */
+        Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> cond,
+                                     bool recurring = false);
+
+        // 距下一次需要处理的时间(毫秒), 没有定时器返回~0ull
+        uint64_t getNextTimer();
+
+        bool hasTimer();
+
+        uint32_t getTickMs() const { return m_tick_ms; }
+
+    private:
+        TimerManager(const TimerManager &) = delete;
+        TimerManager &operator=(const TimerManager &) = delete;
+
+        void run();
+
+        // 当前tick, roundUp为true时向上取整, 用作新定时器的起点保证不会提前到期
+        uint64_t nowTick(bool roundUp = false) const;
+        uint64_t toTicks(uint64_t ms) const;
+
+        // 以下函数在持有m_mutex时调用
+        void arm(Timer *timer, uint64_t start);
+        void link(Timer *timer);
+        void linkTo(Timer *timer, Timer **slot); // 挂到指定槽位的链表头
+        void unlink(Timer *timer);
+        void cascade(Timer **slot);
+        void advance(uint64_t target, std::vector<Timer::ptr> &expired);
+        uint64_t nextTick() const;
+
+        bool cancel(Timer *timer);
+        bool reset(Timer *timer, uint64_t ms, bool fromNow);
+
+    private:
+        uint32_t m_tick_ms;                                    // 精度
+        std::chrono::steady_clock::time_point m_start_time;   // tick 0 对应的时刻
+        uint64_t m_current_tick = 0;                           // 已经处理到的tick
+        uint64_t m_wait_tick = 0;                              // 定时器线程睡眠到的tick, 0表示没有睡眠
+        Timer *m_near[256];                                    // 第0级
+        Timer *m_far[3][64];                                   // 第1~3级
+        size_t m_near_count = 0;                               // 第0级的定时器个数
+        size_t m_count = 0;                                    // 时间轮中的定时器个数
+        Timer *m_running = nullptr;                            // 正在执行回调的定时器
+        bool m_stopping = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;                        // 唤醒定时器线程
+        std::condition_variable m_run_cond;                    // 回调执行完毕
+        Thread::ptr m_thread;                                  // 定时器线程
+    };
+
+    // 全局定时器, 日志重新打开文件、配置热加载防抖等使用; 持有其引用可保证在使用期间不被析构
+    using TimerMgr = SingletonPtr<TimerManager>;
+}
+
+#endif // __TIMER_H__
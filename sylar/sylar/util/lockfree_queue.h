@@ -0,0 +1,390 @@
+#ifndef __LOCKFREE_QUEUE_H__
+#define __LOCKFREE_QUEUE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 有界无锁队列
+ * SpscQueue: 单生产者单消费者环形队列
+ * MpscQueue: 多生产者单消费者队列(Vyukov 序号槽)
+ * MpmcQueue: 多生产者多消费者队列(Vyukov 序号槽)
+ *
+ * 容量在构造时确定, 向上取整为2的幂; 队列满时 tryPush 返回false, 空时 tryPop 返回false,
+ * 都不会阻塞, 需要等待时由调用方决定自旋、让出或休眠.
+ * 生产者与消费者使用的下标之间用整个缓存行隔开, 避免伪共享
+ */
+
+namespace sylar
+{
+    namespace detail
+    {
+        static const size_t kCacheLineSize = 64;
+
+        inline size_t QueueCapacity(size_t capacity)
+        {
+            size_t res = 2;
+            while (res < capacity)
+            {
+                res <<= 1;
+            }
+            return res;
+        }
+
+        // 未构造的元素存储
+        template <typename T>
+        struct QueueStorage
+        {
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+
+            T *get() { return reinterpret_cast<T *>(&data); }
+        };
+
+        /**
+         * @brief 带序号的槽位环, MPSC/MPMC 共用的生产者部分
+         * @details 槽位序号等于下标时可写, 等于下标+1时可读, 读完后置为下标+容量供下一轮写入.
+         *          生产者通过CAS抢占写下标, 抢到后写入数据再发布序号
+         */
+        template <typename T>
+        class SequencedRing
+        {
+        public:
+            explicit SequencedRing(size_t capacity)
+                : m_mask(QueueCapacity(capacity) - 1), m_cells(new Cell[m_mask + 1]),
+                  m_enqueuePos(0)
+            {
+                for (size_t i = 0; i <= m_mask; ++i)
+                {
+                    m_cells[i].seq.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            size_t capacity() const { return m_mask + 1; }
+
+            template <typename U>
+            bool tryPush(U &&val)
+            {
+                size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+                Cell *cell;
+                while (true)
+                {
+                    cell = &m_cells[pos & m_mask];
+                    size_t seq = cell->seq.load(std::memory_order_acquire);
+                    intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                    if (diff == 0)
+                    {
+                        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if (diff < 0)
+                    {
+                        // 槽位还未被上一轮读走, 队列已满
+                        return false;
+                    }
+                    else
+                    {
+                        pos = m_enqueuePos.load(std::memory_order_relaxed);
+                    }
+                }
+                new (cell->storage.get()) T(std::forward<U>(val));
+                cell->seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+        protected:
+            struct Cell
+            {
+                std::atomic<size_t> seq;
+                QueueStorage<T> storage;
+            };
+
+            // 移出pos处已发布的元素并把槽位交还给生产者
+            template <typename OutputIt>
+            void consume(Cell *cell, size_t pos, OutputIt &out)
+            {
+                T *p = cell->storage.get();
+                *out = std::move(*p);
+                ++out;
+                p->~T();
+                cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+            }
+
+            // 析构时销毁dequeuePos之后还未取出的元素
+            void destroyFrom(size_t pos)
+            {
+                while (true)
+                {
+                    Cell *cell = &m_cells[pos & m_mask];
+                    if (cell->seq.load(std::memory_order_acquire) != pos + 1)
+                    {
+                        break;
+                    }
+                    cell->storage.get()->~T();
+                    cell->seq.store(pos + m_mask + 1, std::memory_order_relaxed);
+                    ++pos;
+                }
+            }
+
+            const size_t m_mask;
+            std::unique_ptr<Cell[]> m_cells;
+            char m_pad0[kCacheLineSize];
+            std::atomic<size_t> m_enqueuePos;
+            char m_pad1[kCacheLineSize - sizeof(std::atomic<size_t>)];
+        };
+    }
+
+    /**
+     * @brief 单生产者单消费者有界队列
+     * @details 任意时刻最多一个线程调用 tryPush, 最多一个线程调用 tryPop/popBatch.
+     *          两端都是无等待(wait-free)的: 每次操作的步数有上限, 不会因另一端停顿而重试.
+     *          两端各自缓存对端的下标, 只有缓存看起来满/空时才去读对端的缓存行
+     */
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(size_t capacity)
+            : m_mask(detail::QueueCapacity(capacity) - 1),
+              m_slots(new detail::QueueStorage<T>[m_mask + 1]),
+              m_head(0), m_tailCache(0), m_tail(0), m_headCache(0) {}
+
+        ~SpscQueue()
+        {
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            for (size_t i = m_head.load(std::memory_order_relaxed); i != tail; ++i)
+            {
+                m_slots[i & m_mask].get()->~T();
+            }
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+
+        // 近似元素个数, 只在两端都静止时准确
+        size_t sizeApprox() const
+        {
+            return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+        bool empty() const { return sizeApprox() == 0; }
+
+        // 生产者调用
+        template <typename U>
+        bool tryPush(U &&val)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_headCache > m_mask)
+            {
+                m_headCache = m_head.load(std::memory_order_acquire);
+                if (tail - m_headCache > m_mask)
+                {
+                    return false;
+                }
+            }
+            new (m_slots[tail & m_mask].get()) T(std::forward<U>(val));
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 消费者调用
+        bool tryPop(T &out)
+        {
+            return popBatch(&out, 1) == 1;
+        }
+
+        /**
+         * @brief 批量取出, 最多max个, 按入队顺序写到out
+         * @details 只发布一次消费下标, 生产者看到的缓存行写入次数与批大小无关
+         * @return 实际取出的个数
+         */
+        template <typename OutputIt>
+        size_t popBatch(OutputIt out, size_t max)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (m_tailCache - head < max)
+            {
+                m_tailCache = m_tail.load(std::memory_order_acquire);
+            }
+            size_t n = std::min(m_tailCache - head, max);
+            for (size_t i = 0; i < n; ++i)
+            {
+                T *p = m_slots[(head + i) & m_mask].get();
+                *out = std::move(*p);
+                ++out;
+                p->~T();
+            }
+            if (n)
+            {
+                m_head.store(head + n, std::memory_order_release);
+            }
+            return n;
+        }
+
+    private:
+        SpscQueue(const SpscQueue &) = delete;
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        const size_t m_mask;
+        std::unique_ptr<detail::QueueStorage<T>[]> m_slots;
+        char m_pad0[detail::kCacheLineSize];
+        // 消费者独占
+        std::atomic<size_t> m_head;
+        size_t m_tailCache;
+        char m_pad1[detail::kCacheLineSize];
+        // 生产者独占
+        std::atomic<size_t> m_tail;
+        size_t m_headCache;
+        char m_pad2[detail::kCacheLineSize];
+    };
+
+    /**
+     * @brief 多生产者单消费者有界队列
+     * @details 生产者之间是无锁(lock-free)的: CAS失败说明有别的生产者成功入队.
+     *          消费者不使用CAS, 每次操作步数有上限.
+     *          注意: 生产者抢到槽位后、发布前被挂起时, 消费者会把队列视为空(tryPop返回false),
+     *          该槽位之后已发布的元素也要等它发布后才能取出; 每个生产者各自的入队顺序保持不变
+     */
+    template <typename T>
+    class MpscQueue : public detail::SequencedRing<T>
+    {
+        using Base = detail::SequencedRing<T>;
+
+    public:
+        explicit MpscQueue(size_t capacity)
+            : Base(capacity), m_dequeuePos(0) {}
+
+        ~MpscQueue() { this->destroyFrom(m_dequeuePos); }
+
+        // 消费者调用
+        bool tryPop(T &out)
+        {
+            return popBatch(&out, 1) == 1;
+        }
+
+        /**
+         * @brief 批量取出, 最多max个, 遇到未发布的槽位即停止
+         * @return 实际取出的个数
+         */
+        template <typename OutputIt>
+        size_t popBatch(OutputIt out, size_t max)
+        {
+            size_t n = 0;
+            while (n < max)
+            {
+                size_t pos = m_dequeuePos;
+                typename Base::Cell *cell = &this->m_cells[pos & this->m_mask];
+                if (cell->seq.load(std::memory_order_acquire) != pos + 1)
+                {
+                    break;
+                }
+                this->consume(cell, pos, out);
+                m_dequeuePos = pos + 1;
+                ++n;
+            }
+            return n;
+        }
+
+    private:
+        MpscQueue(const MpscQueue &) = delete;
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        // 只有消费者访问
+        size_t m_dequeuePos;
+        char m_pad[detail::kCacheLineSize - sizeof(size_t)];
+    };
+
+    /**
+     * @brief 多生产者多消费者有界队列
+     * @details 生产者之间、消费者之间都是无锁(lock-free)的, 生产者与消费者只在同一个槽位的序号上同步.
+     *          与 MpscQueue 一样, 抢到槽位后停顿的线程会让对端暂时看到满/空, 但不会让对端阻塞
+     */
+    template <typename T>
+    class MpmcQueue : public detail::SequencedRing<T>
+    {
+        using Base = detail::SequencedRing<T>;
+
+    public:
+        explicit MpmcQueue(size_t capacity)
+            : Base(capacity), m_dequeuePos(0) {}
+
+        ~MpmcQueue() { this->destroyFrom(m_dequeuePos.load(std::memory_order_relaxed)); }
+
+        // 近似元素个数, 包含已抢到槽位但还未发布的元素
+        size_t sizeApprox() const
+        {
+            size_t dequeuePos = m_dequeuePos.load(std::memory_order_acquire);
+            size_t enqueuePos = this->m_enqueuePos.load(std::memory_order_acquire);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+
+        bool empty() const { return sizeApprox() == 0; }
+
+        bool tryPop(T &out)
+        {
+            return popBatch(&out, 1) == 1;
+        }
+
+        /**
+         * @brief 批量取出, 最多max个
+         * @details 多消费者时每个元素仍需单独抢占, 批量接口只是省去调用方的循环;
+         *          取出的元素之间可能夹杂其他消费者取走的元素
+         * @return 实际取出的个数
+         */
+        template <typename OutputIt>
+        size_t popBatch(OutputIt out, size_t max)
+        {
+            size_t n = 0;
+            size_t pos;
+            typename Base::Cell *cell;
+            while (n < max && (cell = claim(pos)))
+            {
+                this->consume(cell, pos, out);
+                ++n;
+            }
+            return n;
+        }
+
+    private:
+        // 抢占一个已发布的槽位, 队列为空时返回nullptr
+        typename Base::Cell *claim(size_t &pos)
+        {
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                typename Base::Cell *cell = &this->m_cells[pos & this->m_mask];
+                size_t seq = cell->seq.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                if (diff == 0)
+                {
+                    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        return cell;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return nullptr;
+                }
+                else
+                {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        MpmcQueue(const MpmcQueue &) = delete;
+        MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+        std::atomic<size_t> m_dequeuePos;
+        char m_pad[detail::kCacheLineSize - sizeof(std::atomic<size_t>)];
+    };
+}
+
+#endif // __LOCKFREE_QUEUE_H__
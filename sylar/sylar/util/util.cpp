@@ -1,6 +1,102 @@
 #include "util.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <locale.h>
 
 namespace Util
 {
+    namespace detail
+    {
+        //解析和格式化固定使用C locale, 不受setlocale的影响(如de_DE下小数点为',')
+        static locale_t CLocale()
+        {
+            static locale_t s_locale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+            return s_locale;
+        }
 
-}
\ No newline at end of file
+        //只接受十进制写法: 排除前后空白、十六进制(0x1p3)、inf和nan, 其余格式由strtod检查
+        static bool IsDecimalFloat(const std::string &str)
+        {
+            bool digit = false;
+            for (char c : str)
+            {
+                if (c >= '0' && c <= '9')
+                    digit = true;
+                else if (c != '+' && c != '-' && c != '.' && c != 'e' && c != 'E')
+                    return false;
+            }
+            return digit;
+        }
+
+        template <typename T>
+        static bool ParseFloat(const std::string &str, T &out, T (*fn)(const char *, char **, locale_t))
+        {
+            if (!IsDecimalFloat(str))
+                return false;
+
+            char *end = nullptr;
+            errno = 0;
+            T v = fn(str.c_str(), &end, CLocale());
+            if (end != str.c_str() + str.size())
+                return false;
+            if (errno == ERANGE && std::isinf(v))
+                return false;
+            out = v;
+            return true;
+        }
+
+        bool parse_float(const std::string &str, double &out)
+        {
+            return ParseFloat<double>(str, out, strtod_l);
+        }
+
+        bool parse_float(const std::string &str, float &out)
+        {
+            return ParseFloat<float>(str, out, strtof_l);
+        }
+
+        //从digits10开始逐步增加精度, 直到解析回来与原值相等; snprintf期间当前线程切换到C locale
+        template <typename T>
+        static std::string FormatFloat(T v, T (*fn)(const char *, char **, locale_t))
+        {
+            char buf[32];
+            int len = 0;
+            locale_t old = uselocale(CLocale());
+            for (int prec = std::numeric_limits<T>::digits10; prec <= std::numeric_limits<T>::max_digits10; ++prec)
+            {
+                len = snprintf(buf, sizeof(buf), "%.*g", prec, static_cast<double>(v));
+                if (fn(buf, nullptr, CLocale()) == v)
+                    break;
+            }
+            uselocale(old);
+            return std::string(buf, len);
+        }
+
+        std::string format_float(double v)
+        {
+            return FormatFloat<double>(v, strtod_l);
+        }
+
+        std::string format_float(float v)
+        {
+            return FormatFloat<float>(v, strtof_l);
+        }
+
+        bool parse_bool(const std::string &str, bool &out)
+        {
+            if (str == "1" || str == "true" || str == "True" || str == "TRUE")
+            {
+                out = true;
+                return true;
+            }
+            if (str == "0" || str == "false" || str == "False" || str == "FALSE")
+            {
+                out = false;
+                return true;
+            }
+            return false;
+        }
+    }
+}
@@ -27,6 +27,7 @@ inline std::uint32_t getThreadId()
 #include <exception>
 #include <type_traits>
 #include <sstream>
+#include <string>
 #include <limits>
 
 namespace Util
@@ -111,17 +112,217 @@ namespace Util
         typedef const T *type;
     };
 
+    namespace detail
+    {
+        //走快速路径的整数类型(字符类型和bool按流的语义处理)
+        template <typename T>
+        struct is_fast_integer
+            : std::integral_constant<bool, std::is_integral<T>::value && (sizeof(T) > 1) &&
+                                               !std::is_same<T, bool>::value &&
+                                               !std::is_same<T, wchar_t>::value &&
+                                               !std::is_same<T, char16_t>::value &&
+                                               !std::is_same<T, char32_t>::value>
+        {
+        };
+
+        template <typename T>
+        struct is_fast_float
+            : std::integral_constant<bool, std::is_same<T, float>::value || std::is_same<T, double>::value>
+        {
+        };
+
+        enum lexical_kind
+        {
+            kind_stream,    //stringstream通用转换
+            kind_identity,  //相同类型
+            kind_cstr,      //const char* -> string
+            kind_str2int,   //string -> 整数
+            kind_int2str,   //整数 -> string
+            kind_str2float, //string -> 浮点
+            kind_float2str, //浮点 -> string
+            kind_str2bool,  //string -> bool
+            kind_bool2str   //bool -> string
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_kind_of
+        {
+            static const bool from_str = std::is_same<Source, std::string>::value;
+            static const bool to_str = std::is_same<Target, std::string>::value;
+
+            static const int value =
+                std::is_same<Target, Source>::value                                      ? kind_identity
+                : to_str && (std::is_same<Source, const char *>::value ||
+                             std::is_same<Source, char *>::value)                        ? kind_cstr
+                : from_str && is_fast_integer<Target>::value                             ? kind_str2int
+                : to_str && is_fast_integer<Source>::value                               ? kind_int2str
+                : from_str && is_fast_float<Target>::value                               ? kind_str2float
+                : to_str && is_fast_float<Source>::value                                 ? kind_float2str
+                : from_str && std::is_same<Target, bool>::value                          ? kind_str2bool
+                : to_str && std::is_same<Source, bool>::value                            ? kind_bool2str
+                                                                                         : kind_stream;
+        };
+
+        /**
+         * @brief 十进制整数解析, 不允许前后空白, 溢出返回false
+         * @details 无符号类型不接受负号
+         */
+        template <typename T>
+        bool parse_integer(const char *p, const char *end, T &out)
+        {
+            typedef typename std::make_unsigned<T>::type U;
+            if (p == end)
+                return false;
+
+            bool neg = false;
+            if (*p == '-' || *p == '+')
+            {
+                neg = *p == '-';
+                if (++p == end || (neg && !std::is_signed<T>::value))
+                    return false;
+            }
+
+            U limit = static_cast<U>(std::numeric_limits<T>::max()) + (neg ? 1 : 0);
+            U val = 0;
+            for (; p != end; ++p)
+            {
+                unsigned d = static_cast<unsigned char>(*p) - '0';
+                if (d > 9 || val > (limit - d) / 10)
+                    return false;
+                val = val * 10 + d;
+            }
+            out = static_cast<T>(neg ? static_cast<U>(0) - val : val);
+            return true;
+        }
+
+        //整数格式化, 结果不超过短字符串长度, 不分配内存
+        template <typename T>
+        std::string format_integer(T v)
+        {
+            typedef typename std::make_unsigned<T>::type U;
+            char buf[24];
+            char *end = buf + sizeof(buf);
+            char *p = end;
+            bool neg = std::is_signed<T>::value && v < static_cast<T>(0);
+            U u = neg ? static_cast<U>(0) - static_cast<U>(v) : static_cast<U>(v);
+            do
+            {
+                *--p = static_cast<char>('0' + u % 10);
+                u /= 10;
+            } while (u);
+            if (neg)
+                *--p = '-';
+            return std::string(p, end);
+        }
+
+        //浮点解析(正确舍入), 与locale无关; 只接受十进制写法, 不允许前后空白, 十六进制、inf、nan和上溢返回false
+        bool parse_float(const std::string &str, double &out);
+        bool parse_float(const std::string &str, float &out);
+
+        //浮点格式化: 能精确还原原值的最短表示, 小数点固定为'.'
+        std::string format_float(double v);
+        std::string format_float(float v);
+
+        //接受 1/0/true/false(含首字母大写和全大写)
+        bool parse_bool(const std::string &str, bool &out);
+
+        template <typename Target, typename Source, int Kind = lexical_kind_of<Target, Source>::value>
+        struct lexical_converter
+        {
+            static Target convert(const Source &arg)
+            {
+                lexical_stream<Target, Source> interpreter;
+                Target result;
+
+                if (!(interpreter << arg && interpreter >> result))
+                    throw(bad_lexical_cast(typeid(Source), typeid(Target)));
+
+                return result;
+            }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_identity>
+        {
+            static const Target &convert(const Source &arg) { return arg; }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_cstr>
+        {
+            static Target convert(const Source &arg)
+            {
+                if (!arg)
+                    throw(bad_lexical_cast(typeid(Source), typeid(Target)));
+                return Target(arg);
+            }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_str2int>
+        {
+            static Target convert(const Source &arg)
+            {
+                Target result;
+                if (!parse_integer(arg.data(), arg.data() + arg.size(), result))
+                    throw(bad_lexical_cast(typeid(Source), typeid(Target)));
+                return result;
+            }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_int2str>
+        {
+            static Target convert(const Source &arg) { return format_integer(arg); }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_str2float>
+        {
+            static Target convert(const Source &arg)
+            {
+                Target result;
+                if (!parse_float(arg, result))
+                    throw(bad_lexical_cast(typeid(Source), typeid(Target)));
+                return result;
+            }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_float2str>
+        {
+            static Target convert(const Source &arg) { return format_float(arg); }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_str2bool>
+        {
+            static Target convert(const Source &arg)
+            {
+                Target result;
+                if (!parse_bool(arg, result))
+                    throw(bad_lexical_cast(typeid(Source), typeid(Target)));
+                return result;
+            }
+        };
+
+        template <typename Target, typename Source>
+        struct lexical_converter<Target, Source, kind_bool2str>
+        {
+            static Target convert(const Source &arg) { return arg ? "1" : "0"; }
+        };
+    }
+
+    /**
+     * @brief 类型转换
+     * @details 整数、float/double、bool与string之间的转换以及同类型转换走专门的快速路径,
+     *          不构造stringstream; 其他类型仍然通过stringstream转换
+     */
     template <typename Target, typename Source>
     Target lexical_cast(const Source &arg)
     {
         typedef typename array_to_pointer_decay<Source>::type NewSource;
-        lexical_stream<Target, NewSource> interpreter;
-        Target result;
-
-        if (!(interpreter << arg && interpreter >> result))
-            throw(bad_lexical_cast(typeid(NewSource), typeid(Target)));
-
-        return result;
+        return detail::lexical_converter<Target, NewSource>::convert(arg);
     }
 
 }
@@ -0,0 +1,118 @@
+#ifndef __WORK_STEAL_DEQUE_H__
+#define __WORK_STEAL_DEQUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include "lockfree_queue.h"
+
+namespace sylar
+{
+    /**
+     * @brief Chase-Lev 工作窃取双端队列(有界)
+     * @details 所有者线程在底部 push/pop(后进先出, 缓存友好), 其他线程从顶部 steal(先进先出).
+     *          所有者操作无等待, 只有与窃取者争抢最后一个元素时才用CAS; steal 是无锁的,
+     *          CAS失败说明元素被所有者或其他窃取者取走.
+     *          T需要可平凡拷贝(通常是指针), 元素的生命周期由调用方管理; 满时 push 返回false
+     */
+    template <typename T>
+    class WorkStealDeque
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "WorkStealDeque requires a trivially copyable type");
+
+    public:
+        explicit WorkStealDeque(size_t capacity)
+            : m_mask(detail::QueueCapacity(capacity) - 1),
+              m_buffer(new std::atomic<T>[m_mask + 1]),
+              m_top(0), m_bottom(0) {}
+
+        size_t capacity() const { return m_mask + 1; }
+
+        // 近似元素个数, 用于判断是否值得窃取
+        size_t sizeApprox() const
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            return b > t ? static_cast<size_t>(b - t) : 0;
+        }
+
+        bool empty() const { return sizeApprox() == 0; }
+
+        // 所有者调用
+        bool push(T val)
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            if (b - t > static_cast<int64_t>(m_mask))
+            {
+                return false;
+            }
+            m_buffer[b & m_mask].store(val, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        // 所有者调用, 取最近push的元素
+        bool pop(T &out)
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                // 已空
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+            out = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+            if (t == b)
+            {
+                // 最后一个元素, 与窃取者竞争
+                bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                         std::memory_order_relaxed);
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        // 任意线程调用, 取最早push的元素
+        bool steal(T &out)
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b)
+            {
+                return false;
+            }
+            T val = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed))
+            {
+                return false;
+            }
+            out = val;
+            return true;
+        }
+
+    private:
+        WorkStealDeque(const WorkStealDeque &) = delete;
+        WorkStealDeque &operator=(const WorkStealDeque &) = delete;
+
+        const int64_t m_mask;
+        std::unique_ptr<std::atomic<T>[]> m_buffer;
+        char m_pad0[detail::kCacheLineSize];
+        // 窃取者竞争
+        std::atomic<int64_t> m_top;
+        char m_pad1[detail::kCacheLineSize];
+        // 所有者独占写
+        std::atomic<int64_t> m_bottom;
+        char m_pad2[detail::kCacheLineSize];
+    };
+}
+
+#endif // __WORK_STEAL_DEQUE_H__
@@ -0,0 +1,265 @@
+#include "../sylar/config/config.h"
+#include "../sylar/log/log.h"
+#include "bench_util.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * 配置模块基准测试, 结果以JSON输出便于回归对比
+ * ./bench_config [-o result.json] [-q]    -q: 只跑小规模用例
+ */
+
+namespace
+{
+    using namespace bench;
+
+    // 按配置项名称的各段组织的嵌套文档
+    struct YamlTree
+    {
+        std::string value;
+        std::map<std::string, YamlTree> children;
+    };
+
+    void EmitTree(YAML::Emitter &out, const YamlTree &tree)
+    {
+        if (tree.children.empty())
+        {
+            out << tree.value;
+            return;
+        }
+        out << YAML::BeginMap;
+        for (auto &i : tree.children)
+        {
+            out << YAML::Key << i.first << YAML::Value;
+            EmitTree(out, i.second);
+        }
+        out << YAML::EndMap;
+    }
+
+    /**
+     * LoadFromYaml: keys个int配置项均分到多层嵌套的分组中, depth为键名的段数
+     */
+    void BenchLoadFromYaml(size_t keys, size_t depth)
+    {
+        const size_t fanout = 16;
+        std::string prefix = "bench_load_" + std::to_string(keys) + "_" + std::to_string(depth);
+        std::vector<std::string> names;
+        names.reserve(keys);
+        for (size_t i = 0; i < keys; ++i)
+        {
+            std::string name = prefix;
+            size_t group = i;
+            for (size_t d = 1; d < depth; ++d)
+            {
+                name += ".g" + std::to_string(group % fanout);
+                group /= fanout;
+            }
+            name += ".k" + std::to_string(i);
+            names.push_back(name);
+            sylar::Config::Lookup(name, 0, "");
+        }
+
+        const int rounds = 3;
+        uint64_t parseNs = 0;
+        uint64_t loadNs = 0;
+        for (int r = 1; r <= rounds; ++r)
+        {
+            // 每轮的值都不同, 保证每个配置项都真正提交
+            YamlTree tree;
+            for (size_t i = 0; i < keys; ++i)
+            {
+                YamlTree *node = &tree;
+                std::stringstream ns(names[i]);
+                std::string seg;
+                while (std::getline(ns, seg, '.'))
+                {
+                    node = &node->children[seg];
+                }
+                node->value = std::to_string(i + r);
+            }
+            YAML::Emitter text;
+            EmitTree(text, tree);
+
+            auto begin = Clock::now();
+            YAML::Node parsed = YAML::Load(text.c_str());
+            parseNs += ElapsedNs(begin);
+
+            begin = Clock::now();
+            sylar::Config::LoadFromYaml(parsed);
+            loadNs += ElapsedNs(begin);
+        }
+        Report("yaml_parse", {{"keys", Param(keys)}, {"depth", Param(depth)}}, rounds, parseNs);
+        Report("load_from_yaml", {{"keys", Param(keys)}, {"depth", Param(depth)}}, rounds, loadNs);
+    }
+
+    void BenchLookup(size_t registered)
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < registered; ++i)
+        {
+            names.push_back("bench_lookup.k" + std::to_string(i));
+            sylar::Config::Lookup(names.back(), 0, "");
+        }
+        sylar::Config::Lookup("bench_lookup.fixed", 0, "");
+
+        const uint64_t ops = 1000000;
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            Sink() += sylar::Config::Lookup<int>(names[i % registered]) ? 1 : 0;
+        }
+        Report("lookup_string", {{"registered", Param(registered)}}, ops, ElapsedNs(begin));
+
+        begin = Clock::now();
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            Sink() += sylar::Config::LookupBase(names[i % registered]) ? 1 : 0;
+        }
+        Report("lookup_base", {{"registered", Param(registered)}}, ops, ElapsedNs(begin));
+
+        begin = Clock::now();
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            Sink() += sylar::Config::Lookup<int>(SYLAR_CONFIG("bench_lookup.fixed")) ? 1 : 0;
+        }
+        Report("lookup_config_key", {{"registered", Param(registered)}}, ops, ElapsedNs(begin));
+    }
+
+    // threads个线程同时读取, 统计每次读取的平均耗时
+    template <typename Fn>
+    void RunReaders(const std::string &name, size_t threads, uint64_t opsPerThread, Fn fn)
+    {
+        std::vector<std::thread> pool;
+        std::atomic<uint64_t> totalNs(0);
+        for (size_t t = 0; t < threads; ++t)
+        {
+            pool.push_back(std::thread([&]()
+                                       {
+                                           auto begin = Clock::now();
+                                           uint64_t sum = 0;
+                                           for (uint64_t i = 0; i < opsPerThread; ++i)
+                                           {
+                                               sum += fn();
+                                           }
+                                           totalNs += ElapsedNs(begin);
+                                           Sink() += sum;
+                                       }));
+        }
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+        Report(name, {{"threads", Param(threads)}}, opsPerThread * threads, totalNs);
+    }
+
+    void BenchGetValue(size_t threads)
+    {
+        static auto s_int = sylar::Config::Lookup("bench_get.int", 8080, "");
+        static auto s_vec = sylar::Config::Lookup("bench_get.vec", std::vector<int>(10000, 1), "");
+
+        RunReaders("get_value_scalar", threads, 1000000, []()
+                   { return static_cast<uint64_t>(s_int->getValue()); });
+        RunReaders("get_handle_scalar", threads, 1000000, []()
+                   { return static_cast<uint64_t>(*s_int->get()); });
+        RunReaders("get_value_vector10k", threads, 2000, []()
+                   { return static_cast<uint64_t>(s_vec->getValue().size()); });
+        RunReaders("get_handle_vector10k", threads, 1000000, []()
+                   { return static_cast<uint64_t>(s_vec->get()->size()); });
+        RunReaders("cached_config_vector10k", threads, 1000000, []()
+                   {
+                       static thread_local sylar::CachedConfig<std::vector<int>> s_cached(s_vec);
+                       return static_cast<uint64_t>(s_cached->size());
+                   });
+    }
+
+    void BenchSetValue(size_t listeners)
+    {
+        auto var = sylar::Config::Lookup("bench_set.l" + std::to_string(listeners), 0, "");
+        for (size_t i = 0; i < listeners; ++i)
+        {
+            var->addListener(i, [](const int &oldValue, const int &newValue)
+                             { Sink() += oldValue + newValue; });
+        }
+
+        const uint64_t ops = 100000;
+        auto begin = Clock::now();
+        for (uint64_t i = 1; i <= ops; ++i)
+        {
+            var->setValue(static_cast<int>(i));
+        }
+        Report("set_value", {{"listeners", Param(listeners)}}, ops, ElapsedNs(begin));
+
+        // 包含回调线程执行完所有回调的时间
+        sylar::Config::WaitListeners();
+        Report("set_value_and_dispatch", {{"listeners", Param(listeners)}}, ops, ElapsedNs(begin));
+    }
+
+    void BenchToString(size_t size)
+    {
+        std::vector<int> vec(size);
+        std::map<std::string, int> map;
+        for (size_t i = 0; i < size; ++i)
+        {
+            vec[i] = i;
+            map["key" + std::to_string(i)] = i;
+        }
+        auto vecVar = sylar::Config::Lookup("bench_dump.vec" + std::to_string(size), vec, "");
+        auto mapVar = sylar::Config::Lookup("bench_dump.map" + std::to_string(size), map, "");
+
+        const uint64_t ops = 20;
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            Sink() += vecVar->toString().size();
+        }
+        Report("to_string_vector", {{"size", Param(size)}}, ops, ElapsedNs(begin));
+
+        begin = Clock::now();
+        for (uint64_t i = 0; i < ops; ++i)
+        {
+            Sink() += mapVar->toString().size();
+        }
+        Report("to_string_map", {{"size", Param(size)}}, ops, ElapsedNs(begin));
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Options opt = bench::ParseArgs(argc, argv);
+    const bool quick = opt.quick;
+
+    // Lookup已存在的配置项时会打印日志, 避免干扰输出
+    LOG_ROOT->setLevel(sylar::LogLevel::ERROR);
+
+    std::vector<size_t> keys = quick ? std::vector<size_t>{1000} : std::vector<size_t>{1000, 10000, 100000};
+    for (size_t k : keys)
+    {
+        BenchLoadFromYaml(k, 2);
+        BenchLoadFromYaml(k, 4);
+    }
+
+    BenchLookup(quick ? 1000 : 100000);
+
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    BenchGetValue(1);
+    if (cores > 1)
+    {
+        BenchGetValue(std::min<size_t>(cores, 8));
+    }
+
+    BenchSetValue(0);
+    BenchSetValue(4);
+
+    BenchToString(1000);
+    if (!quick)
+    {
+        BenchToString(100000);
+    }
+
+    return bench::WriteResults(opt);
+}
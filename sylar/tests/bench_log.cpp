@@ -0,0 +1,117 @@
+#include "../sylar/log/log.h"
+#include "bench_util.h"
+#include "yaml-cpp/yaml.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 日志输出基准测试, 结果以JSON输出便于回归对比
+ * 对比直接输出与经过 DedupLogAppender 包装后的开销(内容各不相同时不折叠, 相同时折叠)
+ * ./bench_log [-o result.json] [-q]    -q: 减少每个线程的日志条数
+ */
+
+namespace
+{
+    using namespace bench;
+
+    // 格式化到内存后丢弃, 与 StdoutLogAppender 一样持锁格式化, 但不产生IO
+    class NullLogAppender : public sylar::LogAppender
+    {
+    public:
+        void log(sylar::Logger::ptr logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override
+        {
+            if (level >= m_level)
+            {
+                std::lock_guard<std::mutex> lockGuard(m_mutex);
+                m_buffer.str("");
+                m_formatter->format(m_buffer, logger, level, event);
+                Sink() += m_buffer.tellp();
+            }
+        }
+
+        void toYamlFields(YAML::Emitter &out) override
+        {
+            out << YAML::Key << "type" << YAML::Value << "NullLogAppender";
+        }
+
+    private:
+        std::stringstream m_buffer;
+    };
+
+    /**
+     * threads个线程各输出count条日志
+     * @param[in] repeat true时每条内容相同(被折叠), false时每条内容不同
+     */
+    void BenchLog(const std::string &name, bool dedup, bool repeat, size_t threads, uint64_t count)
+    {
+        sylar::Logger::ptr logger(new sylar::Logger("bench_" + name));
+        sylar::LogAppender::ptr appender(new NullLogAppender);
+        if (dedup)
+        {
+            appender.reset(new sylar::DedupLogAppender(appender, 60));
+        }
+        logger->addAppender(appender);
+
+        std::vector<std::thread> pool;
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> start(false);
+        std::atomic<uint64_t> totalNs(0);
+        for (size_t t = 0; t < threads; ++t)
+        {
+            pool.push_back(std::thread([&]()
+                                       {
+                                           ++ready;
+                                           while (!start.load(std::memory_order_acquire))
+                                           {
+                                               std::this_thread::yield();
+                                           }
+                                           auto begin = Clock::now();
+                                           for (uint64_t i = 0; i < count; ++i)
+                                           {
+                                               LOG_INFO(logger) << "request done, id = " << (repeat ? 0 : i);
+                                           }
+                                           totalNs += ElapsedNs(begin);
+                                       }));
+        }
+        while (ready.load() != threads)
+        {
+            std::this_thread::yield();
+        }
+        start.store(true, std::memory_order_release);
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+        logger->clearAppenders();
+        Report(name, {{"threads", Param(threads)}}, count * threads, totalNs);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Options opt = bench::ParseArgs(argc, argv);
+    const bool quick = opt.quick;
+
+    const uint64_t count = quick ? 20000 : 500000;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threads{1};
+    for (size_t t = 2; t <= std::min<size_t>(cores, 8); t *= 2)
+    {
+        threads.push_back(t);
+    }
+
+    for (size_t t : threads)
+    {
+        BenchLog("plain", false, false, t, count);
+        BenchLog("dedup_distinct", true, false, t, count);
+        BenchLog("plain_repeat", false, true, t, count);
+        BenchLog("dedup_repeat", true, true, t, count);
+    }
+
+    return bench::WriteResults(opt);
+}
@@ -0,0 +1,188 @@
+#include "../sylar/thread/mutex.h"
+#include "bench_util.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * 锁的竞争基准测试, 结果以JSON输出便于回归对比
+ * ./bench_mutex [-o result.json] [-q]    -q: 减少每个线程的操作次数
+ */
+
+namespace
+{
+    using namespace bench;
+
+    // 被保护的数据: 4个机器字, 读者求和, 写者整体递增
+    struct Payload
+    {
+        uint64_t v[4];
+    };
+
+    // 统一各种锁的读写接口
+    struct StdMutexGuard
+    {
+        std::mutex mutex;
+        Payload data = Payload();
+        uint64_t read()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return data.v[0] + data.v[1] + data.v[2] + data.v[3];
+        }
+        void write()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &i : data.v)
+            {
+                ++i;
+            }
+        }
+    };
+
+    template <typename M>
+    struct ExclusiveGuard
+    {
+        M mutex;
+        Payload data = Payload();
+        uint64_t read()
+        {
+            typename M::Lock lock(mutex);
+            return data.v[0] + data.v[1] + data.v[2] + data.v[3];
+        }
+        void write()
+        {
+            typename M::Lock lock(mutex);
+            for (auto &i : data.v)
+            {
+                ++i;
+            }
+        }
+    };
+
+    template <typename M>
+    struct SharedGuard
+    {
+        M mutex;
+        Payload data = Payload();
+        uint64_t read()
+        {
+            typename M::ReadLock lock(mutex);
+            return data.v[0] + data.v[1] + data.v[2] + data.v[3];
+        }
+        void write()
+        {
+            typename M::WriteLock lock(mutex);
+            for (auto &i : data.v)
+            {
+                ++i;
+            }
+        }
+    };
+
+    struct SeqLockGuard
+    {
+        sylar::SeqLockValue<Payload> data;
+        uint64_t read()
+        {
+            Payload p = data.load();
+            return p.v[0] + p.v[1] + p.v[2] + p.v[3];
+        }
+        void write()
+        {
+            Payload p = data.load();
+            for (auto &i : p.v)
+            {
+                ++i;
+            }
+            data.store(p);
+        }
+    };
+
+    /**
+     * threads个线程同时访问, 每个线程每readPerWrite+1次操作中有1次写;
+     * readPerWrite为0表示只写
+     */
+    template <typename G>
+    void BenchContention(const std::string &name, size_t threads, uint64_t readPerWrite, uint64_t opsPerThread)
+    {
+        G guard;
+        std::vector<std::thread> pool;
+        std::atomic<size_t> ready(0);
+        std::atomic<bool> start(false);
+        std::atomic<uint64_t> totalNs(0);
+        for (size_t t = 0; t < threads; ++t)
+        {
+            pool.push_back(std::thread([&]()
+                                       {
+                                           ++ready;
+                                           while (!start.load(std::memory_order_acquire))
+                                           {
+                                               sylar::CpuRelax();
+                                           }
+                                           auto begin = Clock::now();
+                                           uint64_t sum = 0;
+                                           for (uint64_t i = 0; i < opsPerThread; ++i)
+                                           {
+                                               if (i % (readPerWrite + 1) == 0)
+                                               {
+                                                   guard.write();
+                                               }
+                                               else
+                                               {
+                                                   sum += guard.read();
+                                               }
+                                           }
+                                           totalNs += ElapsedNs(begin);
+                                           Sink() += sum;
+                                       }));
+        }
+        while (ready.load() != threads)
+        {
+            std::this_thread::yield();
+        }
+        start.store(true, std::memory_order_release);
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+        Sink() += guard.read();
+        Report(name, {{"threads", Param(threads)}, {"read_per_write", Param(readPerWrite)}},
+               opsPerThread * threads, totalNs);
+    }
+
+    void BenchAll(size_t threads, uint64_t readPerWrite, uint64_t opsPerThread)
+    {
+        BenchContention<StdMutexGuard>("std_mutex", threads, readPerWrite, opsPerThread);
+        BenchContention<ExclusiveGuard<sylar::Mutex>>("mutex", threads, readPerWrite, opsPerThread);
+        BenchContention<ExclusiveGuard<sylar::Spinlock>>("spinlock", threads, readPerWrite, opsPerThread);
+        BenchContention<SharedGuard<sylar::RWMutex>>("rwmutex", threads, readPerWrite, opsPerThread);
+        BenchContention<SharedGuard<sylar::RWSpinlock>>("rwspinlock", threads, readPerWrite, opsPerThread);
+        BenchContention<SeqLockGuard>("seqlock", threads, readPerWrite, opsPerThread);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Options opt = bench::ParseArgs(argc, argv);
+    const bool quick = opt.quick;
+
+    const uint64_t opsPerThread = quick ? 100000 : 2000000;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threads{1};
+    for (size_t t = 2; t <= std::min<size_t>(cores, 16); t *= 2)
+    {
+        threads.push_back(t);
+    }
+
+    for (size_t t : threads)
+    {
+        BenchAll(t, 0, opsPerThread);
+        BenchAll(t, 9, opsPerThread);
+        BenchAll(t, 99, opsPerThread);
+    }
+
+    return bench::WriteResults(opt);
+}
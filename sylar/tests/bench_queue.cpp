@@ -0,0 +1,162 @@
+#include "../sylar/util/lockfree_queue.h"
+#include "../sylar/thread/mutex.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * 无锁队列与 std::mutex + std::deque 的吞吐对比, 结果以JSON输出便于回归对比
+ * ./bench_queue [-o result.json] [-q]    -q: 减少元素个数
+ */
+
+namespace
+{
+    using namespace bench;
+
+    // 对照组: std::mutex + std::deque, 同样有界
+    template <typename T>
+    class MutexDequeQueue
+    {
+    public:
+        explicit MutexDequeQueue(size_t capacity) : m_capacity(capacity) {}
+
+        bool tryPush(const T &val)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.size() >= m_capacity)
+            {
+                return false;
+            }
+            m_queue.push_back(val);
+            return true;
+        }
+
+        template <typename OutputIt>
+        size_t popBatch(OutputIt out, size_t max)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t n = std::min(max, m_queue.size());
+            for (size_t i = 0; i < n; ++i)
+            {
+                *out = m_queue.front();
+                ++out;
+                m_queue.pop_front();
+            }
+            return n;
+        }
+
+    private:
+        size_t m_capacity;
+        std::mutex m_mutex;
+        std::deque<T> m_queue;
+    };
+
+    /**
+     * producers个生产者各写入itemsPerProducer个元素, consumers个消费者每次最多取batch个,
+     * 统计从开始到全部取完的总耗时
+     */
+    template <typename Q>
+    void BenchQueue(const std::string &name, size_t producers, size_t consumers, size_t batch,
+                    uint64_t itemsPerProducer)
+    {
+        Q queue(1024);
+        const uint64_t total = itemsPerProducer * producers;
+        std::atomic<uint64_t> consumed(0);
+        std::atomic<bool> start(false);
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < consumers; ++c)
+        {
+            threads.push_back(std::thread([&]()
+                                          {
+                                              while (!start.load(std::memory_order_acquire))
+                                              {
+                                                  std::this_thread::yield();
+                                              }
+                                              std::vector<uint64_t> buf(batch);
+                                              uint64_t sum = 0;
+                                              sylar::SpinBackoff backoff;
+                                              while (consumed.load(std::memory_order_relaxed) < total)
+                                              {
+                                                  size_t n = queue.popBatch(buf.begin(), batch);
+                                                  if (n == 0)
+                                                  {
+                                                      backoff.pause();
+                                                      continue;
+                                                  }
+                                                  backoff = sylar::SpinBackoff();
+                                                  for (size_t i = 0; i < n; ++i)
+                                                  {
+                                                      sum += buf[i];
+                                                  }
+                                                  consumed += n;
+                                              }
+                                              Sink() += sum;
+                                          }));
+        }
+        for (size_t p = 0; p < producers; ++p)
+        {
+            threads.push_back(std::thread([&]()
+                                          {
+                                              while (!start.load(std::memory_order_acquire))
+                                              {
+                                                  std::this_thread::yield();
+                                              }
+                                              for (uint64_t i = 0; i < itemsPerProducer; ++i)
+                                              {
+                                                  sylar::SpinBackoff backoff;
+                                                  while (!queue.tryPush(i))
+                                                  {
+                                                      backoff.pause();
+                                                  }
+                                              }
+                                          }));
+        }
+
+        auto begin = Clock::now();
+        start.store(true, std::memory_order_release);
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        Report(name, {{"producers", Param(producers)}, {"consumers", Param(consumers)}, {"batch", Param(batch)}},
+               total, ElapsedNs(begin));
+    }
+
+    void BenchAll(size_t producers, size_t consumers, size_t batch, uint64_t items)
+    {
+        if (producers == 1 && consumers == 1)
+        {
+            BenchQueue<sylar::SpscQueue<uint64_t>>("spsc", producers, consumers, batch, items);
+        }
+        if (consumers == 1)
+        {
+            BenchQueue<sylar::MpscQueue<uint64_t>>("mpsc", producers, consumers, batch, items);
+        }
+        BenchQueue<sylar::MpmcQueue<uint64_t>>("mpmc", producers, consumers, batch, items);
+        BenchQueue<MutexDequeQueue<uint64_t>>("mutex_deque", producers, consumers, batch, items);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Options opt = bench::ParseArgs(argc, argv);
+    const bool quick = opt.quick;
+
+    const uint64_t items = quick ? 100000 : 2000000;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t many = std::max<size_t>(2, std::min<size_t>(cores / 2, 8));
+    for (size_t batch : {1, 64})
+    {
+        BenchAll(1, 1, batch, items);
+        BenchAll(many, 1, batch, items / many);
+        BenchAll(many, many, batch, items / many);
+    }
+
+    return bench::WriteResults(opt);
+}
@@ -0,0 +1,145 @@
+#include "../sylar/fiber/scheduler.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 调度器在不同线程数下的吞吐, 结果以JSON输出便于回归对比
+ * ./bench_scheduler [-o result.json] [-q]    -q: 减少任务个数
+ *   spawn:  非工作线程提交空任务(全局队列)
+ *   fanout: 工作线程内递归扇出空任务(本地队列 + 窃取)
+ *   yield:  协程反复 YieldToReady
+ *   wake:   两个协程互相唤醒(LIFO槽)
+ */
+
+namespace
+{
+    using namespace bench;
+
+    void BenchSpawn(size_t threads, uint64_t tasks)
+    {
+        std::atomic<uint64_t> done(0);
+        sylar::Scheduler scheduler(threads, "bench");
+        scheduler.start();
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < tasks; ++i)
+        {
+            scheduler.schedule([&done]()
+                               { done.fetch_add(1, std::memory_order_relaxed); });
+        }
+        scheduler.stop();
+        Report("spawn", {{"threads", Param(threads)}}, done, ElapsedNs(begin));
+    }
+
+    void Fanout(sylar::Scheduler *scheduler, int depth, std::atomic<uint64_t> *done)
+    {
+        done->fetch_add(1, std::memory_order_relaxed);
+        if (depth == 0)
+        {
+            return;
+        }
+        for (int i = 0; i < 8; ++i)
+        {
+            scheduler->schedule([scheduler, depth, done]()
+                                { Fanout(scheduler, depth - 1, done); });
+        }
+    }
+
+    void BenchFanout(size_t threads, int depth)
+    {
+        std::atomic<uint64_t> done(0);
+        sylar::Scheduler scheduler(threads, "bench");
+        scheduler.start();
+        auto begin = Clock::now();
+        scheduler.schedule([&scheduler, &done, depth]()
+                           { Fanout(&scheduler, depth, &done); });
+        scheduler.stop();
+        Report("fanout", {{"threads", Param(threads)}}, done, ElapsedNs(begin));
+    }
+
+    void BenchYield(size_t threads, uint64_t fibers, uint64_t rounds)
+    {
+        sylar::Scheduler scheduler(threads, "bench");
+        scheduler.start();
+        auto begin = Clock::now();
+        for (uint64_t i = 0; i < fibers; ++i)
+        {
+            scheduler.schedule([rounds]()
+                               {
+                                   for (uint64_t r = 0; r < rounds; ++r)
+                                   {
+                                       sylar::Scheduler::YieldToReady();
+                                   } });
+        }
+        scheduler.stop();
+        Report("yield", {{"threads", Param(threads)}, {"fibers", Param(fibers)}}, fibers * rounds, ElapsedNs(begin));
+    }
+
+    // pairs对协程各自互相唤醒rounds次
+    void BenchWake(size_t threads, uint64_t pairs, uint64_t rounds)
+    {
+        sylar::Scheduler scheduler(threads, "bench");
+        std::vector<sylar::Fiber::ptr> fibers(pairs * 2);
+        for (uint64_t p = 0; p < pairs; ++p)
+        {
+            sylar::Fiber::ptr &ping = fibers[p * 2];
+            sylar::Fiber::ptr &pong = fibers[p * 2 + 1];
+            pong = std::make_shared<sylar::Fiber>([&ping, rounds]()
+                                                  {
+                                                      for (uint64_t i = 1; i <= rounds; ++i)
+                                                      {
+                                                          sylar::Scheduler::GetThis()->schedule(ping);
+                                                          if (i < rounds)
+                                                          {
+                                                              sylar::Fiber::Yield();
+                                                          }
+                                                      } });
+            ping = std::make_shared<sylar::Fiber>([&pong, rounds]()
+                                                  {
+                                                      for (uint64_t i = 0; i < rounds; ++i)
+                                                      {
+                                                          sylar::Scheduler::GetThis()->schedule(pong);
+                                                          sylar::Fiber::Yield();
+                                                      } });
+        }
+        scheduler.start();
+        auto begin = Clock::now();
+        for (uint64_t p = 0; p < pairs; ++p)
+        {
+            scheduler.schedule(fibers[p * 2]);
+        }
+        scheduler.stop();
+        Report("wake", {{"threads", Param(threads)}, {"pairs", Param(pairs)}}, pairs * rounds * 2, ElapsedNs(begin));
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    bench::Options opt = bench::ParseArgs(argc, argv);
+    const bool quick = opt.quick;
+
+    const uint64_t tasks = quick ? 100000 : 1000000;
+    const int depth = quick ? 5 : 7;
+    const uint64_t rounds = quick ? 1000 : 10000;
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> threadCounts;
+    for (size_t n = 1; n < cores; n *= 2)
+    {
+        threadCounts.push_back(n);
+    }
+    threadCounts.push_back(cores);
+
+    for (size_t threads : threadCounts)
+    {
+        BenchSpawn(threads, tasks);
+        BenchFanout(threads, depth);
+        BenchYield(threads, threads * 16, rounds);
+        BenchWake(threads, threads, rounds * 10);
+    }
+
+    return bench::WriteResults(opt);
+}
@@ -0,0 +1,123 @@
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * 基准测试共用的计时和结果输出, 各 bench_*.cpp 包含使用
+ * 命令行: [-o result.json] [-q]    -o: JSON写入文件(默认标准输出), -q: 只跑小规模用例
+ * 每个用例的结果在标准错误上打印一行, 全部结束后输出JSON便于回归对比
+ */
+namespace bench
+{
+    using Clock = std::chrono::steady_clock;
+    using Params = std::vector<std::pair<std::string, std::string>>;
+
+    inline uint64_t ElapsedNs(Clock::time_point begin)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+    }
+
+    // 防止被测代码被优化掉
+    inline std::atomic<uint64_t> &Sink()
+    {
+        static std::atomic<uint64_t> s_sink(0);
+        return s_sink;
+    }
+
+    struct Result
+    {
+        std::string name;
+        Params params;
+        uint64_t ops;
+        uint64_t totalNs;
+    };
+
+    inline std::vector<Result> &Results()
+    {
+        static std::vector<Result> s_results;
+        return s_results;
+    }
+
+    inline void Report(const std::string &name, const Params &params, uint64_t ops, uint64_t totalNs)
+    {
+        Results().push_back(Result{name, params, ops, totalNs});
+        std::cerr << name;
+        for (auto &i : params)
+        {
+            std::cerr << " " << i.first << "=" << i.second;
+        }
+        std::cerr << ": " << (ops ? totalNs / ops : 0) << " ns/op" << std::endl;
+    }
+
+    inline std::string ToJson()
+    {
+        const std::vector<Result> &results = Results();
+        std::stringstream ss;
+        ss << "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &r = results[i];
+            ss << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"params\": {";
+            for (size_t j = 0; j < r.params.size(); ++j)
+            {
+                ss << (j ? ", " : "") << "\"" << r.params[j].first << "\": " << r.params[j].second;
+            }
+            ss << "}, \"ops\": " << r.ops << ", \"total_ns\": " << r.totalNs
+               << ", \"ns_per_op\": " << (r.ops ? static_cast<double>(r.totalNs) / r.ops : 0.0)
+               << ", \"ops_per_sec\": " << (r.totalNs ? r.ops * 1e9 / r.totalNs : 0.0) << "}";
+        }
+        ss << "\n  ]\n}\n";
+        return ss.str();
+    }
+
+    inline std::string Param(uint64_t v) { return std::to_string(v); }
+
+    struct Options
+    {
+        std::string output; // JSON输出文件, 为空时输出到标准输出
+        bool quick = false; // 只跑小规模用例
+    };
+
+    inline Options ParseArgs(int argc, char const *argv[])
+    {
+        Options opt;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "-o" && i + 1 < argc)
+            {
+                opt.output = argv[++i];
+            }
+            else if (arg == "-q")
+            {
+                opt.quick = true;
+            }
+        }
+        return opt;
+    }
+
+    // 输出全部结果, 作为main的返回值
+    inline int WriteResults(const Options &opt)
+    {
+        std::string json = ToJson();
+        if (opt.output.empty())
+        {
+            std::cout << json;
+            return 0;
+        }
+        std::ofstream ofs(opt.output);
+        ofs << json;
+        return ofs ? 0 : 1;
+    }
+}
+
+#endif // __BENCH_UTIL_H__
@@ -1,6 +1,11 @@
 #include "../sylar/config/config.h"
+#include "../sylar/config/config_watcher.h"
+#include "../sylar/config/config_snapshot.h"
 #include "sylar/log/log.h"
 #include "yaml-cpp/yaml.h"
+#include "test_helper.h"
+#include <sys/stat.h>
+#include <unistd.h>
 
 sylar::ConfigVar<int>::ptr gIntValueConfig =
     sylar::Config::Lookup("system.port", static_cast<int>(8080), "system port");
@@ -31,6 +36,8 @@ sylar::ConfigVar<std::unordered_map<std::string, int>>::ptr gStrIntUMapValueConf
     sylar::Config::Lookup("system.str_int_umap", std::unordered_map<std::string, int>{{"key", 12}, {"key", 12}},
                           "system str int umap");
 
+using testing::check;
+
 void print_yaml(const YAML::Node &node, int level)
 {
     if (node.IsNull())
@@ -114,6 +121,20 @@ void test_config()
     LOG_INFO(LOG_ROOT) << "after: " << gIntValueConfig->getValue();
     LOG_INFO(LOG_ROOT) << "after: " << gFloatValueConfig->toString();
 
+    // get() 返回快照句柄, 不拷贝容器; 句柄持有期间值保持不变
+    auto vec = gIntVecValueConfig->get();
+    LOG_INFO(LOG_ROOT) << "after: int_vec size = " << vec->size()
+                       << " port = " << *gIntValueConfig->get();
+
+    // 字面量名称的哈希在编译期计算, 查找时不分配内存
+    auto port = sylar::Config::Lookup<int>(SYLAR_CONFIG("system.port"));
+    LOG_INFO(LOG_ROOT) << "lookup by SYLAR_CONFIG: " << (port ? port->toString() : "null");
+
+    // 线程本地缓存: 版本号未变化时直接返回缓存值
+    static thread_local sylar::CachedConfig<std::vector<int>> s_int_vec(gIntVecValueConfig);
+    LOG_INFO(LOG_ROOT) << "cached int_vec size = " << s_int_vec->size()
+                       << " epoch = " << sylar::Config::GetEpoch();
+
     XX(gIntVecValueConfig, int_vec, after);
     XX(gIntListValueConfig, int_list, after);
     XX(gIntSetValueConfig, int_set, after);
@@ -150,42 +171,11 @@ public:
     }
 };
 
-// 对自定义类型进行LexicalCast偏特化
-namespace sylar
-{
-    template <>
-    class LexicalCast<std::string, Person>
-    {
-    public:
-        Person operator()(const std::string &val)
-        {
-            YAML::Node node = YAML::Load(val);
-            Person p;
-            p.m_name = node["name"].as<std::string>();
-            p.m_age = node["age"].as<int>();
-            p.m_sex = node["sex"].as<bool>();
-            return p;
-        }
-    };
-
-    template <>
-    class LexicalCast<Person, std::string>
-    {
-    public:
-        std::string operator()(const Person &p)
-        {
-            YAML::Node node;
-            node["name"] = p.m_name;
-            node["age"] = p.m_age;
-            node["sex"] = p.m_sex;
-            std::stringstream ss;
-            ss << node;
-            return ss.str();
-        }
-    };
-}
+// 声明字段表, 生成NodeCast/LexicalCast等特化, 按字段直接读写YAML, 不经过中间字符串; 成员名与键名不同时用SYLAR_CONFIG_FIELD映射
+SYLAR_CONFIG_STRUCT(Person, SYLAR_CONFIG_FIELD(m_name, "name"), SYLAR_CONFIG_FIELD(m_age, "age"),
+                    SYLAR_CONFIG_FIELD(m_sex, "sex"))
 
-// 如果想要使用自定义类型的配置项，需要对自定义类型进行LexicalCast偏特化
+// 如果想要使用自定义类型的配置项，需要对自定义类型进行LexicalCast偏特化(或使用SYLAR_CONFIG_STRUCT)
 sylar::ConfigVar<Person>::ptr g_person =
     sylar::Config::Lookup("class.person", Person(), "class person");
 
@@ -196,6 +186,36 @@ sylar::ConfigVar<std::map<std::string, Person>>::ptr g_person_map =
 sylar::ConfigVar<std::map<std::string, std::vector<Person>>>::ptr g_person_vec_map =
     sylar::Config::Lookup("class.vec_map", std::map<std::string, std::vector<Person>>(), "class person");
 
+// 两种写法混用
+struct Point
+{
+    int x = 0;
+    int m_y = 0;
+
+    bool operator==(const Point &rhs) const { return x == rhs.x && m_y == rhs.m_y; }
+};
+
+SYLAR_CONFIG_STRUCT(Point, x, SYLAR_CONFIG_FIELD(m_y, "y"))
+
+sylar::ConfigVar<Point>::ptr g_point =
+    sylar::Config::Lookup("class.point", Point(), "class point");
+
+void test_struct_field()
+{
+    YAML::Node root = YAML::Load("class:\n"
+                                 "  person: {name: p9, age: 39, sex: true}\n"
+                                 "  point: {x: 1, y: 2}\n");
+    sylar::Config::LoadFromYaml(root);
+    const Person &p = *g_person->get();
+    check(p.m_name == "p9" && p.m_age == 39 && p.m_sex, "person fields = " + p.toString());
+    check(g_point->getValue().x == 1 && g_point->getValue().m_y == 2, "point = " + g_point->toString());
+
+    // 序列化使用映射后的键名
+    YAML::Node out = YAML::Load(g_person->toString());
+    check(out["name"].as<std::string>() == "p9" && !out["m_name"], "person yaml = " + g_person->toString());
+    check(YAML::Load(g_point->toString())["y"].as<int>() == 2, "point yaml = " + g_point->toString());
+}
+
 void test_class()
 {
     LOG_INFO(LOG_ROOT) << "before: " << g_person->getValue().toString() << " - " << g_person->toString();
@@ -219,6 +239,7 @@ void test_class()
 
     YAML::Node root = YAML::LoadFile("../bin/conf/testConfig.yml");
     sylar::Config::LoadFromYaml(root);
+    sylar::Config::WaitListeners();
 
     LOG_INFO(LOG_ROOT) << "after: " << g_person->getValue().toString() << " - " << g_person->toString();
     XX_PM(g_person_map, "class.map after");
@@ -232,6 +253,8 @@ void test_log_yaml_config()
     std::cout << sylar::LoggerMgr::GetInstance()->toYamlString() << std::endl;
     YAML::Node root = YAML::LoadFile("../bin/conf/log.yaml");
     sylar::Config::LoadFromYaml(root);
+    // 回调(LogInitializer)在配置回调线程中执行, 等待日志配置生效
+    sylar::Config::WaitListeners();
     std::cout << "======================================" << std::endl;
     std::cout << sylar::LoggerMgr::GetInstance()->toYamlString() << std::endl;
     std::cout << "======================================" << std::endl;
@@ -242,6 +265,293 @@ void test_log_yaml_config()
     LOG_INFO(system_log) << "hello system" << std::endl;
 }
 
+static void write_file(const std::string &path, const std::string &content)
+{
+    std::ofstream ofs(path, std::ios_base::out | std::ios_base::trunc);
+    ofs << content;
+}
+
+void test_dotted_key()
+{
+    // 顶层的扁平写法按段查找, 与嵌套写法等价; 非法名称只报错, 不影响其余配置
+    YAML::Node root = YAML::Load("system.port: 9900\n"
+                                 "SYSTEM.Value: 3.5\n"
+                                 "system:\n"
+                                 "  int_vec.bad-name: [1]\n"
+                                 "  int_list: [7]\n"
+                                 "system.unknown.port: 1\n");
+    sylar::Config::LoadFromYaml(root);
+    check(gIntValueConfig->getValue() == 9900, "dotted system.port = " + gIntValueConfig->toString());
+    check(gFloatValueConfig->getValue() == 3.5f, "dotted system.value = " + gFloatValueConfig->toString());
+    check(gIntListValueConfig->getValue() == std::list<int>{7}, "nested int_list = " + gIntListValueConfig->toString());
+}
+
+void test_transaction()
+{
+    std::atomic<int> calls(0);
+    std::atomic<bool> consistent(true);
+    gIntValueConfig->addListener(30, [&calls, &consistent](const int &oldValue, const int &newValue)
+                                 {
+                                     ++calls;
+                                     if (newValue == 9901 && gFloatValueConfig->getValue() != 1.5f)
+                                     {
+                                         consistent = false;
+                                     }
+                                     LOG_INFO(LOG_ROOT) << "system.port: " << oldValue << " -> " << newValue
+                                                        << " system.value: " << gFloatValueConfig->getValue();
+                                 });
+
+    // 两个配置项同时生效, 回调中读到的system.value已经是新值
+    uint64_t epoch = sylar::Config::GetEpoch();
+    bool changed = sylar::Config::Transaction()
+                       .set(gIntValueConfig, 9901)
+                       .set(gFloatValueConfig, 1.5f)
+                       .commit();
+    sylar::Config::WaitListeners();
+    check(changed, "transaction changed");
+    check(sylar::Config::GetEpoch() == epoch + 2, "transaction epoch advanced by one version");
+    check(calls == 1 && consistent, "transaction listener calls = " + std::to_string(calls.load()));
+
+    // 没有值变化的提交不改变版本号, 各线程的 CachedConfig 不会失效
+    epoch = sylar::Config::GetEpoch();
+    gIntValueConfig->setValue(9901);
+    sylar::Config::LoadFromYaml(YAML::Load("unknown_section:\n  key: 1\n"));
+    check(!sylar::Config::Transaction().set(gFloatValueConfig, 1.5f).commit(), "no-op transaction changed");
+    check(sylar::Config::GetEpoch() == epoch, "no-op commits advanced epoch " + std::to_string(epoch) +
+                                                  " -> " + std::to_string(sylar::Config::GetEpoch()));
+
+    // 任意一项转换失败, 整个事务不提交
+    changed = sylar::Config::Transaction()
+                  .setString(gIntValueConfig, "not a number")
+                  .set(gFloatValueConfig, 2.5f)
+                  .commit();
+    check(!changed && gFloatValueConfig->getValue() == 1.5f, "bad transaction committed");
+
+    // 配置项为空同样使事务失败
+    sylar::ConfigVar<int>::ptr nullVar;
+    sylar::Config::Transaction tx;
+    tx.set(nullVar, 1).set(gFloatValueConfig, 3.5f);
+    check(tx.failed(), "null var marks transaction failed");
+    check(!tx.commit() && gFloatValueConfig->getValue() == 1.5f, "null var transaction committed");
+    sylar::Config::WaitListeners();
+    gIntValueConfig->delListener(30);
+
+    // 版本号相同的CachedConfig来自同一次提交
+    std::atomic<bool> stop(false);
+    std::atomic<int> mismatches(0);
+    std::thread reader([&stop, &mismatches]()
+                       {
+                           sylar::CachedConfig<int> port(gIntValueConfig);
+                           sylar::CachedConfig<float> value(gFloatValueConfig);
+                           while (!stop)
+                           {
+                               int p = *port;
+                               float v = *value;
+                               if (port.getEpoch() == value.getEpoch() && static_cast<float>(p) != v)
+                               {
+                                   ++mismatches;
+                               }
+                           }
+                       });
+    for (int i = 0; i < 20000; ++i)
+    {
+        sylar::Config::Transaction().set(gIntValueConfig, i).set(gFloatValueConfig, static_cast<float>(i)).commit();
+    }
+    stop = true;
+    reader.join();
+    check(mismatches == 0, "cached config mismatches = " + std::to_string(mismatches.load()));
+
+    sylar::Config::WaitListeners();
+    for (auto &i : sylar::Config::GetListenerStats())
+    {
+        LOG_INFO(LOG_ROOT) << "listener " << i.name << "#" << i.key << " count = " << i.count
+                           << " total = " << i.totalUs << "us max = " << i.maxUs << "us";
+    }
+}
+
+void test_diff_listener()
+{
+    gStrIntMapValueConfig->setValue(std::map<std::string, int>{{"key", 12}});
+    sylar::Config::WaitListeners();
+
+    std::vector<std::string> events;
+    gStrIntMapValueConfig->addDiffListener(40, [&events](const sylar::ConfigDiff<std::map<std::string, int>> &diff)
+                                           {
+                                               for (auto &i : diff.added)
+                                               {
+                                                   events.push_back("added " + i.first + "=" + std::to_string(i.second));
+                                               }
+                                               for (auto &i : diff.removed)
+                                               {
+                                                   events.push_back("removed " + i.first);
+                                               }
+                                               for (auto &i : diff.changed)
+                                               {
+                                                   events.push_back("changed " + i.key + " " + std::to_string(i.oldValue) +
+                                                                    "->" + std::to_string(i.newValue));
+                                               }
+                                           });
+
+    auto m = gStrIntMapValueConfig->getValue();
+    m["key"] += 1;
+    m["k_new"] = 100;
+    gStrIntMapValueConfig->setValue(m);
+
+    m.erase("k_new");
+    gStrIntMapValueConfig->setValue(m);
+
+    // 值没有变化时不回调
+    gStrIntMapValueConfig->setValue(m);
+    sylar::Config::WaitListeners();
+    gStrIntMapValueConfig->delListener(40);
+
+    std::vector<std::string> expected{"added k_new=100", "changed key 12->13", "removed k_new"};
+    std::string got;
+    for (auto &i : events)
+    {
+        got += i + "; ";
+    }
+    check(events == expected, "diff listener events: " + got);
+}
+
+void test_snapshot()
+{
+    std::vector<std::string> sources{"../bin/conf/testConfig.yml"};
+    remove("testConfig.snapshot");
+
+    // 第一次加载解析YAML并生成快照, 之后源文件不变时直接应用快照
+    check(sylar::ConfigSnapshot::Load("testConfig.snapshot", sources), "snapshot first load");
+    sylar::ConfigSnapshot::ptr snapshot = sylar::ConfigSnapshot::Open("testConfig.snapshot");
+    check(snapshot && snapshot->size() > 0, "snapshot open");
+    check(snapshot && !snapshot->isStale(), "snapshot fresh");
+
+    gIntVecValueConfig->setValue(std::vector<int>{});
+    g_person_map->setValue(std::map<std::string, Person>());
+    check(sylar::ConfigSnapshot::Load("testConfig.snapshot", sources), "snapshot second load");
+    check(gIntVecValueConfig->getValue() == std::vector<int>({10, 20, 30}),
+          "from snapshot: int_vec = " + gIntVecValueConfig->toString());
+    check(g_person_map->get()->size() == 2 && g_person_map->get()->at("person2").m_age == 20,
+          "from snapshot: class.map = " + g_person_map->toString());
+
+    // 源文件变化后快照过期
+    std::ifstream ifs(sources[0]);
+    std::stringstream content;
+    content << ifs.rdbuf();
+    write_file("snapshot_src.yml", content.str());
+    check(sylar::ConfigSnapshot::Compile("snapshot_src.snapshot", std::vector<std::string>(1, "snapshot_src.yml")),
+          "snapshot compile");
+    write_file("snapshot_src.yml", content.str() + "\n");
+    snapshot = sylar::ConfigSnapshot::Open("snapshot_src.snapshot");
+    check(snapshot && snapshot->isStale(), "snapshot stale after source changed");
+
+    remove("snapshot_src.yml");
+    remove("snapshot_src.snapshot");
+}
+
+void test_load_dir()
+{
+    // 目录下的文件并行解析, 按文件名顺序合并后一次性应用
+    const std::string dir = "load_dir_test";
+    mkdir(dir.c_str(), 0755);
+    write_file(dir + "/10-base.yml", "system:\n  port: 7000\n  value: 7.5\n");
+    write_file(dir + "/20-override.yaml", "system.port: 7001\n");
+    write_file(dir + "/30-ignored.txt", "system.port: 7002\n");
+    write_file(dir + "/.hidden.yml", "system.port: 7003\n");
+
+    bool ok = sylar::Config::LoadFromDir(dir);
+    sylar::Config::WaitListeners();
+    check(ok, "load dir");
+    check(gIntValueConfig->getValue() == 7001, "load dir system.port = " + gIntValueConfig->toString());
+    check(gFloatValueConfig->getValue() == 7.5f, "load dir system.value = " + gFloatValueConfig->toString());
+
+    // 任意一个文件解析失败时整体不加载
+    write_file(dir + "/15-broken.yml", "system: [unclosed\n");
+    write_file(dir + "/10-base.yml", "system:\n  port: 8000\n");
+    ok = sylar::Config::LoadFromDir(dir);
+    check(!ok, "load dir with broken file");
+    check(gIntValueConfig->getValue() == 7001, "broken load dir system.port = " + gIntValueConfig->toString());
+
+    for (const char *name : {"10-base.yml", "15-broken.yml", "20-override.yaml", "30-ignored.txt", ".hidden.yml"})
+    {
+        remove((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+// 记录打印"ConfigWatcher reload"的线程, 用来确认加载不在全局定时器线程上执行
+class ReloadThreadAppender : public sylar::LogAppender
+{
+public:
+    void log(std::shared_ptr<sylar::Logger> logger, sylar::LogLevel::Level level, sylar::LogEvent::ptr event) override
+    {
+        if (event->getContent().find("ConfigWatcher reload") != std::string::npos)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_threads.push_back(event->getThreadName());
+        }
+    }
+
+    void toYamlFields(YAML::Emitter &out) override
+    {
+        out << YAML::Key << "type" << YAML::Value << "ReloadThreadAppender";
+    }
+
+    std::vector<std::string> getThreads()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_threads;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::string> m_threads;
+};
+
+void test_config_watcher()
+{
+    const std::string path = "watcher_test.yml";
+    write_file(path, "system:\n  port: 1000\n");
+    sylar::Config::LoadFromFiles(std::vector<std::string>(1, path));
+    sylar::Config::WaitListeners();
+
+    std::atomic<int> changes(0);
+    gIntValueConfig->addListener(20, [&changes](const int &oldValue, const int &newValue)
+                                 {
+                                     ++changes;
+                                     LOG_INFO(LOG_ROOT) << "system.port changed: " << oldValue << " -> " << newValue;
+                                 });
+
+    std::shared_ptr<ReloadThreadAppender> reloads(new ReloadThreadAppender);
+    LOG_ROOT->addAppender(reloads);
+
+    // 防抖时间内的连续写入合并为一次加载
+    sylar::ConfigWatcher watcher(path, 200);
+    check(watcher.start(), "watcher start");
+    for (int i = 1; i <= 5; ++i)
+    {
+        write_file(path, "system:\n  port: " + std::to_string(1000 + i) + "\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+    sylar::Config::WaitListeners();
+    check(gIntValueConfig->getValue() == 1005, "watcher system.port = " + gIntValueConfig->toString());
+    check(changes == 1, "watcher reloads = " + std::to_string(changes.load()));
+    std::vector<std::string> threads = reloads->getThreads();
+    check(threads == std::vector<std::string>(1, "config_watcher"),
+          "watcher reload thread = " + (threads.empty() ? std::string("none") : threads.front()));
+
+    // 停止后不再加载
+    watcher.stop();
+    write_file(path, "system:\n  port: 2000\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    sylar::Config::WaitListeners();
+    check(gIntValueConfig->getValue() == 1005, "watcher stopped, system.port = " + gIntValueConfig->toString());
+
+    LOG_ROOT->delAppender(reloads);
+    gIntValueConfig->delListener(20);
+    remove(path.c_str());
+}
+
 int main(int argc, char const *argv[])
 {
 
@@ -249,6 +559,13 @@ int main(int argc, char const *argv[])
     //test_config();
     //test_class();
     test_log_yaml_config();
-
-    return 0;
+    test_dotted_key();
+    test_config_watcher();
+    test_transaction();
+    test_diff_listener();
+    test_snapshot();
+    test_load_dir();
+    test_struct_field();
+
+    return testing::Finish();
 }
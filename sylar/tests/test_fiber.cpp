@@ -0,0 +1,124 @@
+#include "../sylar/fiber/fiber.h"
+#include "../sylar/thread/thread.h"
+#include "../sylar/log/log.h"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = LOG_ROOT;
+
+void run_in_fiber()
+{
+    LOG_INFO(g_logger) << "run_in_fiber begin";
+    sylar::Fiber::Yield();
+    LOG_INFO(g_logger) << "run_in_fiber end";
+}
+
+// 日志中的协程id随当前协程变化
+void test_fiber()
+{
+    LOG_INFO(g_logger) << "main begin";
+    sylar::Fiber::ptr fiber(new sylar::Fiber(&run_in_fiber));
+    fiber->resume();
+    LOG_INFO(g_logger) << "main after resume, state = " << fiber->getState();
+    fiber->resume();
+    LOG_INFO(g_logger) << "main after end, state = " << fiber->getState();
+
+    fiber->reset([]()
+                 { throw std::runtime_error("boom"); });
+    fiber->resume();
+    LOG_INFO(g_logger) << "main after exception, state = " << fiber->getState();
+}
+
+static sylar::FiberLocal<int> g_local;
+
+// 每个协程各有一份局部变量, 协程切换不影响彼此的值
+void test_fiber_local()
+{
+    *g_local = -1;
+    std::vector<sylar::Fiber::ptr> fibers;
+    for (int i = 0; i < 3; ++i)
+    {
+        fibers.push_back(std::make_shared<sylar::Fiber>([i]()
+                                                        {
+                                                            g_local.set(i);
+                                                            sylar::Fiber::Yield();
+                                                            LOG_INFO(g_logger) << "local = " << *g_local << " expect " << i;
+                                                        }));
+    }
+    for (auto &f : fibers)
+    {
+        f->resume();
+    }
+    for (auto &f : fibers)
+    {
+        f->resume();
+    }
+    LOG_INFO(g_logger) << "main local = " << *g_local << " expect -1";
+}
+
+// 大量协程反复切换, 统计切换耗时和栈缓存
+void test_many_fibers()
+{
+    const int count = 10000;
+    const int rounds = 10;
+    std::vector<sylar::Fiber::ptr> fibers;
+    for (int i = 0; i < count; ++i)
+    {
+        fibers.push_back(std::make_shared<sylar::Fiber>([rounds]()
+                                                        {
+                                                            for (int r = 0; r < rounds; ++r)
+                                                            {
+                                                                sylar::Fiber::Yield();
+                                                            }
+                                                        },
+                                                        32 * 1024));
+    }
+    LOG_INFO(g_logger) << "total fibers = " << sylar::Fiber::TotalFibers();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r <= rounds; ++r)
+    {
+        for (auto &f : fibers)
+        {
+            f->resume();
+        }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    // 每次resume包含切入和切出两次切换
+    LOG_INFO(g_logger) << "resume+yield: " << ns / (count * (rounds + 1)) << " ns";
+
+    fibers.clear();
+    LOG_INFO(g_logger) << "total fibers = " << sylar::Fiber::TotalFibers()
+                       << " cached stacks = " << sylar::FiberStack::CachedCount();
+}
+
+// 在一个线程上yield的协程在另一个线程上恢复
+void test_migrate()
+{
+    sylar::Fiber::ptr fiber(new sylar::Fiber([]()
+                                             {
+                                                 LOG_INFO(g_logger) << "before yield";
+                                                 sylar::Fiber::Yield();
+                                                 LOG_INFO(g_logger) << "after yield";
+                                             }));
+    sylar::Thread t1([fiber]()
+                     { fiber->resume(); },
+                     "fiber_1");
+    t1.join();
+    sylar::Thread t2([fiber]()
+                     { fiber->resume(); },
+                     "fiber_2");
+    t2.join();
+    LOG_INFO(g_logger) << "migrate state = " << fiber->getState();
+}
+
+int main(int argc, char const *argv[])
+{
+    test_fiber();
+    test_fiber_local();
+    test_many_fibers();
+    test_migrate();
+    return 0;
+}
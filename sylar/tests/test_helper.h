@@ -0,0 +1,44 @@
+#ifndef __TEST_HELPER_H__
+#define __TEST_HELPER_H__
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+/**
+ * 功能测试共用的断言, 各 test_*.cpp 包含使用
+ * check 失败时打印原因并记录, 不中止测试; main 最后 return testing::Finish() 输出 OK/FAILED 并返回退出码.
+ * check 可以在工作线程、定时器回调中调用
+ */
+namespace testing
+{
+    inline std::atomic<bool> &FailedFlag()
+    {
+        static std::atomic<bool> s_failed(false);
+        return s_failed;
+    }
+
+    // 到目前为止是否有检查失败
+    inline bool Failed()
+    {
+        return FailedFlag().load();
+    }
+
+    inline void check(bool cond, const std::string &msg)
+    {
+        if (!cond)
+        {
+            FailedFlag() = true;
+            std::cout << "FAILED: " << msg << std::endl;
+        }
+    }
+
+    // 输出总结果, 返回进程退出码
+    inline int Finish()
+    {
+        std::cout << (Failed() ? "FAILED" : "OK") << std::endl;
+        return Failed() ? 1 : 0;
+    }
+}
+
+#endif // __TEST_HELPER_H__
@@ -0,0 +1,174 @@
+#include "../sylar/util/lockfree_queue.h"
+#include "../sylar/thread/mutex.h"
+#include "test_helper.h"
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 无锁队列压力测试, 建议以 -DSYLAR_TSAN=ON 构建后运行
+ * 每个元素编码为 (生产者编号 << 32 | 序号), 校验不丢、不重、每个生产者内部有序
+ */
+
+static const uint64_t kItemsPerProducer = 200000;
+using testing::check;
+
+// 生产者不断重试直到入队成功
+template <typename Q>
+static void produce(Q &queue, uint64_t producer)
+{
+    for (uint64_t i = 0; i < kItemsPerProducer; ++i)
+    {
+        uint64_t val = (producer << 32) | i;
+        sylar::SpinBackoff backoff;
+        while (!queue.tryPush(val))
+        {
+            backoff.pause();
+        }
+    }
+}
+
+/**
+ * consumers个消费者各自批量取出, 统计每个生产者的元素;
+ * 同一个消费者看到的同一生产者的元素必须递增
+ */
+template <typename Q>
+static void run(const std::string &name, Q &queue, size_t producers, size_t consumers, size_t batch)
+{
+    const uint64_t total = kItemsPerProducer * producers;
+    std::atomic<uint64_t> consumed(0);
+    std::vector<std::unique_ptr<std::atomic<uint64_t>>> counts;
+    std::vector<std::unique_ptr<std::atomic<uint64_t>>> sums;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        counts.emplace_back(new std::atomic<uint64_t>(0));
+        sums.emplace_back(new std::atomic<uint64_t>(0));
+    }
+    std::atomic<bool> orderOk(true);
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < consumers; ++c)
+    {
+        threads.push_back(std::thread([&]()
+                                      {
+                                          std::vector<uint64_t> buf(batch);
+                                          std::vector<int64_t> last(producers, -1);
+                                          sylar::SpinBackoff backoff;
+                                          while (consumed.load(std::memory_order_relaxed) < total)
+                                          {
+                                              size_t n = queue.popBatch(buf.begin(), batch);
+                                              if (n == 0)
+                                              {
+                                                  backoff.pause();
+                                                  continue;
+                                              }
+                                              for (size_t i = 0; i < n; ++i)
+                                              {
+                                                  uint64_t p = buf[i] >> 32;
+                                                  int64_t seq = buf[i] & 0xffffffff;
+                                                  if (p >= producers || seq <= last[p])
+                                                  {
+                                                      orderOk = false;
+                                                      continue;
+                                                  }
+                                                  last[p] = seq;
+                                                  ++*counts[p];
+                                                  *sums[p] += seq;
+                                              }
+                                              consumed += n;
+                                          }
+                                      }));
+    }
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.push_back(std::thread([&queue, p]()
+                                      { produce(queue, p); }));
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    check(orderOk, name + " per-producer order");
+    for (size_t p = 0; p < producers; ++p)
+    {
+        check(*counts[p] == kItemsPerProducer, name + " count of producer " + std::to_string(p));
+        check(*sums[p] == kItemsPerProducer * (kItemsPerProducer - 1) / 2,
+              name + " checksum of producer " + std::to_string(p));
+    }
+    uint64_t rest;
+    check(!queue.tryPop(rest), name + " queue drained");
+    std::cout << name << " producers=" << producers << " consumers=" << consumers
+              << " batch=" << batch << (testing::Failed() ? " FAILED" : " ok") << std::endl;
+}
+
+void test_spsc()
+{
+    for (size_t batch : {1, 64})
+    {
+        sylar::SpscQueue<uint64_t> queue(1024);
+        run("spsc", queue, 1, 1, batch);
+    }
+}
+
+void test_mpsc()
+{
+    for (size_t batch : {1, 64})
+    {
+        sylar::MpscQueue<uint64_t> queue(1024);
+        run("mpsc", queue, 4, 1, batch);
+    }
+}
+
+void test_mpmc()
+{
+    for (size_t batch : {1, 64})
+    {
+        sylar::MpmcQueue<uint64_t> queue(1024);
+        run("mpmc", queue, 4, 4, batch);
+    }
+}
+
+// 满/空边界、容量取整、非平凡类型的构造与析构
+void test_boundary()
+{
+    sylar::SpscQueue<std::string> spsc(3);
+    check(spsc.capacity() == 4, "spsc capacity rounds up");
+    for (int i = 0; i < 4; ++i)
+    {
+        check(spsc.tryPush(std::string(32, 'a' + i)), "spsc push until full");
+    }
+    check(!spsc.tryPush(std::string("x")), "spsc push when full");
+    std::string s;
+    check(spsc.tryPop(s) && s == std::string(32, 'a'), "spsc pop fifo");
+    check(spsc.tryPush(std::string("e")), "spsc push after pop");
+
+    sylar::MpmcQueue<std::shared_ptr<int>> mpmc(2);
+    std::shared_ptr<int> sp = std::make_shared<int>(7);
+    check(mpmc.tryPush(sp) && mpmc.tryPush(sp), "mpmc push until full");
+    check(!mpmc.tryPush(sp), "mpmc push when full");
+    check(sp.use_count() == 3, "mpmc holds copies");
+    {
+        sylar::MpscQueue<std::shared_ptr<int>> mpsc(4);
+        mpsc.tryPush(sp);
+        check(sp.use_count() == 4, "mpsc holds copy");
+    }
+    check(sp.use_count() == 3, "mpsc destructor releases rest");
+
+    std::vector<std::shared_ptr<int>> out(4);
+    check(mpmc.popBatch(out.begin(), 4) == 2, "mpmc batch pops available");
+    check(!mpmc.tryPop(out[0]), "mpmc empty after batch");
+    std::cout << "boundary" << (testing::Failed() ? " FAILED" : " ok") << std::endl;
+}
+
+int main(int argc, char const *argv[])
+{
+    test_boundary();
+    test_spsc();
+    test_mpsc();
+    test_mpmc();
+    return testing::Finish();
+}
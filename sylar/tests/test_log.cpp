@@ -24,6 +24,68 @@ int main(int argc, char *argv[])
     FMT_LOG_DEBUG(logger1, "a new formatter pattern %s", "by程荣");
     LOG_INFO(logger1) << "hello world,你好世界。" << std::endl;
 
+    // 飞行记录仪模式: 缓存最近4条日志, INFO照常输出, DEBUG只缓存, 出现ERROR时补输出缓存中的DEBUG日志
+    sylar::Logger::ptr logger2(new sylar::Logger("flight"));
+    sylar::RingBufferLogAppender::ptr ring(new sylar::RingBufferLogAppender(4));
+    ring->addAppender(sylar::LogAppender::ptr(new sylar::StdoutLogAppender));
+    logger2->addAppender(ring);
+    for (int i = 0; i < 8; ++i)
+    {
+        LOG_DEBUG(logger2) << "flight debug " << i;
+    }
+    LOG_INFO(logger2) << "flight info";
+    LOG_ERROR(logger2) << "flight error, dump debug 5~7 cached before it";
+
+    // 重复日志折叠: 5秒内相同调用点的相同内容只输出一次
+    sylar::Logger::ptr logger3(new sylar::Logger("dedup"));
+    logger3->addAppender(sylar::LogAppender::ptr(new sylar::DedupLogAppender(
+        sylar::LogAppender::ptr(new sylar::StdoutLogAppender), 5)));
+    for (int i = 0; i < 1000; ++i)
+    {
+        LOG_WARN(logger3) << "upstream connect failed";
+    }
+    LOG_INFO(logger3) << "upstream recovered";
+
+    // 窗口结束后即使没有新的日志也会输出折叠条数
+    sylar::Logger::ptr logger7(new sylar::Logger("dedup_window"));
+    logger7->addAppender(sylar::LogAppender::ptr(new sylar::DedupLogAppender(
+        sylar::LogAppender::ptr(new sylar::StdoutLogAppender), 1)));
+    for (int i = 0; i < 100; ++i)
+    {
+        LOG_WARN(logger7) << "disk almost full";
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2100));
+
+    // 结构化字段 + JSON格式器
+    sylar::Logger::ptr logger4(new sylar::Logger("json"));
+    logger4->setFormatter("json");
+    logger4->addAppender(sylar::LogAppender::ptr(new sylar::StdoutLogAppender));
+    LOG_INFO(logger4).kv("user", 1001).kv("ms", 3.25).kv("ok", true).kv("path", "/a\"b\\c\n")
+        << "request done, 0123456789abcdefghijklmnopqrstuvwxyz \"quoted\"";
+
+    // 诊断上下文: %X 输出全部, %X{key} 输出指定键
+    sylar::Logger::ptr logger5(new sylar::Logger("mdc"));
+    logger5->setFormatter("%d%T[%p]%T[%X]%T%X{tenant}%T%m%n");
+    logger5->addAppender(sylar::LogAppender::ptr(new sylar::StdoutLogAppender));
+    {
+        sylar::MDC::Guard g1("request_id", "r-42");
+        sylar::MDC::Guard g2("tenant", "acme");
+        LOG_INFO(logger5) << "inside request";
+        LOG_INFO(logger4) << "json with mdc";
+    }
+    LOG_INFO(logger5) << "outside request";
+
+    // 压缩文件输出, 可用 zcat log.txt.gz 查看
+    {
+        sylar::Logger::ptr logger6(new sylar::Logger("gzip"));
+        logger6->addAppender(sylar::LogAppender::ptr(
+            new sylar::CompressedFileLogAppender("./log.txt.gz", 6, 4096)));
+        for (int i = 0; i < 1000; ++i)
+        {
+            LOG_INFO(logger6) << "compressed log line " << i;
+        }
+    }
+
     //	std::cout << system("color 1") << "hello" << std::endl;
     std::cout << Util::lexical_cast<int>("1021") + 1;
     //system("pause");
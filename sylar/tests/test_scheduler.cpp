@@ -0,0 +1,272 @@
+#include "../sylar/fiber/scheduler.h"
+#include "../sylar/log/log.h"
+#include "test_helper.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <sched.h>
+#include <string>
+#include <thread>
+
+/**
+ * 调度器功能测试: 外部提交、工作线程内扇出、主动让出、挂起后唤醒、互相唤醒、停止时的并发提交、MDC随协程迁移
+ * 校验每个任务恰好执行一次, 失败时返回非0
+ */
+
+static sylar::Logger::ptr g_logger = LOG_ROOT;
+using testing::check;
+
+// 非工作线程提交, 进入全局队列
+void test_external()
+{
+    const int count = 100000;
+    std::atomic<int> done(0);
+    sylar::Scheduler scheduler(4, "ext");
+    scheduler.start();
+    for (int i = 0; i < count; ++i)
+    {
+        scheduler.schedule([&done]()
+                           { ++done; });
+    }
+    scheduler.stop();
+    check(done == count, "external done = " + std::to_string(done));
+    check(!scheduler.schedule([]() {}), "schedule after stop");
+}
+
+// 在工作线程上递归扇出, 任务进入本地队列后被其他线程窃取
+static void fanout(sylar::Scheduler *scheduler, int depth, std::atomic<int> *done)
+{
+    ++*done;
+    if (depth == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        scheduler->schedule([scheduler, depth, done]()
+                            { fanout(scheduler, depth - 1, done); });
+    }
+}
+
+void test_fanout()
+{
+    // 4叉树深度8的节点数
+    const int count = ((1 << 18) - 1) / 3;
+    std::atomic<int> done(0);
+    sylar::Scheduler scheduler(4, "fan");
+    scheduler.start();
+    scheduler.schedule([&scheduler, &done]()
+                       {
+                           check(sylar::Scheduler::GetThis() == &scheduler, "GetThis");
+                           fanout(&scheduler, 8, &done); });
+    scheduler.stop();
+    check(done == count, "fanout done = " + std::to_string(done) + " expect " + std::to_string(count));
+}
+
+// 主动让出后重新排队, 可能在其他线程上继续
+void test_yield_to_ready()
+{
+    const int fibers = 64;
+    const int rounds = 100;
+    std::atomic<int> done(0);
+    sylar::Scheduler scheduler(4, "yield");
+    scheduler.start();
+    for (int i = 0; i < fibers; ++i)
+    {
+        scheduler.schedule([&done, rounds]()
+                           {
+                               for (int r = 0; r < rounds; ++r)
+                               {
+                                   sylar::Scheduler::YieldToReady();
+                               }
+                               ++done; });
+    }
+    scheduler.stop();
+    check(done == fibers, "yield done = " + std::to_string(done));
+}
+
+// 挂起的协程由外部线程唤醒
+void test_hold_and_wake()
+{
+    std::atomic<int> step(0);
+    sylar::Scheduler scheduler(2, "hold");
+    scheduler.start();
+    sylar::Fiber::ptr fiber = std::make_shared<sylar::Fiber>([&step]()
+                                                             {
+                                                                 step = 1;
+                                                                 sylar::Fiber::Yield();
+                                                                 step = 2; });
+    check(scheduler.schedule(fiber), "schedule hold fiber");
+    while (step != 1 || fiber->getState() != sylar::Fiber::READY)
+    {
+        sylar::CpuRelax();
+    }
+    check(scheduler.schedule(fiber), "wake hold fiber");
+    scheduler.stop();
+    check(step == 2 && fiber->getState() == sylar::Fiber::TERM, "hold step = " + std::to_string(step));
+    check(!scheduler.schedule(fiber), "schedule terminated fiber");
+}
+
+// 两个协程互相唤醒, 唤醒的协程走LIFO槽
+void test_ping_pong()
+{
+    const int rounds = 10000;
+    std::atomic<int> pings(0);
+    std::atomic<int> pongs(0);
+    sylar::Scheduler scheduler(2, "pingpong");
+    scheduler.start();
+    sylar::Fiber::ptr ping;
+    sylar::Fiber::ptr pong;
+    pong = std::make_shared<sylar::Fiber>([&]()
+                                          {
+                                              for (int i = 1; i <= rounds; ++i)
+                                              {
+                                                  ++pongs;
+                                                  sylar::Scheduler::GetThis()->schedule(ping);
+                                                  if (i < rounds)
+                                                  {
+                                                      sylar::Fiber::Yield();
+                                                  }
+                                              } });
+    ping = std::make_shared<sylar::Fiber>([&]()
+                                          {
+                                              for (int i = 0; i < rounds; ++i)
+                                              {
+                                                  ++pings;
+                                                  sylar::Scheduler::GetThis()->schedule(pong);
+                                                  sylar::Fiber::Yield();
+                                              } });
+    scheduler.schedule(ping);
+    scheduler.stop();
+    check(pings == rounds && pongs == rounds, "ping pong = " + std::to_string(pings) + "/" + std::to_string(pongs));
+    check(ping->getState() == sylar::Fiber::TERM && pong->getState() == sylar::Fiber::TERM, "ping pong state");
+}
+
+// stop 期间外部线程持续提交: 被接受的任务都要执行, stop 开始后的提交被拒绝
+void test_stop_race()
+{
+    std::atomic<int> accepted(0);
+    std::atomic<int> ran(0);
+    std::atomic<bool> done(false);
+    sylar::Scheduler scheduler(2, "stop");
+    scheduler.start();
+    sylar::Thread producer([&]()
+                           {
+                               while (!done)
+                               {
+                                   if (scheduler.schedule([&ran]()
+                                                          { ++ran; }))
+                                   {
+                                       ++accepted;
+                                   }
+                               } },
+                           "stop_producer");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    scheduler.stop();
+    int acceptedAtStop = accepted;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    done = true;
+    producer.join();
+    check(accepted == ran, "stop race accepted = " + std::to_string(accepted) + " ran = " + std::to_string(ran));
+    check(accepted == acceptedAtStop, "schedule accepted after stop");
+}
+
+// 工作线程名为 前缀_编号
+void test_thread_name()
+{
+    std::string name;
+    sylar::Scheduler scheduler(1, "named");
+    scheduler.start();
+    scheduler.schedule([&name]()
+                       {
+                           name = sylar::Thread::GetName();
+                           LOG_INFO(g_logger) << "run in worker"; });
+    scheduler.stop();
+    check(name == "named_0", "thread name = " + name);
+}
+
+// 协程每轮挂起前让一个忙任务占住当前线程, 再由外部唤醒, 只能由另一个工作线程接着运行;
+// 恢复后 %X 仍应输出本协程设置的上下文, 而不是该线程上其他协程的
+void test_mdc_steal()
+{
+    const int rounds = 20;
+    sylar::Scheduler scheduler(2, "mdc");
+    sylar::LogFormatter::ptr fmt(new sylar::LogFormatter("%X|%X{req}"));
+    std::atomic<int> parked(0);
+    std::atomic<int> resumed(0);
+    std::atomic<bool> busyStarted(false);
+    int migrated = 0;
+    int mismatched = 0;
+    std::string last;
+
+    // 忙任务在同一线程上设置自己的上下文, 直到第round轮协程恢复运行
+    auto busy = [&](int round)
+    {
+        sylar::MDC::Guard guard("req", "busy");
+        busyStarted = true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (resumed < round && std::chrono::steady_clock::now() < deadline)
+        {
+            sched_yield();
+        }
+    };
+
+    scheduler.start();
+    sylar::Fiber::ptr fiber = std::make_shared<sylar::Fiber>([&]()
+                                                             {
+        sylar::MDC::Put("req", "steal");
+        for (int r = 1; r <= rounds; ++r)
+        {
+            uint32_t before = getThreadId();
+            busyStarted = false;
+            sylar::Scheduler::GetThis()->schedule(std::bind(busy, r));
+            parked = r;
+            sylar::Fiber::Yield();
+            resumed = r;
+
+            if (getThreadId() != before)
+            {
+                ++migrated;
+            }
+            sylar::LogEvent::ptr event(new sylar::LogEvent(g_logger, sylar::LogLevel::INFO, __FILE__, __LINE__, 0,
+                                                           getThreadId(), sylar::Fiber::GetFiberId(), 0,
+                                                           sylar::Thread::GetName()));
+            std::string out = fmt->format(g_logger, sylar::LogLevel::INFO, event);
+            if (out != "req=steal|steal")
+            {
+                ++mismatched;
+                last = out;
+            }
+        }
+        sylar::MDC::Clear(); });
+    check(scheduler.schedule(fiber), "schedule mdc fiber");
+    for (int r = 1; r <= rounds; ++r)
+    {
+        while (parked != r || !busyStarted || fiber->getState() != sylar::Fiber::READY)
+        {
+            sched_yield();
+        }
+        scheduler.schedule(fiber);
+    }
+    scheduler.stop();
+
+    LOG_INFO(g_logger) << "mdc fiber migrated " << migrated << "/" << rounds;
+    check(fiber->getState() == sylar::Fiber::TERM, "mdc fiber state");
+    check(migrated > 0, "mdc fiber never resumed on another thread");
+    check(mismatched == 0, "mdc after steal = \"" + last + "\", mismatched " + std::to_string(mismatched));
+    check(!sylar::MDC::GetSnapshot(), "mdc of the main thread untouched");
+}
+
+int main(int argc, char const *argv[])
+{
+    test_external();
+    test_fanout();
+    test_yield_to_ready();
+    test_hold_and_wake();
+    test_ping_pong();
+    test_stop_race();
+    test_thread_name();
+    test_mdc_steal();
+    return testing::Finish();
+}
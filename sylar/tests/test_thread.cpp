@@ -0,0 +1,118 @@
+#include "../sylar/thread/thread.h"
+#include "../sylar/log/log.h"
+#include "test_helper.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+static sylar::Logger::ptr g_logger = LOG_ROOT;
+
+using testing::check;
+
+static int g_count = 0;
+static sylar::Mutex g_mutex;
+static std::vector<std::string> g_names; // 各线程看到的 GetName(), 由g_mutex保护
+
+void fun1()
+{
+    LOG_INFO(g_logger) << "name: " << sylar::Thread::GetName()
+                       << " this.name: " << sylar::Thread::GetThis()->getName()
+                       << " id: " << getThreadId()
+                       << " this.id: " << sylar::Thread::GetThis()->getId();
+    {
+        sylar::Mutex::Lock lock(g_mutex);
+        g_names.push_back(sylar::Thread::GetName());
+    }
+    for (int i = 0; i < 100000; ++i)
+    {
+        sylar::Mutex::Lock lock(g_mutex);
+        ++g_count;
+    }
+}
+
+void test_thread()
+{
+    std::vector<sylar::Thread::ptr> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.push_back(std::make_shared<sylar::Thread>(&fun1, "name_" + std::to_string(i)));
+    }
+    for (auto &t : threads)
+    {
+        check(t->getId() > 0, "thread id valid after construction: " + t->getName());
+        t->join();
+    }
+    LOG_INFO(g_logger) << "count = " << g_count;
+    check(g_count == 400000, "count = " + std::to_string(g_count) + ", expected 400000");
+
+    std::sort(g_names.begin(), g_names.end());
+    check(g_names == std::vector<std::string>({"name_0", "name_1", "name_2", "name_3"}),
+          "GetName() in each thread matches the requested name");
+}
+
+// 在绑核线程中记录名称和运行过的CPU, 多次采样以覆盖被调度到其他CPU的情况
+struct PinnedResult
+{
+    std::string name;
+    std::vector<int> cpus;
+};
+
+static void RunPinned(const std::string &name, const sylar::ThreadAffinity &affinity,
+                      const std::vector<int> &allowed)
+{
+    PinnedResult result;
+    sylar::Thread t([&result]()
+                    {
+                        result.name = sylar::Thread::GetName();
+                        for (int i = 0; i < 100; ++i)
+                        {
+                            result.cpus.push_back(sched_getcpu());
+                            sched_yield();
+                        }
+                    },
+                    name, affinity);
+    t.join();
+
+    LOG_INFO(g_logger) << name << " running on cpu " << result.cpus.front();
+    check(result.name == name, name + ": GetName() = " + result.name);
+    for (int cpu : result.cpus)
+    {
+        if (std::find(allowed.begin(), allowed.end(), cpu) == allowed.end())
+        {
+            check(false, name + ": ran on cpu " + std::to_string(cpu) + " outside the pinned set");
+            break;
+        }
+    }
+}
+
+// 绑定到CPU 0 和 NUMA 节点 0
+void test_affinity()
+{
+    std::vector<int> node0Cpus = sylar::Thread::GetNumaNodeCpus(0);
+    LOG_INFO(g_logger) << "numa node 0 cpus: " << node0Cpus.size();
+
+    sylar::ThreadAffinity cpu0;
+    cpu0.cpus.push_back(0);
+    RunPinned("pinned_cpu0", cpu0, cpu0.cpus);
+
+    // 没有NUMA信息(如容器中没有挂载sysfs)时绑核会失败, 跳过
+    if (node0Cpus.empty())
+    {
+        std::cout << "numa node 0 not found, skip pinned_node0" << std::endl;
+        return;
+    }
+    sylar::ThreadAffinity node0;
+    node0.numaNode = 0;
+    RunPinned("pinned_node0", node0, node0Cpus);
+}
+
+int main(int argc, char const *argv[])
+{
+    LOG_INFO(g_logger) << "thread test begin";
+    test_thread();
+    test_affinity();
+    LOG_INFO(g_logger) << "thread test end";
+    return testing::Finish();
+}
@@ -0,0 +1,224 @@
+#include "../sylar/timer/timer.h"
+#include "../sylar/log/log.h"
+#include "test_helper.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 定时器测试: 到期顺序与精度、循环、取消、重新计时、条件定时器、跨级别下移, 以及添加/取消的耗时
+ * 失败时返回非0
+ */
+
+static sylar::Logger::ptr g_logger = LOG_ROOT;
+
+using Clock = std::chrono::steady_clock;
+
+using testing::check;
+
+static uint64_t ElapsedMs(Clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - begin).count();
+}
+
+static void SleepMs(uint64_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// 一次性定时器不早于设定时间到期, 且按到期时间顺序执行
+void test_oneshot(sylar::TimerManager &manager)
+{
+    std::vector<int> order;
+    std::mutex mutex;
+    auto begin = Clock::now();
+    std::atomic<uint64_t> earliest(~0ULL);
+    for (int ms : {50, 10, 30, 20, 40})
+    {
+        manager.addTimer(ms, [&, ms]()
+                         {
+                             uint64_t elapsed = ElapsedMs(begin);
+                             check(elapsed >= static_cast<uint64_t>(ms), "oneshot fired early " + std::to_string(ms));
+                             std::lock_guard<std::mutex> lock(mutex);
+                             order.push_back(ms); });
+    }
+    SleepMs(150);
+    std::lock_guard<std::mutex> lock(mutex);
+    check(order == std::vector<int>({10, 20, 30, 40, 50}), "oneshot order");
+    check(!manager.hasTimer(), "oneshot all fired");
+}
+
+void test_recurring(sylar::TimerManager &manager)
+{
+    std::atomic<int> count(0);
+    sylar::Timer::ptr timer = manager.addTimer(20, [&count]()
+                                               { ++count; },
+                                               true);
+    SleepMs(210);
+    check(timer->cancel(), "recurring cancel");
+    int fired = count;
+    LOG_INFO(g_logger) << "recurring 20ms fired " << fired << " times in 210ms";
+    check(fired >= 8 && fired <= 11, "recurring count = " + std::to_string(fired));
+    SleepMs(50);
+    check(count == fired, "recurring after cancel");
+    check(!timer->cancel(), "cancel twice");
+}
+
+void test_cancel_refresh(sylar::TimerManager &manager)
+{
+    std::atomic<int> cancelled(0);
+    sylar::Timer::ptr timer = manager.addTimer(30, [&cancelled]()
+                                               { ++cancelled; });
+    check(timer->cancel(), "cancel");
+    check(!timer->refresh(), "refresh cancelled");
+
+    // 不断重新计时的定时器不会到期
+    std::atomic<int> refreshed(0);
+    auto begin = Clock::now();
+    std::atomic<uint64_t> firedAt(0);
+    timer = manager.addTimer(50, [&]()
+                             {
+                                 ++refreshed;
+                                 firedAt = ElapsedMs(begin); });
+    for (int i = 0; i < 5; ++i)
+    {
+        SleepMs(20);
+        check(timer->refresh(), "refresh");
+    }
+    SleepMs(100);
+    check(cancelled == 0, "cancelled timer fired");
+    check(refreshed == 1 && firedAt >= 150, "refresh fired " + std::to_string(refreshed) + " at " + std::to_string(firedAt));
+    check(!timer->refresh(), "refresh finished");
+
+    // 修改周期
+    std::atomic<int> resetCount(0);
+    timer = manager.addTimer(1000, [&resetCount]()
+                             { ++resetCount; });
+    check(timer->reset(20, true), "reset");
+    SleepMs(80);
+    check(resetCount == 1, "reset fired");
+}
+
+struct Owner
+{
+    std::atomic<int> count{0};
+};
+
+// 条件对象销毁后定时器自动取消
+void test_condition(sylar::TimerManager &manager)
+{
+    std::shared_ptr<Owner> owner = std::make_shared<Owner>();
+    Owner *raw = owner.get();
+    std::atomic<int> calls(0);
+    manager.addConditionTimer(10, [raw, &calls]()
+                              {
+                                  ++raw->count;
+                                  ++calls; },
+                              owner, true);
+    SleepMs(55);
+    check(owner->count >= 3, "condition count = " + std::to_string(owner->count));
+    owner.reset();
+    int before = calls;
+    SleepMs(50);
+    check(calls == before, "condition after owner destroyed");
+    check(!manager.hasTimer(), "condition auto cancelled");
+}
+
+// 超过第0级范围的定时器经过下移后按时到期
+void test_cascade(sylar::TimerManager &manager)
+{
+    std::vector<uint64_t> delays = {255, 256, 300, 511, 700, 1200};
+    std::vector<std::atomic<uint64_t>> firedAt(delays.size());
+    auto begin = Clock::now();
+    for (size_t i = 0; i < delays.size(); ++i)
+    {
+        firedAt[i] = 0;
+        manager.addTimer(delays[i], [&firedAt, i, begin]()
+                         { firedAt[i] = ElapsedMs(begin); });
+    }
+    LOG_INFO(g_logger) << "next timer in " << manager.getNextTimer() << " ms";
+    SleepMs(1300);
+    for (size_t i = 0; i < delays.size(); ++i)
+    {
+        LOG_INFO(g_logger) << "cascade " << delays[i] << "ms fired at " << firedAt[i] << "ms";
+        check(firedAt[i] >= delays[i] && firedAt[i] < delays[i] + 50, "cascade " + std::to_string(delays[i]));
+    }
+}
+
+// 恰好在第0级一圈边界(第256个tick)到期的定时器, 下移时应当在该tick执行, 而不是推迟到下一个tick.
+// 用10ms的tick放大误差: 构造后立即添加时起点是tick 1, 255个tick后到期的A落在边界上,
+// 256个tick后到期的B在下一个tick; A执行时B应当还在时间轮中
+void test_cascade_boundary()
+{
+    const uint64_t tickMs = 10;
+    auto begin = Clock::now();
+    sylar::TimerManager manager(tickMs, "boundary");
+    std::atomic<uint64_t> firedA(0);
+    std::atomic<uint64_t> firedB(0);
+    std::atomic<bool> pendingB(false);
+    manager.addTimer(255 * tickMs, [&]()
+                     {
+                         firedA = ElapsedMs(begin);
+                         pendingB = manager.hasTimer(); });
+    sylar::Timer::ptr b = manager.addTimer(256 * tickMs, [&]()
+                                           { firedB = ElapsedMs(begin); });
+    if (ElapsedMs(begin) >= tickMs)
+    {
+        // 起点不是tick 1, A不在边界上, 结果没有意义
+        LOG_INFO(g_logger) << "cascade boundary skipped, setup took " << ElapsedMs(begin) << " ms";
+        b->cancel();
+        return;
+    }
+
+    SleepMs(257 * tickMs + 200);
+    LOG_INFO(g_logger) << "cascade boundary A fired at " << firedA << "ms, B at " << firedB << "ms";
+    check(firedA >= 256 * tickMs && firedA < 257 * tickMs, "cascade boundary A at " + std::to_string(firedA));
+    check(firedB >= 257 * tickMs, "cascade boundary B at " + std::to_string(firedB));
+    check(pendingB, "cascade boundary A fired together with B");
+}
+
+// 大量随机定时器, 到期前取消一半, 其余恰好执行一次
+void test_many(sylar::TimerManager &manager)
+{
+    const int count = 20000;
+    std::mt19937 rng(1);
+    std::atomic<int> fired(0);
+    std::vector<sylar::Timer::ptr> timers;
+    auto begin = Clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        timers.push_back(manager.addTimer(200 + rng() % 300, [&fired]()
+                                          { ++fired; }));
+    }
+    uint64_t addNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+    int cancelled = 0;
+    begin = Clock::now();
+    for (int i = 0; i < count; i += 2)
+    {
+        cancelled += timers[i]->cancel() ? 1 : 0;
+    }
+    uint64_t cancelNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+    LOG_INFO(g_logger) << "addTimer " << addNs / count << " ns, cancel " << cancelNs / (count / 2) << " ns";
+
+    SleepMs(700);
+    check(cancelled == count / 2 && fired == count - cancelled,
+          "many fired = " + std::to_string(fired) + " cancelled = " + std::to_string(cancelled));
+    check(!manager.hasTimer(), "many all done");
+}
+
+int main(int argc, char const *argv[])
+{
+    sylar::TimerManager manager(1, "test_timer");
+    test_oneshot(manager);
+    test_recurring(manager);
+    test_cancel_refresh(manager);
+    test_condition(manager);
+    test_cascade(manager);
+    test_cascade_boundary();
+    test_many(manager);
+    return testing::Finish();
+}
@@ -0,0 +1,130 @@
+#include "../sylar/util/util.h"
+#include "test_helper.h"
+#include <clocale>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+using testing::check;
+
+template <typename T>
+static bool Rejected(const std::string &str)
+{
+    try
+    {
+        Util::lexical_cast<T>(str);
+    }
+    catch (const Util::bad_lexical_cast &)
+    {
+        return true;
+    }
+    return false;
+}
+
+void test_integer()
+{
+    check(Util::lexical_cast<int>(std::string("1021")) == 1021, "int");
+    check(Util::lexical_cast<int16_t>(std::string("-32768")) == -32768, "int16 min");
+    check(Rejected<int16_t>("32768"), "int16 overflow");
+    check(Rejected<uint32_t>("-1"), "unsigned negative");
+    check(Util::lexical_cast<int64_t>(std::string("-9223372036854775808")) == std::numeric_limits<int64_t>::min(),
+          "int64 min");
+    check(Rejected<int64_t>("9223372036854775808"), "int64 overflow");
+    check(Util::lexical_cast<std::string>(-42) == "-42", "int to string");
+    check(Rejected<int>(" 1") && Rejected<int>("1 ") && Rejected<int>("") && Rejected<int>("+"), "int rejection");
+}
+
+void test_float()
+{
+    check(Util::lexical_cast<double>(std::string("1.5")) == 1.5, "double");
+    check(Util::lexical_cast<double>(std::string("-2.5e-3")) == -2.5e-3, "double exponent");
+    check(Util::lexical_cast<float>(std::string("10.2")) == 10.2f, "float");
+    check(Util::lexical_cast<std::string>(0.1) == "0.1", "shortest 0.1");
+    check(Util::lexical_cast<std::string>(10.2f) == "10.2", "shortest 10.2f");
+
+    // 上溢
+    check(Rejected<double>("1e309"), "double overflow");
+    check(Rejected<float>("3.5e38"), "float overflow");
+    check(Util::lexical_cast<double>(std::string("1e-400")) == 0.0, "double underflow to zero");
+
+    // 只接受十进制写法
+    const char *bad[] = {"", " 1.5", "1.5 ", "0x1p3", "0X10", "inf", "-inf", "INF", "infinity", "nan", "NAN(1)",
+                         "1,5", "1.5f", "e5", ".", "-", "1e", "1.5.5"};
+    for (const char *s : bad)
+    {
+        check(Rejected<double>(s) && Rejected<float>(s), std::string("accepted '") + s + "'");
+    }
+
+    // 往返: 格式化后解析回来与原值逐位相等
+    std::mt19937_64 rng(42);
+    for (int i = 0; i < 100000; ++i)
+    {
+        uint64_t bits = rng();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (std::isfinite(d))
+        {
+            std::string s = Util::lexical_cast<std::string>(d);
+            check(Util::lexical_cast<double>(s) == d, "double round trip " + s);
+        }
+
+        uint32_t fbits = static_cast<uint32_t>(bits >> 32);
+        float f;
+        memcpy(&f, &fbits, sizeof(f));
+        if (std::isfinite(f))
+        {
+            std::string s = Util::lexical_cast<std::string>(f);
+            check(Util::lexical_cast<float>(s) == f, "float round trip " + s);
+        }
+    }
+    check(Util::lexical_cast<double>(Util::lexical_cast<std::string>(std::numeric_limits<double>::max())) ==
+              std::numeric_limits<double>::max(),
+          "double max round trip");
+    check(Util::lexical_cast<float>(Util::lexical_cast<std::string>(std::numeric_limits<float>::denorm_min())) ==
+              std::numeric_limits<float>::denorm_min(),
+          "float denorm_min round trip");
+}
+
+void test_locale()
+{
+    // 小数点为','的locale下结果不变
+    const char *names[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "ru_RU.UTF-8"};
+    const char *name = nullptr;
+    for (const char *n : names)
+    {
+        if (setlocale(LC_ALL, n))
+        {
+            name = n;
+            break;
+        }
+    }
+    if (!name)
+    {
+        std::cout << "skip test_locale: no locale with ',' decimal point installed" << std::endl;
+        return;
+    }
+
+    check(Util::lexical_cast<double>(std::string("1.5")) == 1.5, std::string("parse under ") + name);
+    check(Rejected<double>("1,5"), std::string("accepted '1,5' under ") + name);
+    check(Util::lexical_cast<std::string>(1.5) == "1.5", std::string("format under ") + name);
+    setlocale(LC_ALL, "C");
+}
+
+void test_bool()
+{
+    check(Util::lexical_cast<bool>(std::string("true")) && !Util::lexical_cast<bool>(std::string("0")), "bool");
+    check(Rejected<bool>("yes"), "bool rejection");
+    check(Util::lexical_cast<std::string>(true) == "1", "bool to string");
+}
+
+int main(int argc, char const *argv[])
+{
+    test_integer();
+    test_float();
+    test_locale();
+    test_bool();
+    return testing::Finish();
+}